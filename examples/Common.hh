@@ -73,19 +73,29 @@ inline void report(_Step_t num_steps, _Pi_t pi, timer::timer& t,
 
 //----------------------------------------------------------------------------//
 
+template <typename _Tp>
+_Tp GetEnv(const std::string& env_id, _Tp _default = _Tp())
+{
+    char* env_var = getenv(env_id.c_str());
+    if(env_var)
+    {
+        std::string str_var = std::string(env_var);
+        std::istringstream iss(str_var);
+        _Tp var = _Tp();
+        iss >> var;
+        return var;
+    }
+    return _default;
+}
+
+//----------------------------------------------------------------------------//
+
 template <typename _Size_t>
 _Size_t GetEnvNumSteps(_Size_t _default = 500000000)
 {
-    char* env_nsteps;
-    env_nsteps = getenv("NUM_STEPS");
-    if(env_nsteps)
-    {
-        std::string str_nsteps = std::string(env_nsteps);
-        std::istringstream iss(str_nsteps);
-        _Size_t _n = 0;
-        iss >> _n;
+    _Size_t _n = GetEnv<_Size_t>("NUM_STEPS", 0);
+    if(_n > 0)
         return _n;
-    }
 
     if(_default > 0)
         return _default;
@@ -0,0 +1,174 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+//
+//
+//  Load-imbalanced loop: the cost of iteration "i" grows linearly with "i"
+//  (the last iteration is ~WORK_RATIO times more expensive than the first),
+//  so an even static split leaves most threads idle while the thread owning
+//  the last block finishes.
+//
+//      - static     : run_loop with one chunk per thread (pi_thread_pool)
+//      - dynamic    : run_loop with loop_schedule::dynamic(CHUNK_SIZE)
+//      - guided     : run_loop with loop_schedule::guided(CHUNK_SIZE)
+//      - omp static/dynamic/guided (when built with OpenMP, cf. omp_pi_loop)
+//
+//  environment: NUM_STEPS, WORK_RATIO, CHUNK_SIZE, NUM_THREADS
+//
+//
+
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <string>
+
+#include <madthreading/types.hh>
+#include <madthreading/utility/timer.hh>
+#include <madthreading/threading/thread_manager.hh>
+#include "../Common.hh"
+
+using namespace mad;
+
+//============================================================================//
+
+static ulong_type num_steps = 0;
+static ulong_type work_ratio = 0;
+
+//----------------------------------------------------------------------------//
+// cost of iteration "i" is 1 + work_ratio * i / num_steps inner iterations
+inline double_type kernel(ulong_type i)
+{
+    ulong_type _n = 1 + (work_ratio * i) / num_steps;
+    double_type _sum = 0.0;
+    for(ulong_type j = 0; j < _n; ++j)
+        _sum += 1.0 / std::sqrt(static_cast<double_type>(i + j + 1));
+    return _sum;
+}
+
+//----------------------------------------------------------------------------//
+
+inline int check(const std::string& prefix, double_type value,
+                 double_type reference, timer::timer& t)
+{
+    double_type _rel = std::fabs(value - reference) / std::fabs(reference);
+    std::cout << " " << std::setw(24) << prefix << ": "
+              << std::scientific << std::setprecision(10) << value
+              << " (rel. diff = " << std::setprecision(2) << _rel << ") in ";
+    t.report();
+    std::cout << std::endl;
+    return (_rel > 1.0e-10) ? 1 : 0;
+}
+
+//============================================================================//
+
+int main(int, char**)
+{
+    num_steps = GetEnvNumSteps(200000UL);
+    work_ratio = GetEnv<ulong_type>("WORK_RATIO", 100);
+    ulong_type chunk = GetEnv<ulong_type>("CHUNK_SIZE", 16);
+    ulong_type num_threads = thread_manager::GetEnvNumThreads(1);
+    thread_manager* tm = new thread_manager(num_threads);
+    task_group tg;
+    int ret = 0;
+
+    double_ts sum(0.0);
+    auto compute_block = [&sum] (const ulong_type& s, const ulong_type& e)
+    {
+        double_type tl_sum = 0.0;
+        for(ulong_type i = s; i < e; ++i)
+            tl_sum += kernel(i);
+        sum += tl_sum;
+    };
+
+    std::cout << "\nImbalanced loop with " << num_steps << " steps, "
+              << "work ratio " << work_ratio << ", chunk " << chunk
+              << ", and " << num_threads << " threads\n" << std::endl;
+
+    //========================================================================//
+    timer::timer t_ref;
+    double_type reference = 0.0;
+    for(ulong_type i = 0; i < num_steps; ++i)
+        reference += kernel(i);
+    check("serial", reference, reference, t_ref.stop_and_return());
+
+    //========================================================================//
+    sum = 0.0;
+    timer::timer t_static;
+    tm->run_loop(&tg, compute_block, 0UL, num_steps, num_threads);
+    tg.join();
+    ret += check("mad static", sum, reference, t_static.stop_and_return());
+
+    //========================================================================//
+    sum = 0.0;
+    timer::timer t_dynamic;
+    tm->run_loop(&tg, compute_block, 0UL, num_steps,
+                 loop_schedule::dynamic(chunk));
+    tg.join();
+    ret += check("mad dynamic", sum, reference, t_dynamic.stop_and_return());
+
+    //========================================================================//
+    sum = 0.0;
+    timer::timer t_guided;
+    tm->run_loop(&tg, compute_block, 0UL, num_steps,
+                 loop_schedule::guided(chunk));
+    tg.join();
+    ret += check("mad guided", sum, reference, t_guided.stop_and_return());
+
+#if defined(USE_OPENMP)
+    omp_set_num_threads(num_threads);
+
+    //========================================================================//
+    double_type omp_sum = 0.0;
+    timer::timer t_omp_static;
+    #pragma omp parallel for reduction(+:omp_sum) schedule(static)
+    for(ulong_type i = 0; i < num_steps; ++i)
+        omp_sum += kernel(i);
+    ret += check("omp static", omp_sum, reference,
+                 t_omp_static.stop_and_return());
+
+    //========================================================================//
+    omp_sum = 0.0;
+    timer::timer t_omp_dynamic;
+    #pragma omp parallel for reduction(+:omp_sum) schedule(dynamic, chunk)
+    for(ulong_type i = 0; i < num_steps; ++i)
+        omp_sum += kernel(i);
+    ret += check("omp dynamic", omp_sum, reference,
+                 t_omp_dynamic.stop_and_return());
+
+    //========================================================================//
+    omp_sum = 0.0;
+    timer::timer t_omp_guided;
+    #pragma omp parallel for reduction(+:omp_sum) schedule(guided, chunk)
+    for(ulong_type i = 0; i < num_steps; ++i)
+        omp_sum += kernel(i);
+    ret += check("omp guided", omp_sum, reference,
+                 t_omp_guided.stop_and_return());
+#endif
+
+    std::cout << std::endl;
+    delete tm;
+    return ret;
+}
+
+//============================================================================//
@@ -0,0 +1,73 @@
+//
+//
+//	Multithreading example using custom MT API
+//		- API uses a thread-pool
+//		- thread_manager::parallel_reduce over a blocked_range (like
+//		  pi_lambda_tbb): per-thread partials combined in a tree, no
+//		  atomic accumulator
+//		- the deterministic_partitioner version gives the same sum for
+//		  any number of threads
+//
+//
+
+#include <iostream>
+#include <iomanip>
+
+#include <madthreading/types.hh>
+#include <madthreading/utility/timer.hh>
+#include <madthreading/threading/thread_manager.hh>
+#include "../Common.hh"
+
+using namespace mad;
+
+//============================================================================//
+
+int main(int, char** argv)
+{
+    typedef blocked_range<ulong_type> range_t;
+
+    ulong_type num_steps = GetEnvNumSteps(500000000UL);
+    double_type step = 1.0/static_cast<double_type>(num_steps);
+    ulong_type num_threads = thread_manager::GetEnvNumThreads(1);
+    thread_manager* tm = new thread_manager(num_threads);
+
+    //------------------------------------------------------------------------//
+    auto compute_block = [step] (const range_t& r, double_type tl_sum)
+    {
+        auto x = [step] (const ulong_type& i) { return (i-0.5)*step; };
+        pragma_simd
+        for(ulong_type i = r.begin(); i < r.end(); ++i)
+            tl_sum += 4.0/(1.0 + x(i)*x(i));
+        return tl_sum;
+    };
+    //------------------------------------------------------------------------//
+    auto join = [] (double_type _x, double_type _y) { return _x+_y; };
+    //------------------------------------------------------------------------//
+
+    //========================================================================//
+    timer::timer t;
+
+    double_type sum = tm->parallel_reduce(range_t(0, num_steps, 10000), 0.0,
+                                          compute_block, join);
+
+    report(num_steps, step*sum, t.stop_and_return(), argv[0]);
+    //========================================================================//
+
+    //========================================================================//
+    timer::timer t_det;
+
+    double_type det_sum = tm->parallel_reduce(range_t(0, num_steps, 10000),
+                                              0.0, compute_block, join,
+                                              deterministic_partitioner());
+
+    report(num_steps, step*det_sum, t_det.stop_and_return(),
+           std::string(argv[0]) + "_deterministic");
+    //========================================================================//
+
+    double_type pi = step * sum;
+    double_type det_pi = step * det_sum;
+    delete tm;
+    return (fabs(pi - M_PI) > PI_EPSILON || fabs(det_pi - M_PI) > PI_EPSILON);
+}
+
+//============================================================================//
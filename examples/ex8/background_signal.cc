@@ -0,0 +1,134 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+//
+//
+//	Throughput and round-trip latency of background task signals
+//		- N producers signal the same background task as fast as they can,
+//		  every signal executes the (empty) task once
+//		- round trip = signal + wait on the returned background_future
+//
+//	environment: NUM_SIGNALS (total per run), MAX_PRODUCERS, NUM_ROUND_TRIPS
+//
+//
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <atomic>
+
+#include <madthreading/types.hh>
+#include <madthreading/threading/thread_manager.hh>
+#include "../Common.hh"
+
+using namespace mad;
+
+typedef std::chrono::high_resolution_clock  clock_type;
+typedef std::chrono::duration<double>       duration_type;
+
+//============================================================================//
+// returns signals per millisecond, from the first signal until the last
+// execution finished
+double measure(thread_manager* tm, background_channel* channel,
+               ulong_type nproducers, ulong_type nsignals)
+{
+    std::atomic<bool> go(false);
+    ulong_type per_producer = nsignals / nproducers;
+    ulong_type total = per_producer * nproducers;
+    std::vector<background_future> last(nproducers);
+
+    std::vector<std::thread> producers;
+    for(ulong_type i = 0; i < nproducers; ++i)
+    {
+        producers.push_back(std::thread([&, i] ()
+        {
+            while(!go.load())
+                std::this_thread::yield();
+            for(ulong_type j = 0; j < per_producer; ++j)
+                last[i] = tm->signal_background(channel);
+        }));
+    }
+
+    clock_type::time_point _start = clock_type::now();
+    go.store(true);
+    for(auto& itr : producers)
+        itr.join();
+    for(auto& itr : last)
+        itr.wait();
+    duration_type _elapsed = clock_type::now() - _start;
+
+    return total / (_elapsed.count() * 1.0e3);
+}
+
+//============================================================================//
+
+int main(int, char**)
+{
+    ulong_type nsignals = GetEnv<ulong_type>("NUM_SIGNALS", 1UL << 20);
+    ulong_type max_producers = GetEnv<ulong_type>("MAX_PRODUCERS", 8);
+    ulong_type nround = GetEnv<ulong_type>("NUM_ROUND_TRIPS", 10000);
+    thread_manager* tm = new thread_manager(1);
+
+    task_group tg;
+    ulong_ts nexec = 0;
+    background_channel* channel =
+            tm->add_background_task(&tg, &nexec, [&] () { ++nexec; });
+
+    std::cout << "\nBackground signals with " << nsignals
+              << " signals per run\n" << std::endl;
+    std::cout << std::setw(12) << "producers"
+              << std::setw(20) << "signals/ms" << std::endl;
+
+    ulong_type expected = 0;
+    for(ulong_type n = 1; n <= max_producers; n *= 2)
+    {
+        double _rate = measure(tm, channel, n, nsignals);
+        expected += (nsignals / n) * n;
+        std::cout << std::setw(12) << n
+                  << std::setw(20) << std::fixed << std::setprecision(1)
+                  << _rate << std::endl;
+    }
+
+    clock_type::time_point _start = clock_type::now();
+    for(ulong_type i = 0; i < nround; ++i)
+        tm->signal_background(channel).wait();
+    duration_type _elapsed = clock_type::now() - _start;
+    expected += nround;
+
+    std::cout << "\nRound trip (signal + wait): " << std::setprecision(3)
+              << (_elapsed.count() / nround) * 1.0e6 << " us" << std::endl;
+
+    int ret = (nexec.load() == expected) ? 0 : 1;
+    if(ret != 0)
+        std::cout << "WRONG NUMBER OF EXECUTIONS: " << nexec.load()
+                  << " vs. " << expected << std::endl;
+    std::cout << std::endl;
+
+    delete tm;
+    return ret;
+}
+
+//============================================================================//
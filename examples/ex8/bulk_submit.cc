@@ -0,0 +1,99 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+//
+//
+//	Cost of submitting an N-iteration loop
+//		- "run_loop" creates and enqueues one task per iteration
+//		- "run_bulk" enqueues a single bulk_task, the workers claim the
+//		  iterations in chunks from a shared counter
+//	submit = time until the submitting call returns, total = until join
+//
+//	environment: NUM_THREADS, MAX_ITERATIONS
+//
+//
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+
+#include <madthreading/types.hh>
+#include <madthreading/threading/thread_manager.hh>
+#include "../Common.hh"
+
+using namespace mad;
+
+typedef std::chrono::high_resolution_clock  clock_type;
+typedef std::chrono::duration<double, std::milli> duration_type;
+
+//============================================================================//
+
+int main(int, char**)
+{
+    ulong_type num_threads = thread_manager::GetEnvNumThreads(4);
+    ulong_type max_iter = GetEnv<ulong_type>("MAX_ITERATIONS", 1000000);
+    thread_manager* tm = new thread_manager(num_threads);
+
+    std::vector<double> data(max_iter, 0.0);
+    auto body = [&] (ulong_type i) { data[i] += 1.0; };
+
+    std::cout << "\nLoop submission [ms] with " << num_threads << " threads\n"
+              << std::endl;
+    std::cout << std::setw(12) << "iterations"
+              << std::setw(18) << "run_loop submit"
+              << std::setw(16) << "run_loop total"
+              << std::setw(18) << "run_bulk submit"
+              << std::setw(16) << "run_bulk total" << std::endl;
+
+    for(ulong_type n = 1000; n <= max_iter; n *= 10)
+    {
+        double _times[4];
+        for(int k = 0; k < 2; ++k)
+        {
+            mad::task_group tg;
+            clock_type::time_point _start = clock_type::now();
+            if(k == 0)
+                tm->run_loop(&tg, body, 0UL, n);
+            else
+                tm->run_bulk(&tg, body, 0UL, n);
+            clock_type::time_point _submitted = clock_type::now();
+            tg.join();
+            clock_type::time_point _end = clock_type::now();
+            _times[2*k] = duration_type(_submitted - _start).count();
+            _times[2*k+1] = duration_type(_end - _start).count();
+        }
+        std::cout << std::setw(12) << n << std::fixed << std::setprecision(3)
+                  << std::setw(18) << _times[0]
+                  << std::setw(16) << _times[1]
+                  << std::setw(18) << _times[2]
+                  << std::setw(16) << _times[3] << std::endl;
+    }
+    std::cout << std::endl;
+
+    delete tm;
+    return 0;
+}
+
+//============================================================================//
@@ -0,0 +1,149 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+//
+//
+//	Recursive fibonacci(N) with fork-join
+//		- serial
+//		- std::async (one thread per spawn, as in ex7), the parent
+//		  blocks in future::get()
+//		- mad parallel_invoke and spawn_group: spawns go to the pool and
+//		  the parent helps while it waits
+//	below CUTOFF every version calls the serial function
+//
+//	environment: NUM_THREADS, FIB_N (40), CUTOFF (25)
+//
+//
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <future>
+#include <cstdint>
+
+#include <madthreading/types.hh>
+#include <madthreading/threading/thread_manager.hh>
+#include "../Common.hh"
+
+using namespace mad;
+
+typedef std::chrono::high_resolution_clock  clock_type;
+typedef std::chrono::duration<double>       duration_type;
+
+static int64_t cutoff = 25;
+
+//============================================================================//
+
+int64_t fib_serial(int64_t n)
+{
+    return (n < 2) ? n : fib_serial(n-1) + fib_serial(n-2);
+}
+
+//============================================================================//
+
+int64_t fib_async(int64_t n)
+{
+    if(n < cutoff)
+        return fib_serial(n);
+    std::future<int64_t> a = std::async(std::launch::async |
+                                        std::launch::deferred,
+                                        fib_async, n-1);
+    int64_t b = fib_async(n-2);
+    return a.get() + b;
+}
+
+//============================================================================//
+
+int64_t fib_invoke(thread_manager* tm, int64_t n)
+{
+    if(n < cutoff)
+        return fib_serial(n);
+    int64_t a = 0, b = 0;
+    tm->parallel_invoke([&] () { a = fib_invoke(tm, n-1); },
+                        [&] () { b = fib_invoke(tm, n-2); });
+    return a + b;
+}
+
+//============================================================================//
+
+int64_t fib_spawn(mad::thread_pool* tp, int64_t n)
+{
+    if(n < cutoff)
+        return fib_serial(n);
+    int64_t a = 0;
+    mad::spawn_group sg(tp);
+    sg.spawn([&] () { a = fib_spawn(tp, n-1); });
+    int64_t b = fib_spawn(tp, n-2);
+    sg.sync();
+    return a + b;
+}
+
+//============================================================================//
+
+template <typename _Func>
+void measure(const std::string& _name, _Func _func, double _serial = 0.0)
+{
+    clock_type::time_point _start = clock_type::now();
+    int64_t _result = _func();
+    double _time = duration_type(clock_type::now() - _start).count();
+    std::cout << std::setw(16) << _name << std::setw(16) << _result
+              << std::setw(12) << std::fixed << std::setprecision(3) << _time;
+    if(_serial > 0.0)
+        std::cout << std::setw(12) << std::setprecision(2) << (_serial / _time);
+    std::cout << std::endl;
+}
+
+//============================================================================//
+
+int main(int, char**)
+{
+    ulong_type num_threads = thread_manager::GetEnvNumThreads(4);
+    int64_t n = GetEnv<int64_t>("FIB_N", 40);
+    cutoff = GetEnv<int64_t>("CUTOFF", 25);
+    thread_manager* tm = new thread_manager(num_threads);
+
+    std::cout << "\nfibonacci(" << n << "), cutoff " << cutoff << ", "
+              << num_threads << " threads\n" << std::endl;
+    std::cout << std::setw(16) << "method" << std::setw(16) << "result"
+              << std::setw(12) << "time [s]" << std::setw(12) << "speed-up"
+              << std::endl;
+
+    clock_type::time_point _start = clock_type::now();
+    int64_t _result = fib_serial(n);
+    double _serial = duration_type(clock_type::now() - _start).count();
+    std::cout << std::setw(16) << "serial" << std::setw(16) << _result
+              << std::setw(12) << std::fixed << std::setprecision(3)
+              << _serial << std::endl;
+
+    measure("std::async", [&] () { return fib_async(n); }, _serial);
+    measure("parallel_invoke", [&] () { return fib_invoke(tm, n); }, _serial);
+    measure("spawn_group", [&] ()
+    { return fib_spawn(tm->thread_pool(), n); }, _serial);
+    std::cout << std::endl;
+
+    delete tm;
+    return 0;
+}
+
+//============================================================================//
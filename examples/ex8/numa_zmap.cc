@@ -0,0 +1,227 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+//
+//
+//	Remote-memory traffic of a streaming cov::accumulate_zmap workload
+//		- every chunk of samples (and its zmap) is first-touched by
+//		  whichever worker initializes it, so its pages live on that
+//		  worker's NUMA node
+//		- "no hint" then processes the chunks with a plain chunked
+//		  run_loop, any worker may take any chunk
+//		- "locality hint" passes the node of the chunk's pages, so the
+//		  chunk runs on that node unless the node runs out of work
+//	remote bytes = bytes of the chunks processed by a worker on another
+//	node than their pages (page nodes from get_mempolicy, worker nodes from
+//	sched_getcpu, no hardware counters needed). Workers are placed with
+//	placement_policy::per_numa_node. On a single node both rows are equal
+//
+//	environment: NUM_THREADS, NUM_CHUNKS, NUM_SAMPLES (per chunk), NUM_ITER
+//
+//
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <functional>
+#include <sched.h>
+
+#ifdef _OPENMP
+#   include <omp.h>
+#endif
+
+#include <madthreading/types.hh>
+#include <madthreading/threading/thread_manager.hh>
+#include <madthreading/threading/topology.hh>
+#include <madthreading/vectorization/cov.hh>
+#include "../Common.hh"
+
+using namespace mad;
+
+typedef std::chrono::high_resolution_clock  clock_type;
+typedef std::chrono::duration<double>       duration_type;
+
+static const int64_t nsub = 4;
+static const int64_t subsize = 4096;
+static const int64_t nnz = 3;
+
+//============================================================================//
+// raw allocations, the pages are placed by the first write in init()
+struct chunk_data
+{
+    explicit chunk_data(int64_t _nsamp)
+    : nsamp(_nsamp),
+      submap(new int64_t[_nsamp]),
+      pix(new int64_t[_nsamp]),
+      weights(new double[_nsamp * nnz]),
+      signal(new double[_nsamp]),
+      zdata(new double[nsub * subsize * nnz])
+    { }
+
+    ~chunk_data()
+    {
+        delete [] submap;
+        delete [] pix;
+        delete [] weights;
+        delete [] signal;
+        delete [] zdata;
+    }
+
+    void init(uint64_t _seed)
+    {
+        for(int64_t i = 0; i < nsamp; ++i)
+        {
+            _seed = _seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            submap[i] = (_seed >> 33) % nsub;
+            pix[i] = (_seed >> 17) % subsize;
+            signal[i] = 1.0e-3 * (i % 1000);
+            for(int64_t j = 0; j < nnz; ++j)
+                weights[i*nnz + j] = 1.0 / (j + 1);
+        }
+        for(int64_t i = 0; i < nsub * subsize * nnz; ++i)
+            zdata[i] = 0.0;
+    }
+
+    void accumulate()
+    {
+#ifdef _OPENMP
+        // the parallel region of accumulate_zmap would otherwise start a
+        // team of every core on each worker
+        omp_set_num_threads(1);
+#endif
+        cov::accumulate_zmap(nsub, subsize, nnz, nsamp, submap, pix, weights,
+                             1.0, signal, zdata);
+    }
+
+    double bytes() const
+    {
+        return sizeof(double) * (nsamp * (nnz + 3) + 2 * nsub * subsize * nnz);
+    }
+
+    int64_t     nsamp;
+    int64_t*    submap;
+    int64_t*    pix;
+    double*     weights;
+    double*     signal;
+    double*     zdata;
+};
+
+//============================================================================//
+
+void measure(thread_manager* tm, const std::string& name,
+             std::vector<chunk_data*>& chunks, ulong_type niter, bool hint)
+{
+    const topology& topo = topology::instance();
+    std::atomic<double> _remote(0.0);
+    std::atomic<double> _total(0.0);
+
+    auto process = [&] (ulong_type f, ulong_type l)
+    {
+        for(ulong_type i = f; i < l; ++i)
+        {
+            chunks[i]->accumulate();
+            int _page = topo.node_of_address(chunks[i]->signal);
+            int _node = topo.node_of(sched_getcpu());
+            double _bytes = chunks[i]->bytes();
+            double _expect = _total.load();
+            while(!_total.compare_exchange_weak(_expect, _expect + _bytes));
+            if(_page >= 0 && _node >= 0 && _page != _node)
+            {
+                _expect = _remote.load();
+                while(!_remote.compare_exchange_weak(_expect,
+                                                     _expect + _bytes));
+            }
+        }
+    };
+
+    auto locality = [&] (ulong_type f, ulong_type) -> long
+    {
+        return (hint) ? topo.node_of_address(chunks[f]->signal) : -1;
+    };
+
+    clock_type::time_point _start = clock_type::now();
+    for(ulong_type n = 0; n < niter; ++n)
+    {
+        mad::task_group tg;
+        tm->run_loop(&tg, process, 0UL, chunks.size(), chunks.size(),
+                     locality);
+        tg.join();
+    }
+    duration_type _elapsed = clock_type::now() - _start;
+
+    std::cout << std::setw(18) << name
+              << std::setw(14) << std::fixed << std::setprecision(4)
+              << _elapsed.count()
+              << std::setw(18) << std::setprecision(2)
+              << (_total.load() / _elapsed.count() / 1.0e9)
+              << std::setw(14) << std::setprecision(3)
+              << (_remote.load() / _total.load()) << std::endl;
+}
+
+//============================================================================//
+
+int main(int, char**)
+{
+    ulong_type num_threads = thread_manager::GetEnvNumThreads(4);
+    ulong_type nchunks = GetEnv<ulong_type>("NUM_CHUNKS", 4 * num_threads);
+    ulong_type nsamp = GetEnv<ulong_type>("NUM_SAMPLES", 1UL << 16);
+    ulong_type niter = GetEnv<ulong_type>("NUM_ITER", 10);
+    thread_manager* tm = new thread_manager(num_threads);
+    tm->set_placement(placement_policy::per_numa_node);
+
+    //------------------------------------------------------------------------//
+    // first touch on the workers
+    std::vector<chunk_data*> chunks;
+    for(ulong_type i = 0; i < nchunks; ++i)
+        chunks.push_back(new chunk_data(nsamp));
+    {
+        mad::task_group tg;
+        tm->run_loop(&tg, [&] (ulong_type i) { chunks[i]->init(i + 1); },
+                     0UL, nchunks);
+        tg.join();
+    }
+
+    std::cout << "\ncov::accumulate_zmap on " << nchunks << " chunks of "
+              << nsamp << " samples, " << num_threads << " threads on "
+              << topology::instance().num_nodes() << " NUMA node(s), "
+              << niter << " iterations\n" << std::endl;
+    std::cout << std::setw(18) << "submission"
+              << std::setw(14) << "time [s]"
+              << std::setw(18) << "traffic [GB/s]"
+              << std::setw(14) << "remote" << std::endl;
+
+    measure(tm, "no hint", chunks, niter, false);
+    measure(tm, "locality hint", chunks, niter, true);
+
+    std::cout << std::endl;
+    for(auto& itr : chunks)
+        delete itr;
+    delete tm;
+    return 0;
+}
+
+//============================================================================//
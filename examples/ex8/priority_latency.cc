@@ -0,0 +1,155 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+//
+//
+//	Latency of short tasks submitted while the pool is saturated with bulk
+//	work, e.g. control messages behind a large run_loop
+//		- "FIFO" submits everything at task_priority::normal (the behavior
+//		  without priority lanes)
+//		- the other rows submit the probes at task_priority::high over
+//		  bulk work in the normal or the low lane
+//	latency = time from exec() until the probe starts running
+//
+//	environment: NUM_THREADS, NUM_BULK, BULK_USEC, NUM_PROBES, PROBE_USEC
+//
+//
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+
+#include <madthreading/types.hh>
+#include <madthreading/threading/thread_manager.hh>
+#include "../Common.hh"
+
+using namespace mad;
+
+typedef std::chrono::high_resolution_clock  clock_type;
+typedef std::chrono::duration<double>       duration_type;
+typedef clock_type::time_point              time_point;
+
+//============================================================================//
+
+void spin(double usec)
+{
+    time_point _end = clock_type::now() +
+                      std::chrono::duration_cast<clock_type::duration>(
+                          std::chrono::duration<double, std::micro>(usec));
+    while(clock_type::now() < _end) { }
+}
+
+//============================================================================//
+
+double percentile(const std::vector<double>& sorted, double p)
+{
+    if(sorted.empty())
+        return 0.0;
+    std::size_t _i = (std::size_t) std::ceil(p * sorted.size());
+    return sorted[(_i > 0) ? _i - 1 : 0];
+}
+
+//============================================================================//
+
+void measure(thread_manager* tm, const std::string& name,
+             task_priority bulk_priority, task_priority probe_priority,
+             ulong_type nbulk, double bulk_usec,
+             ulong_type nprobes, double probe_usec)
+{
+    std::vector<time_point> submitted(nprobes);
+    std::vector<time_point> started(nprobes);
+    task_group tg;
+
+    time_point _start = clock_type::now();
+    for(ulong_type i = 0; i < nbulk; ++i)
+        tm->exec(&tg, bulk_priority, spin, bulk_usec);
+
+    for(ulong_type i = 0; i < nprobes; ++i)
+    {
+        time_point* _started = &started[i];
+        submitted[i] = clock_type::now();
+        tm->exec(&tg, probe_priority,
+                 [=] () { *_started = clock_type::now(); });
+        spin(probe_usec);
+    }
+    tg.join();
+    duration_type _total = clock_type::now() - _start;
+
+    std::vector<double> latency(nprobes, 0.0);
+    for(ulong_type i = 0; i < nprobes; ++i)
+        latency[i] = std::chrono::duration<double, std::micro>(
+                         started[i] - submitted[i]).count();
+    std::sort(latency.begin(), latency.end());
+
+    std::cout << std::setw(24) << name
+              << std::setw(14) << std::fixed << std::setprecision(1)
+              << percentile(latency, 0.50)
+              << std::setw(14) << percentile(latency, 0.99)
+              << std::setw(14) << latency.back()
+              << std::setw(14) << std::setprecision(4) << _total.count()
+              << std::endl;
+}
+
+//============================================================================//
+
+int main(int, char**)
+{
+    ulong_type num_threads = thread_manager::GetEnvNumThreads(4);
+    ulong_type nbulk = GetEnv<ulong_type>("NUM_BULK", 20000);
+    double bulk_usec = GetEnv<double>("BULK_USEC", 20.0);
+    ulong_type nprobes = GetEnv<ulong_type>("NUM_PROBES", 200);
+    double probe_usec = GetEnv<double>("PROBE_USEC", 200.0);
+    thread_manager* tm = new thread_manager(num_threads);
+
+    std::cout << "\nProbe latency [us] with " << num_threads << " threads, "
+              << nbulk << " bulk tasks of " << bulk_usec << " us and "
+              << nprobes << " probes every " << probe_usec << " us\n"
+              << std::endl;
+    std::cout << std::setw(24) << "bulk / probe"
+              << std::setw(14) << "p50"
+              << std::setw(14) << "p99"
+              << std::setw(14) << "max"
+              << std::setw(14) << "total [s]" << std::endl;
+
+    measure(tm, "FIFO normal / normal",
+            task_priority::normal, task_priority::normal,
+            nbulk, bulk_usec, nprobes, probe_usec);
+    measure(tm, "normal / high",
+            task_priority::normal, task_priority::high,
+            nbulk, bulk_usec, nprobes, probe_usec);
+    measure(tm, "low / high",
+            task_priority::low, task_priority::high,
+            nbulk, bulk_usec, nprobes, probe_usec);
+
+    std::cout << std::endl;
+    delete tm;
+    return 0;
+}
+
+//============================================================================//
@@ -0,0 +1,168 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+//
+//
+//	Benchmark of thread_manager::parallel_inclusive_scan and
+//	parallel_exclusive_scan against std::partial_sum on int64_t
+//		- "pointer" uses vec.data() (SIMD block kernels with OpenMP)
+//		- "iterator" uses vec.begin() (generic block kernels)
+//
+//	environment: NUM_ELEMENTS, NUM_ITER, NUM_THREADS
+//
+//
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <numeric>
+#include <string>
+#include <cstdint>
+
+#include <madthreading/types.hh>
+#include <madthreading/threading/thread_manager.hh>
+#include "../Common.hh"
+
+using namespace mad;
+
+typedef std::chrono::high_resolution_clock  clock_type;
+typedef std::chrono::duration<double>       duration_type;
+typedef std::vector<int64_t>                vector_type;
+
+//============================================================================//
+// returns the best time of "niter" runs
+template <typename _Func>
+double measure(ulong_type niter, _Func func)
+{
+    double _best = 0.0;
+    for(ulong_type i = 0; i < niter; ++i)
+    {
+        clock_type::time_point _start = clock_type::now();
+        func();
+        duration_type _elapsed = clock_type::now() - _start;
+        if(i == 0 || _elapsed.count() < _best)
+            _best = _elapsed.count();
+    }
+    return _best;
+}
+
+//============================================================================//
+
+int report(const std::string& name, double t, double t_ref, ulong_type n,
+           const vector_type& result, const vector_type& reference)
+{
+    bool _correct = (result == reference);
+    std::cout << std::setw(32) << name
+              << std::setw(14) << std::fixed << std::setprecision(6) << t
+              << std::setw(14) << std::setprecision(3) << (n / t) * 1.0e-9
+              << std::setw(12) << std::setprecision(2) << (t_ref / t)
+              << ((_correct) ? "" : "    WRONG RESULT") << std::endl;
+    return (_correct) ? 0 : 1;
+}
+
+//============================================================================//
+
+int main(int, char**)
+{
+    ulong_type n = GetEnv<ulong_type>("NUM_ELEMENTS", 1UL << 24);
+    ulong_type niter = GetEnv<ulong_type>("NUM_ITER", 5);
+    ulong_type num_threads = thread_manager::GetEnvNumThreads(1);
+    thread_manager* tm = new thread_manager(num_threads);
+    int ret = 0;
+
+    vector_type input(n, 0);
+    for(ulong_type i = 0; i < n; ++i)
+        input[i] = (int64_t) ((i * 2654435761UL) % 1000) - 500;
+    vector_type output(n, 0);
+    vector_type inclusive(n, 0);
+    vector_type exclusive(n, 0);
+
+    //------------------------------------------------------------------------//
+    // references
+    double t_ref = measure(niter, [&] ()
+    {
+        std::partial_sum(input.begin(), input.end(), inclusive.begin());
+    });
+    exclusive[0] = 0;
+    for(ulong_type i = 1; i < n; ++i)
+        exclusive[i] = exclusive[i-1] + input[i-1];
+
+    std::cout << "\nPrefix scan of " << n << " int64_t with " << num_threads
+              << " threads (best of " << niter << ")\n" << std::endl;
+    std::cout << std::setw(32) << "method"
+              << std::setw(14) << "time [s]"
+              << std::setw(14) << "Gelem/s"
+              << std::setw(12) << "speed-up" << std::endl;
+
+    ret += report("std::partial_sum", t_ref, t_ref, n, inclusive, inclusive);
+
+    //------------------------------------------------------------------------//
+    double t = measure(niter, [&] ()
+    {
+        tm->parallel_inclusive_scan(input.data(), input.data() + n,
+                                    output.data());
+    });
+    ret += report("inclusive (pointer)", t, t_ref, n, output, inclusive);
+
+    //------------------------------------------------------------------------//
+    t = measure(niter, [&] ()
+    {
+        tm->parallel_inclusive_scan(input.begin(), input.end(),
+                                    output.begin());
+    });
+    ret += report("inclusive (iterator)", t, t_ref, n, output, inclusive);
+
+    //------------------------------------------------------------------------//
+    t = measure(niter, [&] ()
+    {
+        tm->parallel_exclusive_scan(input.data(), input.data() + n,
+                                    output.data(), (int64_t) 0);
+    });
+    ret += report("exclusive (pointer)", t, t_ref, n, output, exclusive);
+
+    //------------------------------------------------------------------------//
+    // in-place, not timed more than once since the input is overwritten
+    output = input;
+    t = measure(1, [&] ()
+    {
+        tm->parallel_inclusive_scan(output.data(), output.data() + n,
+                                    output.data());
+    });
+    ret += report("inclusive (in-place)", t, t_ref, n, output, inclusive);
+
+    output = input;
+    t = measure(1, [&] ()
+    {
+        tm->parallel_exclusive_scan(output.data(), output.data() + n,
+                                    output.data(), (int64_t) 0);
+    });
+    ret += report("exclusive (in-place)", t, t_ref, n, output, exclusive);
+
+    std::cout << std::endl;
+    delete tm;
+    return ret;
+}
+
+//============================================================================//
@@ -0,0 +1,153 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+//
+//
+//	Benchmark of thread_manager::parallel_sort against std::sort from 1 to
+//	NUM_THREADS threads
+//		- int64_t keys (e.g. pixel indices): LSD radix sort
+//		- int64_t keys with a comparator: merge sort
+//		- parallel_partition against std::partition
+//
+//	environment: NUM_ELEMENTS, KEY_RANGE, NUM_ITER, NUM_THREADS
+//
+//
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <cstdint>
+
+#include <madthreading/types.hh>
+#include <madthreading/threading/thread_manager.hh>
+#include "../Common.hh"
+
+using namespace mad;
+
+typedef std::chrono::high_resolution_clock  clock_type;
+typedef std::chrono::duration<double>       duration_type;
+typedef std::vector<int64_t>                vector_type;
+
+//============================================================================//
+// returns the best time of "niter" runs, "func" works on a fresh copy
+template <typename _Func>
+double measure(ulong_type niter, const vector_type& input,
+               vector_type& output, _Func func)
+{
+    double _best = 0.0;
+    for(ulong_type i = 0; i < niter; ++i)
+    {
+        output = input;
+        clock_type::time_point _start = clock_type::now();
+        func(output);
+        duration_type _elapsed = clock_type::now() - _start;
+        if(i == 0 || _elapsed.count() < _best)
+            _best = _elapsed.count();
+    }
+    return _best;
+}
+
+//============================================================================//
+
+int main(int, char**)
+{
+    ulong_type n = GetEnv<ulong_type>("NUM_ELEMENTS", 1UL << 22);
+    int64_t key_range = GetEnv<int64_t>("KEY_RANGE", 12L * 1024L * 1024L);
+    ulong_type niter = GetEnv<ulong_type>("NUM_ITER", 3);
+    ulong_type max_threads = thread_manager::GetEnvNumThreads(1);
+    int ret = 0;
+
+    std::mt19937_64 rng(54321);
+    std::uniform_int_distribution<int64_t> dist(-1, key_range - 1);
+    vector_type input(n, 0);
+    for(auto& itr : input)
+        itr = dist(rng);
+
+    vector_type reference;
+    vector_type output;
+    double t_sort = measure(niter, input, reference, [] (vector_type& v)
+    {
+        std::sort(v.begin(), v.end());
+    });
+    auto is_hit = [] (const int64_t& _val) { return _val >= 0; };
+    double t_partition = measure(niter, input, output, [=] (vector_type& v)
+    {
+        std::partition(v.begin(), v.end(), is_hit);
+    });
+
+    std::cout << "\nSorting " << n << " int64_t in [-1, " << key_range
+              << ") (best of " << niter << ")\n" << std::endl;
+    std::cout << std::setw(10) << "threads"
+              << std::setw(16) << "std::sort"
+              << std::setw(16) << "radix"
+              << std::setw(16) << "merge"
+              << std::setw(18) << "std::partition"
+              << std::setw(18) << "partition" << std::endl;
+
+    for(ulong_type nthreads = 1; nthreads <= max_threads; ++nthreads)
+    {
+        thread_manager* tm = new thread_manager(nthreads);
+
+        double t_radix = measure(niter, input, output, [=] (vector_type& v)
+        {
+            tm->parallel_sort(v.begin(), v.end());
+        });
+        ret += (output != reference);
+
+        double t_merge = measure(niter, input, output, [=] (vector_type& v)
+        {
+            tm->parallel_sort(v.begin(), v.end(), std::less<int64_t>());
+        });
+        ret += (output != reference);
+
+        vector_type::iterator _split;
+        double t_part = measure(niter, input, output, [&] (vector_type& v)
+        {
+            _split = tm->parallel_partition(v.begin(), v.end(), is_hit);
+        });
+        ret += !(std::all_of(output.begin(), _split, is_hit) &&
+                 std::none_of(_split, output.end(), is_hit));
+
+        std::cout << std::setw(10) << nthreads << std::fixed
+                  << std::setprecision(4)
+                  << std::setw(16) << t_sort
+                  << std::setw(16) << t_radix
+                  << std::setw(16) << t_merge
+                  << std::setw(18) << t_partition
+                  << std::setw(18) << t_part << std::endl;
+
+        delete tm;
+    }
+    std::cout << std::endl;
+
+    if(ret > 0)
+        std::cout << "WRONG RESULT" << std::endl;
+    return ret;
+}
+
+//============================================================================//
@@ -0,0 +1,168 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+//
+//
+//	Micro-benchmark of the thread-pool injection queue
+//		- N producers submit tasks while one consumer drains them
+//		- "deque + mutex" is the previous thread_pool::add_task path
+//		  (push_back under a recursive mutex + notify_one per task)
+//		- "mpmc_queue" is the lock-free ring used now
+//
+//	environment: NUM_TASKS (total per run), MAX_PRODUCERS
+//
+//
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <atomic>
+
+#include <madthreading/types.hh>
+#include <madthreading/threading/mutex.hh>
+#include <madthreading/threading/condition.hh>
+#include <madthreading/threading/mpmc_queue.hh>
+#include <madthreading/threading/thread_manager.hh>
+#include "../Common.hh"
+
+using namespace mad;
+
+typedef std::chrono::high_resolution_clock  clock_type;
+typedef std::chrono::duration<double>       duration_type;
+
+//============================================================================//
+
+struct locked_deque
+{
+    std::deque<void*>   queue;
+    mad::mutex          lock;
+    mad::condition      cond;
+
+    void push(void* ptr)
+    {
+        lock.lock();
+        queue.push_back(ptr);
+        cond.notify_one();
+        lock.unlock();
+    }
+
+    bool pop(void*& ptr)
+    {
+        mad::auto_lock l(lock);
+        if(queue.empty())
+            return false;
+        ptr = queue.front();
+        queue.pop_front();
+        return true;
+    }
+};
+
+//============================================================================//
+
+struct lock_free_queue
+{
+    mpmc_queue<void*>   queue;
+
+    void push(void* ptr) { queue.push(ptr); }
+    bool pop(void*& ptr) { return queue.pop(ptr); }
+};
+
+//============================================================================//
+// returns submissions per second
+template <typename _Queue>
+double measure(ulong_type nproducers, ulong_type ntasks)
+{
+    _Queue q;
+    std::atomic<bool> go(false);
+    ulong_type per_producer = ntasks / nproducers;
+    ulong_type total = per_producer * nproducers;
+
+    std::thread consumer([&] ()
+    {
+        void* ptr = nullptr;
+        ulong_type n = 0;
+        while(n < total)
+        {
+            if(q.pop(ptr))
+                ++n;
+            else
+                std::this_thread::yield();
+        }
+    });
+
+    std::vector<std::thread> producers;
+    for(ulong_type i = 0; i < nproducers; ++i)
+    {
+        producers.push_back(std::thread([&, i] ()
+        {
+            while(!go.load())
+                std::this_thread::yield();
+            for(ulong_type j = 0; j < per_producer; ++j)
+                q.push((void*) (i * per_producer + j + 1));
+        }));
+    }
+
+    clock_type::time_point _start = clock_type::now();
+    go.store(true);
+    for(auto& itr : producers)
+        itr.join();
+    duration_type _elapsed = clock_type::now() - _start;
+
+    consumer.join();
+    return total / _elapsed.count();
+}
+
+//============================================================================//
+
+int main(int, char**)
+{
+    ulong_type ntasks = GetEnv<ulong_type>("NUM_TASKS", 1UL << 20);
+    ulong_type max_producers = GetEnv<ulong_type>("MAX_PRODUCERS", 64);
+
+    std::cout << "\nSubmission throughput [tasks/second] with " << ntasks
+              << " tasks per run\n" << std::endl;
+    std::cout << std::setw(12) << "producers"
+              << std::setw(18) << "deque + mutex"
+              << std::setw(18) << "mpmc_queue"
+              << std::setw(12) << "speed-up" << std::endl;
+
+    for(ulong_type n = 1; n <= max_producers; n *= 2)
+    {
+        double _locked = measure<locked_deque>(n, ntasks);
+        double _lockfree = measure<lock_free_queue>(n, ntasks);
+        std::cout << std::setw(12) << n
+                  << std::setw(18) << std::scientific << std::setprecision(3)
+                  << _locked
+                  << std::setw(18) << _lockfree
+                  << std::setw(12) << std::fixed << std::setprecision(2)
+                  << (_lockfree / _locked) << std::endl;
+    }
+    std::cout << std::endl;
+
+    return 0;
+}
+
+//============================================================================//
@@ -0,0 +1,169 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+//
+//
+//	Per-task overhead of the thread pool
+//		- end-to-end: NUM_TASKS empty tasks submitted with exec() in
+//		  batches of BATCH_SIZE, each batch joined
+//		- completion only: threads finishing tasks of one shared group
+//		  "atomic -= 1, < 2"  is the previous task_group accounting (CAS
+//		  loop, then notify_all whenever fewer than 2 tasks are left)
+//		  "fetch_sub"         is the current one (single fetch_sub with
+//		  release ordering, only the last task of a sleeping join wakes it)
+//
+//	environment: NUM_THREADS, NUM_TASKS (10M), BATCH_SIZE, MAX_THREADS
+//
+//
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <atomic>
+
+#include <madthreading/types.hh>
+#include <madthreading/atomics/atomic.hh>
+#include <madthreading/threading/eventcount.hh>
+#include <madthreading/threading/thread_manager.hh>
+#include "../Common.hh"
+
+using namespace mad;
+
+typedef std::chrono::high_resolution_clock  clock_type;
+typedef std::chrono::duration<double>       duration_type;
+
+//============================================================================//
+
+struct previous_count
+{
+    mad::atomic<long>   count;
+    mad::eventcount     event;
+
+    previous_count(long n) : count(n) { }
+    void done()
+    {
+        count -= 1;
+        if(count.load() < 2)
+            event.notify_all();
+    }
+};
+
+//============================================================================//
+
+struct fetch_sub_count
+{
+    static const long   waiting = 1L << (8 * sizeof(long) - 2);
+    std::atomic<long>   count;
+    mad::eventcount     event;
+
+    fetch_sub_count(long n) : count(n) { }
+    void done()
+    {
+        if(count.fetch_sub(1, std::memory_order_release) == waiting + 1)
+            event.notify_all();
+    }
+};
+
+//============================================================================//
+// nanoseconds per completion
+template <typename _Count>
+double measure(ulong_type nthreads, ulong_type ntasks)
+{
+    ulong_type per_thread = ntasks / nthreads;
+    _Count _count(per_thread * nthreads);
+    std::atomic<bool> go(false);
+
+    std::vector<std::thread> threads;
+    for(ulong_type i = 0; i < nthreads; ++i)
+        threads.push_back(std::thread([&] ()
+        {
+            while(!go.load())
+                std::this_thread::yield();
+            for(ulong_type j = 0; j < per_thread; ++j)
+                _count.done();
+        }));
+
+    clock_type::time_point _start = clock_type::now();
+    go.store(true);
+    for(auto& itr : threads)
+        itr.join();
+    duration_type _elapsed = clock_type::now() - _start;
+    return 1.0e9 * _elapsed.count() / (per_thread * nthreads);
+}
+
+//============================================================================//
+
+int main(int, char**)
+{
+    ulong_type num_threads = thread_manager::GetEnvNumThreads(4);
+    ulong_type ntasks = GetEnv<ulong_type>("NUM_TASKS", 10000000);
+    ulong_type batch = GetEnv<ulong_type>("BATCH_SIZE", 100000);
+    ulong_type max_threads = GetEnv<ulong_type>("MAX_THREADS", 8);
+    thread_manager* tm = new thread_manager(num_threads);
+
+    //------------------------------------------------------------------------//
+    auto _empty = [] () { };
+    ulong_type _ndone = 0;
+    clock_type::time_point _start = clock_type::now();
+    while(_ndone < ntasks)
+    {
+        ulong_type _n = std::min(batch, ntasks - _ndone);
+        mad::task_group tg;
+        for(ulong_type i = 0; i < _n; ++i)
+            tm->exec(&tg, _empty);
+        tg.join();
+        _ndone += _n;
+    }
+    duration_type _elapsed = clock_type::now() - _start;
+
+    std::cout << "\n" << ntasks << " empty tasks with " << num_threads
+              << " threads: " << std::fixed << std::setprecision(1)
+              << (1.0e9 * _elapsed.count() / ntasks) << " ns per task\n"
+              << std::endl;
+
+    //------------------------------------------------------------------------//
+    std::cout << "Task completion [ns per task]\n" << std::endl;
+    std::cout << std::setw(12) << "threads"
+              << std::setw(20) << "atomic -= 1, < 2"
+              << std::setw(14) << "fetch_sub"
+              << std::setw(12) << "speed-up" << std::endl;
+
+    for(ulong_type n = 1; n <= max_threads; n *= 2)
+    {
+        double _previous = measure<previous_count>(n, ntasks);
+        double _current = measure<fetch_sub_count>(n, ntasks);
+        std::cout << std::setw(12) << n << std::setprecision(2)
+                  << std::setw(20) << _previous
+                  << std::setw(14) << _current
+                  << std::setw(12) << (_previous / _current) << std::endl;
+    }
+    std::cout << std::endl;
+
+    delete tm;
+    return 0;
+}
+
+//============================================================================//
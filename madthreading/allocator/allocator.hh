@@ -42,6 +42,7 @@
 #include "madthreading/threading/threading.hh"
 #include "madthreading/threading/auto_lock.hh"
 #include "madthreading/threading/mutex.hh"
+#include "madthreading/threading/fast_mutex.hh"
 
 #ifdef USE_TBB
 #include <tbb/tbb.h>
@@ -494,8 +495,8 @@ allocator<T, USE_TLP>::~allocator() throw()
 template <typename T, bool USE_TLP>
 T* allocator<T, USE_TLP>::malloc_single()
 {
-    static mad::mutex mutex;
-    mad::auto_lock l(mutex);
+    static mad::fast_mutex mutex;
+    mad::fast_lock l(mutex);
     return static_cast<T*>(m_mem.alloc());
 }
 
@@ -95,8 +95,7 @@ void allocator_list::Destroy(size_type nstat, int verbose)
         std::cout << "================= Deleting memory pools ================="
                   << std::endl;
         std::cout << "Thread ID : "
-                  << mad::thread_pool::GetThreadIDs()
-                     .find(std::this_thread::get_id())->second
+                  << mad::thread_pool::GetThisThreadID()
                   << ", nstat = " << nstat
                   << std::endl;
     }
@@ -209,8 +208,7 @@ void allocator_list_tl::Destroy(size_type nstat, int verbose)
         std::cout << "================= Deleting memory pools ================="
                   << std::endl;
         std::cout << "Thread ID : "
-                  << mad::thread_pool::GetThreadIDs()
-                     .find(std::this_thread::get_id())->second
+                  << mad::thread_pool::GetThisThreadID()
                   << ", nstat = " << nstat
                   << std::endl;
     }
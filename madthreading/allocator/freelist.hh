@@ -0,0 +1,211 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#ifndef freelist_hh_
+#define freelist_hh_
+
+//----------------------------------------------------------------------------//
+// Per-thread cache of small, fixed-size memory blocks.
+//
+// Blocks are grouped in 64-byte size classes (up to 512 bytes). Freed blocks
+// go onto the freeing thread's list and are handed out again by the next
+// allocation of that size class on the same thread, so a steady stream of
+// create/delete cycles (e.g. tasks) never reaches the global heap.
+//
+// Every block is an individual ::operator new allocation, so it may be
+// released by any thread, unlike the page-based allocator_pool.
+//----------------------------------------------------------------------------//
+
+#include "madthreading/threading/tls.hh"
+
+#include <new>
+#include <cstddef>
+
+namespace mad
+{
+namespace details
+{
+
+//============================================================================//
+
+class freelist
+{
+public:
+    typedef std::size_t size_type;
+
+    static const size_type block_size = 64;
+    static const size_type num_classes = 8;
+    static const size_type max_cached = 1024;
+
+public:
+    freelist()
+    {
+        state() = ALIVE;
+        for(size_type i = 0; i < num_classes; ++i)
+        {
+            m_head[i] = nullptr;
+            m_count[i] = 0;
+        }
+    }
+
+    ~freelist()
+    {
+        state() = DESTROYED;
+        for(size_type i = 0; i < num_classes; ++i)
+        {
+            while(m_head[i])
+            {
+                node* _next = m_head[i]->next;
+                ::operator delete(m_head[i]);
+                m_head[i] = _next;
+            }
+        }
+    }
+
+public:
+    //------------------------------------------------------------------------//
+    void* allocate(size_type _size)
+    {
+        size_type _idx = size_class(_size);
+        if(_idx >= num_classes)
+            return ::operator new(_size);
+
+        if(m_head[_idx])
+        {
+            node* _node = m_head[_idx];
+            m_head[_idx] = _node->next;
+            --m_count[_idx];
+            return _node;
+        }
+        return allocate_block(_size);
+    }
+    //------------------------------------------------------------------------//
+    void deallocate(void* _ptr, size_type _size)
+    {
+        size_type _idx = size_class(_size);
+        if(_idx >= num_classes || m_count[_idx] >= max_cached)
+        {
+            ::operator delete(_ptr);
+            return;
+        }
+
+        node* _node = static_cast<node*>(_ptr);
+        _node->next = m_head[_idx];
+        m_head[_idx] = _node;
+        ++m_count[_idx];
+    }
+    //------------------------------------------------------------------------//
+    //------------------------------------------------------------------------//
+    // a new block for "_size" bytes, as large as its whole size class: any
+    // block may end up cached by deallocate and be handed out for the
+    // largest size of the class. Also used when the thread has no instance
+    static void* allocate_block(size_type _size)
+    {
+        size_type _idx = size_class(_size);
+        return ::operator new((_idx < num_classes) ? (_idx + 1) * block_size
+                                                   : _size);
+    }
+    //------------------------------------------------------------------------//
+    // the calling thread's instance, nullptr once it has been destroyed
+    // (static objects holding tasks can be destroyed after it at exit)
+    static freelist* instance()
+    {
+        if(state() == DESTROYED)
+            return nullptr;
+        ThreadLocalStatic freelist _instance;
+        return &_instance;
+    }
+
+private:
+    enum { UNINIT = 0, ALIVE = 1, DESTROYED = 2 };
+
+    // lifetime of the calling thread's instance. Trivially destructible,
+    // unlike the instance itself it can still be read after the
+    // thread_local destructors ran
+    static int& state()
+    {
+        ThreadLocalStatic int _state = UNINIT;
+        return _state;
+    }
+
+    static size_type size_class(size_type _size)
+    {
+        return (_size == 0) ? 0 : (_size - 1) / block_size;
+    }
+
+private:
+    struct node { node* next; };
+
+    node*       m_head[num_classes];
+    size_type   m_count[num_classes];
+
+private:
+    freelist(const freelist&);
+    freelist& operator=(const freelist&);
+};
+
+//============================================================================//
+
+} // namespace details
+
+//============================================================================//
+// Thread-local free-list allocator to be inherited from. Requires a virtual
+// destructor in polymorphic hierarchies so the sized delete gets the size
+// of the dynamic type
+//============================================================================//
+class FreeListAllocator_tl
+{
+public:
+    //------------------------------------------------------------------------//
+    void* operator new(size_t size)
+    {
+        details::freelist* _list = details::freelist::instance();
+        return (_list) ? _list->allocate(size)
+                       : details::freelist::allocate_block(size);
+    }
+    //------------------------------------------------------------------------//
+    void* operator new (size_t size, const std::nothrow_t&) throw ()
+    {
+        try { return operator new(size); }
+        catch(std::bad_alloc&) { return nullptr; }
+    }
+    //------------------------------------------------------------------------//
+    void operator delete(void* ptr, size_t size) throw ()
+    {
+        if(ptr == 0)
+            return;
+        details::freelist* _list = details::freelist::instance();
+        if(_list)
+            _list->deallocate(ptr, size);
+        else
+            ::operator delete(ptr);
+    }
+    //------------------------------------------------------------------------//
+};
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
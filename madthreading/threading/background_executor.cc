@@ -0,0 +1,206 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#include "madthreading/threading/background_executor.hh"
+
+namespace mad
+{
+
+//============================================================================//
+
+// polls before an idle background thread goes to sleep
+static const unsigned background_spin_count = 1024;
+
+//============================================================================//
+
+background_executor::thread_data::thread_data()
+: head(&stub),
+  tail(&stub),
+  num_channels(0)
+{ }
+
+//============================================================================//
+
+background_channel* background_executor::thread_data::pop()
+{
+    background_channel* _tail = tail;
+    background_channel* _next = _tail->m_next.load(std::memory_order_acquire);
+
+    // skip the stub
+    if(_tail == &stub)
+    {
+        if(!_next)
+            return nullptr;
+        tail = _next;
+        _tail = _next;
+        _next = _next->m_next.load(std::memory_order_acquire);
+    }
+
+    if(_next)
+    {
+        tail = _next;
+        return _tail;
+    }
+
+    // a producer exchanged the head but has not linked its node yet
+    if(_tail != head.load(std::memory_order_acquire))
+        return nullptr;
+
+    // _tail is the last node: put the stub behind it so it can be unlinked
+    push(&stub);
+    _next = _tail->m_next.load(std::memory_order_acquire);
+    if(_next)
+    {
+        tail = _next;
+        return _tail;
+    }
+    return nullptr;
+}
+
+//============================================================================//
+
+background_executor::background_executor(size_type _nthreads)
+: m_stop(false)
+{
+    if(_nthreads == 0)
+        _nthreads = 1;
+
+    // all queues exist before the first thread starts
+    for(size_type i = 0; i < _nthreads; ++i)
+        m_threads.push_back(new thread_data);
+
+    for(auto& itr : m_threads)
+        itr->thread = std::thread(&background_executor::execute_thread,
+                                  this, itr);
+}
+
+//============================================================================//
+
+background_executor::~background_executor()
+{
+    m_stop.store(true, std::memory_order_seq_cst);
+    for(auto& itr : m_threads)
+        itr->sleeper.unpark();
+
+    for(auto& itr : m_threads)
+    {
+        if(itr->thread.joinable())
+            itr->thread.join();
+        delete itr;
+    }
+
+    for(auto& itr : m_channels)
+        delete itr;
+}
+
+//============================================================================//
+
+background_channel* background_executor::add(vtask* _task)
+{
+    std::lock_guard<std::mutex> l(m_channel_lock);
+
+    size_type _thread = 0;
+    for(size_type i = 1; i < m_threads.size(); ++i)
+        if(m_threads[i]->num_channels < m_threads[_thread]->num_channels)
+            _thread = i;
+
+    background_channel* _channel = new background_channel(_task, _thread);
+    ++m_threads[_thread]->num_channels;
+    m_channels.push_back(_channel);
+    return _channel;
+}
+
+//============================================================================//
+
+void background_executor::execute(thread_data* _thread,
+                                   background_channel* _channel)
+{
+    // clear first: a signal from now on queues the channel again, one that
+    // came before is seen in m_requested below
+    _channel->m_queued.store(false, std::memory_order_seq_cst);
+
+    sequence_type _target =
+            _channel->m_requested.load(std::memory_order_seq_cst);
+    sequence_type _done = _channel->m_completed.load(std::memory_order_relaxed);
+
+    // one execution per signal. An exception goes to the task and to the
+    // future of this signal, the execution still counts as completed
+    for(; _done < _target; ++_done)
+    {
+        try
+        {
+            (*_channel->m_task)();
+        }
+        catch(...)
+        {
+            std::exception_ptr _ptr = std::current_exception();
+            _channel->m_task->set_exception(_ptr);
+            _channel->set_exception(_done + 1, _ptr);
+        }
+        _channel->m_completed.store(_done + 1, std::memory_order_release);
+    }
+
+    _thread->completed.notify_all();
+}
+
+//============================================================================//
+
+void background_executor::execute_thread(thread_data* _thread)
+{
+    while(true)
+    {
+        background_channel* _channel = _thread->pop();
+        if(_channel)
+        {
+            execute(_thread, _channel);
+            continue;
+        }
+
+        if(_thread->empty() && m_stop.load(std::memory_order_acquire))
+            return;
+
+        //--------------------------------------------------------------------//
+        // poll for a while, then sleep
+        unsigned i = 0;
+        for(; i < background_spin_count && _thread->empty() &&
+              !m_stop.load(std::memory_order_relaxed); ++i)
+            cpu_relax();
+        if(i < background_spin_count)
+            continue;
+
+        // publish ourselves as a sleeper, then re-check (see signal)
+        _thread->sleeper.prepare_park();
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(!_thread->empty() || m_stop.load(std::memory_order_seq_cst))
+        {
+            _thread->sleeper.cancel_park();
+            continue;
+        }
+        _thread->sleeper.park();
+    }
+}
+
+//============================================================================//
+
+} // namespace mad
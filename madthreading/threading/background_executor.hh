@@ -0,0 +1,275 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#ifndef background_executor_hh_
+#define background_executor_hh_
+
+//----------------------------------------------------------------------------//
+// Dedicated threads for background tasks, i.e. tasks that are registered
+// once and executed again every time they are signalled (e.g. a thread that
+// refills a buffer of random numbers)
+//
+//      background_executor exec(2);
+//      background_channel* ch = exec.add(task);   // task pinned to a thread
+//      background_future f = exec.signal(ch);     // lock-free, no allocation
+//      ...
+//      f.wait();
+//
+//  - every thread owns an intrusive MPSC queue of channels (D. Vyukov's
+//    design). A signal is a counter increment plus, if the channel is not
+//    queued yet, one exchange to queue it and an unpark of the thread if
+//    it sleeps
+//  - signals are counted: N signals execute the task N times, back to back
+//    without re-queueing the channel
+//  - a background_future is the channel plus the number of the signal, it
+//    is ready once the channel completed that many executions. If that
+//    execution threw, wait() rethrows the exception (the executor thread
+//    carries on with the next signal)
+//
+// The executor does not own the tasks (their task_group does) and does not
+// decrement task counts: a background task is never joined.
+//----------------------------------------------------------------------------//
+
+#include "madthreading/threading/parker.hh"
+#include "madthreading/threading/eventcount.hh"
+#include "madthreading/threading/task/task.hh"
+
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <cstdint>
+#include <cstddef>
+
+namespace mad
+{
+
+class background_executor;
+
+//============================================================================//
+/// \brief a task registered with a background_executor
+class background_channel
+{
+public:
+    typedef uint64_t        sequence_type;
+
+public:
+    vtask* task() const { return m_task; }
+    // all signals so far have been executed
+    bool is_done() const
+    {
+        return m_completed.load(std::memory_order_acquire) ==
+               m_requested.load(std::memory_order_acquire);
+    }
+
+private:
+    friend class background_executor;
+    friend class background_future;
+
+    background_channel(vtask* _task = nullptr, std::size_t _thread = 0)
+    : m_task(_task), m_thread(_thread), m_next(nullptr),
+      m_requested(0), m_completed(0), m_queued(false), m_failed(0)
+    { }
+
+    // execution number "_sequence" threw, stored before m_completed
+    void set_exception(sequence_type _sequence, std::exception_ptr _ptr)
+    {
+        std::lock_guard<std::mutex> l(m_exception_lock);
+        m_exception = _ptr;
+        m_failed.store(_sequence, std::memory_order_release);
+    }
+
+    // rethrow if execution number "_sequence" threw. Only the most recent
+    // failure is kept, a later failing execution replaces it
+    void rethrow(sequence_type _sequence) const
+    {
+        if(m_failed.load(std::memory_order_acquire) != _sequence)
+            return;
+        std::exception_ptr _ptr;
+        {
+            std::lock_guard<std::mutex> l(m_exception_lock);
+            if(m_failed.load(std::memory_order_relaxed) == _sequence)
+                _ptr = m_exception;
+        }
+        if(_ptr)
+            std::rethrow_exception(_ptr);
+    }
+
+    vtask*                              m_task;
+    std::size_t                         m_thread;
+    std::atomic<background_channel*>    m_next;
+    std::atomic<sequence_type>          m_requested;
+    std::atomic<sequence_type>          m_completed;
+    std::atomic<bool>                   m_queued;
+    std::atomic<sequence_type>          m_failed;
+    std::exception_ptr                  m_exception;
+    mutable std::mutex                  m_exception_lock;
+
+private:
+    background_channel(const background_channel&);
+    background_channel& operator=(const background_channel&);
+};
+
+//============================================================================//
+/// \brief completion of one signal of a background_channel
+class background_future
+{
+public:
+    typedef background_channel::sequence_type   sequence_type;
+
+public:
+    background_future() : m_channel(nullptr), m_event(nullptr), m_sequence(0)
+    { }
+
+    bool valid() const { return m_channel != nullptr; }
+
+    bool is_ready() const
+    {
+        return !m_channel ||
+               m_channel->m_completed.load(std::memory_order_acquire) >=
+               m_sequence;
+    }
+
+    // spin briefly, then sleep until the signal has been executed.
+    // Rethrows the exception if this execution of the task threw
+    void wait() const
+    {
+        for(unsigned i = 0; i < 256 && !is_ready(); ++i)
+            cpu_relax();
+        if(!is_ready())
+        {
+            const background_future* _this = this;
+            m_event->await([_this] () { return _this->is_ready(); });
+        }
+        if(m_channel)
+            m_channel->rethrow(m_sequence);
+    }
+
+private:
+    friend class background_executor;
+
+    background_future(background_channel* _channel, eventcount* _event,
+                      sequence_type _sequence)
+    : m_channel(_channel), m_event(_event), m_sequence(_sequence)
+    { }
+
+    background_channel* m_channel;
+    eventcount*         m_event;
+    sequence_type       m_sequence;
+};
+
+//============================================================================//
+
+class background_executor
+{
+public:
+    typedef std::size_t                             size_type;
+    typedef background_channel::sequence_type       sequence_type;
+
+public:
+    explicit background_executor(size_type _nthreads = 1);
+    // executes the signals already queued, then joins the threads
+    ~background_executor();
+
+public:
+    // register a task, it is executed on the thread with the fewest tasks
+    background_channel* add(vtask* _task);
+    // number of dedicated threads
+    size_type size() const { return m_threads.size(); }
+
+    //------------------------------------------------------------------------//
+    // execute the task of "_channel" once more, callable from any thread
+    background_future signal(background_channel* _channel)
+    {
+        sequence_type _seq =
+                _channel->m_requested.fetch_add(1, std::memory_order_seq_cst)
+                + 1;
+        thread_data* _thread = m_threads[_channel->m_thread];
+        // already queued: the executing thread picks up the new request
+        if(!_channel->m_queued.exchange(true, std::memory_order_seq_cst))
+        {
+            _thread->push(_channel);
+            // pairs with the fence in thread_data::wait_for_work
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(_thread->sleeper.is_parked())
+                _thread->sleeper.unpark();
+        }
+        return background_future(_channel, &_thread->completed, _seq);
+    }
+
+private:
+    //------------------------------------------------------------------------//
+    // per thread: intrusive MPSC queue, sleep slot and completion event
+    struct thread_data
+    {
+        thread_data();
+
+        // any thread, wait-free
+        void push(background_channel* _channel)
+        {
+            _channel->m_next.store(nullptr, std::memory_order_relaxed);
+            background_channel* _prev =
+                    head.exchange(_channel, std::memory_order_acq_rel);
+            _prev->m_next.store(_channel, std::memory_order_release);
+        }
+        // owner only, nullptr when empty (or a push is half-way done)
+        background_channel* pop();
+        // owner only
+        bool empty() const
+        {
+            return tail == &stub &&
+                   head.load(std::memory_order_seq_cst) == &stub;
+        }
+
+        char                                pad0[64];
+        std::atomic<background_channel*>    head;
+        char                                pad1[64];
+        background_channel*                 tail;
+        background_channel                  stub;
+        parker                              sleeper;
+        eventcount                          completed;
+        std::thread                         thread;
+        size_type                           num_channels;
+    };
+
+    void execute_thread(thread_data*);
+    void execute(thread_data*, background_channel*);
+
+private:
+    std::vector<thread_data*>           m_threads;
+    std::vector<background_channel*>    m_channels;
+    std::mutex                          m_channel_lock;
+    std::atomic<bool>                   m_stop;
+
+private:
+    background_executor(const background_executor&);
+    background_executor& operator=(const background_executor&);
+};
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
@@ -0,0 +1,93 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#ifndef blocked_range_hh_
+#define blocked_range_hh_
+
+//----------------------------------------------------------------------------//
+// A half-open range [begin, end) that can be recursively split in two
+// until it holds no more than "grainsize" elements (same concept as
+// tbb::blocked_range). _Tp is an integral type or a random-access iterator.
+//----------------------------------------------------------------------------//
+
+#include "madthreading/types.hh"
+
+#include <cstddef>
+
+namespace mad
+{
+
+//============================================================================//
+
+template <typename _Tp>
+class blocked_range
+{
+public:
+    typedef _Tp             value_type;
+    typedef _Tp             const_iterator;
+    typedef std::size_t     size_type;
+
+public:
+    blocked_range(value_type _begin, value_type _end, size_type _grainsize = 1)
+    : m_end(_end),
+      m_begin(_begin),
+      m_grainsize((_grainsize == 0) ? 1 : _grainsize)
+    { }
+
+    // splitting constructor: takes the upper half of "rhs"
+    blocked_range(blocked_range& rhs, splitter)
+    : m_end(rhs.m_end),
+      m_begin(do_split(rhs)),
+      m_grainsize(rhs.m_grainsize)
+    { }
+
+public:
+    const_iterator begin() const    { return m_begin; }
+    const_iterator end() const      { return m_end; }
+    size_type grainsize() const     { return m_grainsize; }
+    size_type size() const          { return size_type(m_end - m_begin); }
+    bool empty() const              { return !(m_begin < m_end); }
+    // true if splitting would give two pieces no smaller than half a grain
+    bool is_divisible() const       { return m_grainsize < size(); }
+
+private:
+    static value_type do_split(blocked_range& r)
+    {
+        value_type _middle = r.m_begin + (r.m_end - r.m_begin) / 2u;
+        r.m_end = _middle;
+        return _middle;
+    }
+
+private:
+    // order matters for the splitting constructor
+    value_type  m_end;
+    value_type  m_begin;
+    size_type   m_grainsize;
+};
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
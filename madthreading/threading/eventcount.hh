@@ -0,0 +1,158 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#ifndef eventcount_hh_
+#define eventcount_hh_
+
+//----------------------------------------------------------------------------//
+// Eventcount: lets a thread block until some lock-free condition becomes
+// true without a mutex on the notifying side (D. Vyukov's design).
+//
+// Waiter:
+//      while(!condition())
+//      {
+//          eventcount::key_type key = ec.prepare_wait();
+//          if(condition()) { ec.cancel_wait(); break; }
+//          ec.wait(key);
+//      }
+// Notifier:
+//      make condition() true; ec.notify_all();
+//
+// notify_*() costs one fence + one load when nobody is waiting. Waiters
+// may wake spuriously and must re-check their condition.
+//----------------------------------------------------------------------------//
+
+#include "madthreading/threading/futex.hh"
+
+#include <atomic>
+#include <climits>
+
+#if !defined(MAD_USE_FUTEX)
+#   include <mutex>
+#   include <condition_variable>
+#endif
+
+namespace mad
+{
+
+//============================================================================//
+
+class eventcount
+{
+public:
+    typedef int key_type;
+
+public:
+    eventcount() : m_epoch(0), m_waiters(0) { }
+
+public:
+    //------------------------------------------------------------------------//
+    // register as a waiter, the condition must be re-checked afterwards
+    key_type prepare_wait()
+    {
+        m_waiters.fetch_add(1, std::memory_order_seq_cst);
+        key_type _key = m_epoch.load(std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return _key;
+    }
+    //------------------------------------------------------------------------//
+    // the condition became true after prepare_wait()
+    void cancel_wait()
+    {
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+    //------------------------------------------------------------------------//
+    // block until a notification after prepare_wait() returned _key
+    void wait(key_type _key)
+    {
+#if defined(MAD_USE_FUTEX)
+        while(m_epoch.load(std::memory_order_acquire) == _key)
+            futex_wait(&m_epoch, _key);
+#else
+        std::unique_lock<std::mutex> l(m_mutex);
+        while(m_epoch.load(std::memory_order_acquire) == _key)
+            m_cond.wait(l);
+#endif
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+    //------------------------------------------------------------------------//
+    void notify_one() { notify(1); }
+    void notify_all() { notify(INT_MAX); }
+    //------------------------------------------------------------------------//
+    // block until _pred() is true
+    template <typename _Pred>
+    void await(_Pred _pred)
+    {
+        while(!_pred())
+        {
+            key_type _key = prepare_wait();
+            if(_pred())
+            {
+                cancel_wait();
+                return;
+            }
+            wait(_key);
+        }
+    }
+
+private:
+    void notify(int _n)
+    {
+        // pairs with prepare_wait: either the waiter sees the new state or
+        // we see the waiter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(m_waiters.load(std::memory_order_relaxed) == 0)
+            return;
+
+#if defined(MAD_USE_FUTEX)
+        m_epoch.fetch_add(1, std::memory_order_release);
+        futex_wake(&m_epoch, _n);
+#else
+        std::lock_guard<std::mutex> l(m_mutex);
+        m_epoch.fetch_add(1, std::memory_order_release);
+        if(_n == 1)
+            m_cond.notify_one();
+        else
+            m_cond.notify_all();
+#endif
+    }
+
+private:
+    std::atomic<int>            m_epoch;
+    std::atomic<int>            m_waiters;
+#if !defined(MAD_USE_FUTEX)
+    std::mutex                  m_mutex;
+    std::condition_variable     m_cond;
+#endif
+
+private:
+    eventcount(const eventcount&);
+    eventcount& operator=(const eventcount&);
+};
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
@@ -0,0 +1,198 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#ifndef fast_mutex_hh_
+#define fast_mutex_hh_
+
+//----------------------------------------------------------------------------//
+// Non-recursive locks for internal hot paths. mad::mutex stays a
+// std::recursive_mutex for user code that relies on recursion.
+//
+//  - fast_mutex : spins briefly, then sleeps on a futex (U. Drepper,
+//                 "Futexes Are Tricky", mutex #3). Uncontended lock/unlock
+//                 is a single atomic each and never enters the kernel.
+//                 Falls back to std::mutex where futexes are unavailable
+//  - spin_mutex : FIFO ticket spinlock for very short critical sections,
+//                 yields the core after spinning for a while
+//
+// Both satisfy BasicLockable/Lockable, so they work with std::lock_guard,
+// std::unique_lock and mad::condition (std::condition_variable_any).
+//----------------------------------------------------------------------------//
+
+#include "madthreading/threading/futex.hh"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+
+namespace mad
+{
+
+//============================================================================//
+
+#if defined(MAD_USE_FUTEX)
+
+class fast_mutex
+{
+public:
+    fast_mutex() : m_state(UNLOCKED) { }
+
+public:
+    //------------------------------------------------------------------------//
+    void lock()
+    {
+        int _c = UNLOCKED;
+        if(m_state.compare_exchange_strong(_c, LOCKED,
+                                           std::memory_order_acquire))
+            return;
+
+        // a short spin avoids the system call when the owner is about to
+        // release the lock
+        for(int i = 0; i < spin_count; ++i)
+        {
+            cpu_relax();
+            _c = UNLOCKED;
+            if(m_state.load(std::memory_order_relaxed) == UNLOCKED &&
+               m_state.compare_exchange_strong(_c, LOCKED,
+                                               std::memory_order_acquire))
+                return;
+        }
+
+        // mark as contended so the owner knows to wake somebody
+        _c = m_state.exchange(CONTENDED, std::memory_order_acquire);
+        while(_c != UNLOCKED)
+        {
+            futex_wait(&m_state, CONTENDED);
+            _c = m_state.exchange(CONTENDED, std::memory_order_acquire);
+        }
+    }
+    //------------------------------------------------------------------------//
+    bool try_lock()
+    {
+        int _c = UNLOCKED;
+        return m_state.compare_exchange_strong(_c, LOCKED,
+                                               std::memory_order_acquire);
+    }
+    //------------------------------------------------------------------------//
+    void unlock()
+    {
+        if(m_state.fetch_sub(1, std::memory_order_release) != LOCKED)
+        {
+            m_state.store(UNLOCKED, std::memory_order_release);
+            futex_wake(&m_state, 1);
+        }
+    }
+
+private:
+    enum { UNLOCKED = 0, LOCKED = 1, CONTENDED = 2 };
+    static const int spin_count = 128;
+
+    std::atomic<int>    m_state;
+
+private:
+    fast_mutex(const fast_mutex&);
+    fast_mutex& operator=(const fast_mutex&);
+};
+
+#else
+
+class fast_mutex
+{
+public:
+    fast_mutex() { }
+
+public:
+    void lock()     { m_mutex.lock(); }
+    bool try_lock() { return m_mutex.try_lock(); }
+    void unlock()   { m_mutex.unlock(); }
+
+private:
+    std::mutex          m_mutex;
+
+private:
+    fast_mutex(const fast_mutex&);
+    fast_mutex& operator=(const fast_mutex&);
+};
+
+#endif
+
+//============================================================================//
+
+class spin_mutex
+{
+public:
+    spin_mutex() : m_next(0), m_serving(0) { }
+
+public:
+    //------------------------------------------------------------------------//
+    void lock()
+    {
+        const uint32_t _ticket = m_next.fetch_add(1, std::memory_order_relaxed);
+        for(uint32_t i = 0;
+            m_serving.load(std::memory_order_acquire) != _ticket; ++i)
+        {
+            if(i < spin_count)
+                cpu_relax();
+            else
+                std::this_thread::yield();
+        }
+    }
+    //------------------------------------------------------------------------//
+    bool try_lock()
+    {
+        uint32_t _serving = m_serving.load(std::memory_order_relaxed);
+        uint32_t _next = _serving;
+        return m_next.compare_exchange_strong(_next, _serving + 1,
+                                              std::memory_order_acquire);
+    }
+    //------------------------------------------------------------------------//
+    void unlock()
+    {
+        // only the owner writes m_serving
+        m_serving.store(m_serving.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_release);
+    }
+
+private:
+    static const uint32_t spin_count = 1024;
+
+    std::atomic<uint32_t>   m_next;
+    std::atomic<uint32_t>   m_serving;
+
+private:
+    spin_mutex(const spin_mutex&);
+    spin_mutex& operator=(const spin_mutex&);
+};
+
+//============================================================================//
+
+using fast_lock = std::lock_guard<fast_mutex>;
+using spin_lock = std::lock_guard<spin_mutex>;
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
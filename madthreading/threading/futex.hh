@@ -0,0 +1,86 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#ifndef futex_hh_
+#define futex_hh_
+
+//----------------------------------------------------------------------------//
+// Low-level helpers for the blocking primitives (parker, fast_mutex,
+// eventcount):
+//  - cpu_relax() : pause hint for spin-wait loops
+//  - futex_wait / futex_wake : sleep on / wake sleepers of a 32-bit word
+//    (Linux only, MAD_USE_FUTEX is defined when they are available)
+//----------------------------------------------------------------------------//
+
+#include <atomic>
+#include <climits>
+
+#if defined(__linux__)
+#   include <linux/futex.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#   define MAD_USE_FUTEX
+#endif
+
+namespace mad
+{
+
+//============================================================================//
+// hint to the CPU that we are in a spin-wait loop
+inline void cpu_relax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__("pause" ::: "memory");
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield" ::: "memory");
+#else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+#if defined(MAD_USE_FUTEX)
+
+//============================================================================//
+// block while *_addr == _val (may return spuriously)
+inline void futex_wait(std::atomic<int>* _addr, int _val)
+{
+    syscall(SYS_futex, reinterpret_cast<int*>(_addr), FUTEX_WAIT_PRIVATE,
+            _val, nullptr, nullptr, 0);
+}
+
+//============================================================================//
+// wake up to "_n" threads blocked on _addr
+inline void futex_wake(std::atomic<int>* _addr, int _n = INT_MAX)
+{
+    syscall(SYS_futex, reinterpret_cast<int*>(_addr), FUTEX_WAKE_PRIVATE,
+            _n, nullptr, nullptr, 0);
+}
+
+#endif
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
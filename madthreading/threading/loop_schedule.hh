@@ -0,0 +1,153 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#ifndef loop_schedule_hh_
+#define loop_schedule_hh_
+
+//----------------------------------------------------------------------------//
+// Self-balancing schedules for thread_manager::run_loop (the OpenMP
+// schedule(dynamic, chunk) and schedule(guided, min_chunk) equivalents).
+//
+// Instead of one task per chunk, one task per worker is submitted and the
+// tasks claim [first, last) chunks from a shared atomic iteration counter
+// until the range is exhausted:
+//  - dynamic : every claim takes "chunk" iterations
+//  - guided  : every claim takes remaining/nworkers iterations, but no
+//              fewer than "min_chunk" (large chunks first, small at the end)
+//----------------------------------------------------------------------------//
+
+#include <atomic>
+#include <cstddef>
+#include <algorithm>
+
+namespace mad
+{
+
+//============================================================================//
+
+class loop_schedule
+{
+public:
+    typedef std::size_t size_type;
+    enum kind_type { DYNAMIC, GUIDED };
+
+public:
+    static loop_schedule dynamic(size_type _chunk = 1)
+    {
+        return loop_schedule(DYNAMIC, _chunk);
+    }
+
+    static loop_schedule guided(size_type _min_chunk = 1)
+    {
+        return loop_schedule(GUIDED, _min_chunk);
+    }
+
+public:
+    kind_type kind() const      { return m_kind; }
+    // chunk size for dynamic, minimum chunk size for guided
+    size_type chunk() const     { return m_chunk; }
+
+private:
+    loop_schedule(kind_type _kind, size_type _chunk)
+    : m_kind(_kind), m_chunk((_chunk == 0) ? 1 : _chunk)
+    { }
+
+private:
+    kind_type   m_kind;
+    size_type   m_chunk;
+};
+
+//============================================================================//
+
+namespace details
+{
+
+//----------------------------------------------------------------------------//
+// the shared iteration counter of one scheduled run_loop
+template <typename _Arg>
+class loop_counter
+{
+public:
+    typedef std::size_t size_type;
+
+public:
+    loop_counter(_Arg _begin, _Arg _end, const loop_schedule& _sched,
+                 size_type _nworkers)
+    : m_next(_begin),
+      m_end(_end),
+      m_kind(_sched.kind()),
+      m_chunk(_sched.chunk()),
+      m_nworkers((_nworkers == 0) ? 1 : _nworkers)
+    { }
+
+public:
+    // claim the next chunk [_first, _last), returns false when exhausted.
+    // The counter is advanced by CAS and never beyond m_end: a fetch_add
+    // would run past the end with every late claim and wrap an unsigned
+    // counter near its maximum. Relaxed is enough, the chunks themselves
+    // carry no data
+    bool claim(_Arg& _first, _Arg& _last)
+    {
+        _Arg _cur = m_next.load(std::memory_order_relaxed);
+        while(true)
+        {
+            if(!(_cur < m_end))
+                return false;
+            _Arg _n = (m_kind == loop_schedule::DYNAMIC)
+                      ? m_chunk
+                      : std::max<_Arg>((m_end - _cur) / m_nworkers, m_chunk);
+            _Arg _l = (m_end - _cur > _n) ? _cur + _n : m_end;
+            if(m_next.compare_exchange_weak(_cur, _l,
+                                            std::memory_order_relaxed))
+            {
+                _first = _cur;
+                _last = _l;
+                return true;
+            }
+        }
+    }
+
+    // every iteration has been claimed (not necessarily executed)
+    bool exhausted() const
+    {
+        return !(m_next.load(std::memory_order_relaxed) < m_end);
+    }
+
+private:
+    std::atomic<_Arg>       m_next;
+    const _Arg              m_end;
+    loop_schedule::kind_type m_kind;
+    const _Arg              m_chunk;
+    const _Arg              m_nworkers;
+};
+
+//----------------------------------------------------------------------------//
+
+} // namespace details
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
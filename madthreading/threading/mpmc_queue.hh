@@ -0,0 +1,208 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef mpmc_queue_hh_
+#define mpmc_queue_hh_
+
+//----------------------------------------------------------------------------//
+// Multi-producer/multi-consumer queue
+//
+//  - fast path is a bounded, lock-free ring buffer (D. Vyukov's design):
+//    every cell carries a sequence number that tells producers and
+//    consumers whether the cell is free for the current "lap"
+//  - when the ring is full, items spill into a mutex-guarded deque so a
+//    push never fails. Consumers drain the ring first, then the overflow.
+//    Ordering is therefore FIFO per producer only while nothing overflows
+//----------------------------------------------------------------------------//
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <cstddef>
+
+namespace mad
+{
+
+//============================================================================//
+
+template <typename _Tp>
+class mpmc_queue
+{
+public:
+    typedef _Tp             value_type;
+    typedef std::size_t     size_type;
+
+public:
+    // capacity of the lock-free ring, rounded up to a power of two
+    explicit mpmc_queue(size_type _capacity = 4096)
+    : m_mask(round_up(_capacity) - 1),
+      m_cells(new cell_type[m_mask + 1]),
+      m_enqueue_pos(0),
+      m_dequeue_pos(0),
+      m_overflow_size(0)
+    {
+        for(size_type i = 0; i <= m_mask; ++i)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    ~mpmc_queue() { delete [] m_cells; }
+
+public:
+    //------------------------------------------------------------------------//
+    // never fails, falls back to the overflow deque when the ring is full
+    void push(const _Tp& _val)
+    {
+        // keep later items behind the ones already spilled
+        if(m_overflow_size.load(std::memory_order_acquire) == 0 &&
+           try_push(_val))
+            return;
+
+        std::lock_guard<std::mutex> l(m_overflow_lock);
+        m_overflow.push_back(_val);
+        m_overflow_size.fetch_add(1, std::memory_order_release);
+    }
+    //------------------------------------------------------------------------//
+    // returns false if empty
+    bool pop(_Tp& _val)
+    {
+        if(try_pop(_val))
+            return true;
+
+        if(m_overflow_size.load(std::memory_order_acquire) == 0)
+            return false;
+
+        std::lock_guard<std::mutex> l(m_overflow_lock);
+        if(m_overflow.empty())
+            return false;
+        _val = m_overflow.front();
+        m_overflow.pop_front();
+        m_overflow_size.fetch_sub(1, std::memory_order_release);
+        return true;
+    }
+    //------------------------------------------------------------------------//
+    // lock-free, returns false when the ring is full
+    bool try_push(const _Tp& _val)
+    {
+        cell_type* _cell = nullptr;
+        size_type _pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        while(true)
+        {
+            _cell = &m_cells[_pos & m_mask];
+            size_type _seq = _cell->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t _diff = (std::ptrdiff_t) _seq - (std::ptrdiff_t) _pos;
+            if(_diff == 0)
+            {
+                if(m_enqueue_pos.compare_exchange_weak(_pos, _pos + 1,
+                                                      std::memory_order_relaxed))
+                    break;
+            }
+            else if(_diff < 0)
+                return false; // full
+            else
+                _pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+        _cell->data = _val;
+        _cell->sequence.store(_pos + 1, std::memory_order_release);
+        return true;
+    }
+    //------------------------------------------------------------------------//
+    // lock-free, returns false when the ring is empty
+    bool try_pop(_Tp& _val)
+    {
+        cell_type* _cell = nullptr;
+        size_type _pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        while(true)
+        {
+            _cell = &m_cells[_pos & m_mask];
+            size_type _seq = _cell->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t _diff = (std::ptrdiff_t) _seq -
+                                   (std::ptrdiff_t) (_pos + 1);
+            if(_diff == 0)
+            {
+                if(m_dequeue_pos.compare_exchange_weak(_pos, _pos + 1,
+                                                      std::memory_order_relaxed))
+                    break;
+            }
+            else if(_diff < 0)
+                return false; // empty
+            else
+                _pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        }
+        _val = _cell->data;
+        _cell->sequence.store(_pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+    //------------------------------------------------------------------------//
+    // approximate when called concurrently
+    size_type size() const
+    {
+        size_type _e = m_enqueue_pos.load(std::memory_order_relaxed);
+        size_type _d = m_dequeue_pos.load(std::memory_order_relaxed);
+        return ((_e > _d) ? (_e - _d) : 0) +
+                m_overflow_size.load(std::memory_order_relaxed);
+    }
+
+    bool empty() const { return size() == 0; }
+    size_type capacity() const { return m_mask + 1; }
+
+private:
+    static size_type round_up(size_type n)
+    {
+        size_type _n = 2;
+        while(_n < n)
+            _n <<= 1;
+        return _n;
+    }
+
+private:
+    struct cell_type
+    {
+        std::atomic<size_type>  sequence;
+        _Tp                     data;
+    };
+
+    // keep the producer and consumer counters on separate cache lines
+    typedef char cache_pad_t[64];
+
+    cache_pad_t             m_pad0;
+    const size_type         m_mask;
+    cell_type* const        m_cells;
+    cache_pad_t             m_pad1;
+    std::atomic<size_type>  m_enqueue_pos;
+    cache_pad_t             m_pad2;
+    std::atomic<size_type>  m_dequeue_pos;
+    cache_pad_t             m_pad3;
+    std::atomic<size_type>  m_overflow_size;
+    std::mutex              m_overflow_lock;
+    std::deque<_Tp>         m_overflow;
+
+private:
+    mpmc_queue(const mpmc_queue&);
+    mpmc_queue& operator=(const mpmc_queue&);
+};
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
@@ -0,0 +1,123 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#ifndef parallel_find_hh_
+#define parallel_find_hh_
+
+//----------------------------------------------------------------------------//
+// parallel_find_if: the first element satisfying a predicate, like
+// std::find_if, with early exit
+//
+// One task per worker (and the calling thread) claims chunks of the range
+// in increasing order from a shared counter. A match lowers the shared
+// "found" index and cancels the task_group: no further chunks are claimed
+// and the tasks that have not started are skipped. The chunks already
+// claimed all lie before the match (they were claimed earlier) and are
+// scanned up to the current "found" index, so the result is the first
+// match, not just any. Use via thread_manager::parallel_find_if
+//----------------------------------------------------------------------------//
+
+#include "madthreading/threading/thread_pool.hh"
+#include "madthreading/threading/loop_schedule.hh"
+#include "madthreading/threading/task/task.hh"
+#include "madthreading/threading/task/task_group.hh"
+
+#include <atomic>
+#include <algorithm>
+#include <cstddef>
+
+namespace mad
+{
+
+namespace details
+{
+
+// elements per chunk: small enough to stop soon after a match, large enough
+// to amortize the claim
+static const std::size_t find_min_chunk = 1 << 10;
+static const std::size_t find_chunks_per_worker = 16;
+
+//----------------------------------------------------------------------------//
+// lower _value to _index if smaller
+inline void atomic_min(std::atomic<std::size_t>& _value, std::size_t _index)
+{
+    std::size_t _cur = _value.load(std::memory_order_relaxed);
+    while(_index < _cur &&
+          !_value.compare_exchange_weak(_cur, _index,
+                                        std::memory_order_relaxed))
+    { }
+}
+
+//----------------------------------------------------------------------------//
+
+template <typename _Iter, typename _Predicate>
+_Iter parallel_find_if(thread_pool* tp, _Iter first, _Iter last,
+                       const _Predicate& pred)
+{
+    typedef loop_counter<std::size_t> counter_type;
+
+    std::size_t _n = last - first;
+    if(_n <= find_min_chunk || tp->size() < 2 || !tp->is_alive())
+        return std::find_if(first, last, pred);
+
+    std::size_t _chunk = std::max(find_min_chunk,
+                                  _n / (find_chunks_per_worker * tp->size()));
+    counter_type _counter(0, _n, loop_schedule::dynamic(_chunk), tp->size());
+    std::atomic<std::size_t> _found(_n);
+    task_group tg(tp);
+
+    auto _search = [&] ()
+    {
+        std::size_t _f, _l;
+        while(!tg.is_canceled() && _counter.claim(_f, _l))
+        {
+            for(std::size_t i = _f;
+                i < _l && i < _found.load(std::memory_order_relaxed); ++i)
+            {
+                if(pred(*(first + i)))
+                {
+                    atomic_min(_found, i);
+                    tg.cancel();
+                    break;
+                }
+            }
+        }
+    };
+
+    for(std::size_t i = 1; i < tp->size(); ++i)
+        tp->add_task(new task<void>(&tg, _search));
+    // the calling thread searches as well
+    _search();
+    tg.join();
+
+    return first + _found.load();
+}
+
+//----------------------------------------------------------------------------//
+
+} // namespace details
+
+} // namespace mad
+
+#endif
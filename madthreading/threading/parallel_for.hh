@@ -0,0 +1,326 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#ifndef parallel_for_hh_
+#define parallel_for_hh_
+
+//----------------------------------------------------------------------------//
+// parallel_for over a splittable range (e.g. blocked_range) with lazy
+// recursive splitting: a task keeps the lower half of its range and
+// spawns the upper half, so idle workers steal the largest pieces first
+// and splitting only happens as deep as the load requires.
+//
+// Partitioners:
+//  - simple_partitioner   : split until the range is no longer divisible
+//                           (the grainsize alone sets the task size)
+//  - auto_partitioner     : split into a few pieces per worker, then split
+//                           further only when a piece is stolen
+//  - affinity_partitioner : fixed pieces. The worker that executed each
+//                           piece is recorded and the next loop with the
+//                           same partitioner places the piece on that
+//                           worker again (cache reuse across loops)
+//
+// Use via thread_manager::parallel_for
+//----------------------------------------------------------------------------//
+
+#include "madthreading/types.hh"
+#include "madthreading/threading/thread_pool.hh"
+#include "madthreading/threading/blocked_range.hh"
+#include "madthreading/threading/task/task.hh"
+#include "madthreading/threading/task/task_group.hh"
+
+#include <vector>
+#include <algorithm>
+
+namespace mad
+{
+
+//============================================================================//
+
+class simple_partitioner { };
+
+//============================================================================//
+
+class auto_partitioner { };
+
+//============================================================================//
+
+class affinity_partitioner
+{
+public:
+    typedef std::vector<long>   map_type;
+
+public:
+    // worker index per piece of the last loop (-1 = not a pool worker)
+    const map_type& get_map() const { return m_map; }
+    map_type& get_map() { return m_map; }
+    void clear() { m_map.clear(); }
+
+private:
+    map_type    m_map;
+};
+
+//============================================================================//
+
+namespace details
+{
+
+//----------------------------------------------------------------------------//
+// shared by all the tasks of one parallel_for, lives on the caller's stack
+template <typename _Body>
+struct for_context
+{
+    const _Body*    body;
+    thread_pool*    pool;
+    task_group*     group;
+};
+
+//----------------------------------------------------------------------------//
+struct simple_partition_state
+{
+    void note_start(long) { }
+    bool should_split() const { return true; }
+    simple_partition_state split() { return *this; }
+};
+
+//----------------------------------------------------------------------------//
+struct auto_partition_state
+{
+    // extra levels of splitting granted to a piece that was stolen
+    static const int stolen_depth = 1;
+
+    int     depth;  // remaining levels of splitting
+    long    owner;  // worker that spawned this piece
+
+    auto_partition_state(int _depth, long _owner)
+    : depth(_depth), owner(_owner)
+    { }
+
+    void note_start(long _worker)
+    {
+        if(_worker != owner)
+            depth += stolen_depth;
+        owner = _worker;
+    }
+    bool should_split() const { return depth > 0; }
+    auto_partition_state split()
+    {
+        --depth;
+        return *this;
+    }
+
+    // split into at least 2 pieces per worker up front
+    static int initial_depth(std::size_t _nworkers)
+    {
+        int _depth = 1;
+        for(std::size_t n = 1; n < _nworkers; n *= 2)
+            ++_depth;
+        return _depth;
+    }
+};
+
+//----------------------------------------------------------------------------//
+// the task body of a recursively split parallel_for. Keep this small: it
+// is stored inline in the task (small_function)
+template <typename _Range, typename _Body, typename _State>
+class start_for
+{
+public:
+    typedef for_context<_Body> context_type;
+
+public:
+    start_for(const _Range& _range, const context_type* _ctx, _State _state)
+    : m_range(_range), m_ctx(_ctx), m_state(_state)
+    { }
+
+    void operator()()
+    {
+        m_state.note_start(m_ctx->pool->get_this_thread_index());
+        // keep the lower half, hand out the upper half
+        while(m_range.is_divisible() && m_state.should_split())
+        {
+            _Range _upper(m_range, splitter());
+            spawn(_upper, m_state.split());
+        }
+        (*m_ctx->body)(m_range);
+    }
+
+    static void spawn(const _Range& _range, const context_type* _ctx,
+                      _State _state)
+    {
+        _ctx->pool->add_task(new task<void>(_ctx->group,
+                                            start_for(_range, _ctx, _state)));
+    }
+
+private:
+    void spawn(const _Range& _range, _State _state)
+    {
+        spawn(_range, m_ctx, _state);
+    }
+
+private:
+    _Range                  m_range;
+    const context_type*     m_ctx;
+    _State                  m_state;
+};
+
+//----------------------------------------------------------------------------//
+// one fixed piece of an affinity_partitioner loop
+template <typename _Range, typename _Body>
+class affinity_for
+{
+public:
+    affinity_for(const _Range& _range, const _Body* _body,
+                 thread_pool* _pool, long* _slot)
+    : m_range(_range), m_body(_body), m_pool(_pool), m_slot(_slot)
+    { }
+
+    void operator()()
+    {
+        *m_slot = m_pool->get_this_thread_index();
+        (*m_body)(m_range);
+    }
+
+private:
+    _Range          m_range;
+    const _Body*    m_body;
+    thread_pool*    m_pool;
+    long*           m_slot;
+};
+
+//----------------------------------------------------------------------------//
+// start of block _b when [0, _n) is cut into _nblocks nearly equal blocks
+inline std::size_t block_offset(std::size_t _n, std::size_t _nblocks,
+                                std::size_t _b)
+{
+    return (_n / _nblocks) * _b + std::min(_b, _n % _nblocks);
+}
+
+//----------------------------------------------------------------------------//
+// split breadth-first until there are at least _target pieces (or nothing
+// is divisible). The pieces are in range order and only depend on the
+// range and _target, not on the scheduling
+template <typename _Range>
+std::vector<_Range> split_pieces(const _Range& range, std::size_t _target)
+{
+    std::vector<_Range> _pieces(1, range);
+    bool _divided = true;
+    while(_pieces.size() < _target && _divided)
+    {
+        _divided = false;
+        std::vector<_Range> _next;
+        _next.reserve(2 * _pieces.size());
+        for(auto& itr : _pieces)
+        {
+            if(itr.is_divisible())
+            {
+                _Range _upper(itr, splitter());
+                _next.push_back(itr);
+                _next.push_back(_upper);
+                _divided = true;
+            }
+            else
+                _next.push_back(itr);
+        }
+        _pieces.swap(_next);
+    }
+    return _pieces;
+}
+
+//----------------------------------------------------------------------------//
+
+template <typename _Range, typename _Body>
+void parallel_for(thread_pool* tp, const _Range& range, const _Body& body,
+                  const simple_partitioner&)
+{
+    typedef start_for<_Range, _Body, simple_partition_state> start_type;
+
+    if(range.empty())
+        return;
+
+    task_group tg(tp);
+    for_context<_Body> _ctx = { &body, tp, &tg };
+    // the calling thread takes the first piece itself
+    start_type(range, &_ctx, simple_partition_state())();
+    tg.join();
+}
+
+//----------------------------------------------------------------------------//
+
+template <typename _Range, typename _Body>
+void parallel_for(thread_pool* tp, const _Range& range, const _Body& body,
+                  const auto_partitioner&)
+{
+    typedef start_for<_Range, _Body, auto_partition_state> start_type;
+
+    if(range.empty())
+        return;
+
+    task_group tg(tp);
+    for_context<_Body> _ctx = { &body, tp, &tg };
+    auto_partition_state _state(auto_partition_state::initial_depth(tp->size()),
+                                tp->get_this_thread_index());
+    // the calling thread takes the first piece itself
+    start_type(range, &_ctx, _state)();
+    tg.join();
+}
+
+//----------------------------------------------------------------------------//
+
+template <typename _Range, typename _Body>
+void parallel_for(thread_pool* tp, const _Range& range, const _Body& body,
+                  affinity_partitioner& partitioner)
+{
+    typedef affinity_for<_Range, _Body> piece_type;
+
+    if(range.empty())
+        return;
+
+    // deterministic pieces (4 per worker): the same range always gives the
+    // same pieces so the recorded placement stays meaningful
+    std::vector<_Range> _pieces = split_pieces(range, 4 * tp->size());
+
+    //------------------------------------------------------------------------//
+    // a different decomposition invalidates the recorded placement
+    affinity_partitioner::map_type& _map = partitioner.get_map();
+    if(_map.size() != _pieces.size())
+        _map.assign(_pieces.size(), -1);
+
+    task_group tg(tp);
+    for(std::size_t i = 0; i < _pieces.size(); ++i)
+        tp->add_task(new task<void>(&tg, piece_type(_pieces[i], &body, tp,
+                                                    &_map[i])),
+                     _map[i]);
+    tg.join();
+}
+
+//----------------------------------------------------------------------------//
+
+} // namespace details
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
@@ -0,0 +1,138 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#ifndef parallel_invoke_hh_
+#define parallel_invoke_hh_
+
+//----------------------------------------------------------------------------//
+// fork-join for recursive (divide-and-conquer) code on the thread pool
+//
+//  - spawn_group: spawn(func) queues func, sync() returns once everything
+//    spawned so far has been executed, e.g. inside a task
+//          spawn_group sg(tp);
+//          sg.spawn([&] () { x = fib(n-1); });
+//          y = fib(n-2);
+//          sg.sync();
+//  - parallel_invoke(tp, f1, f2, ...): f1 ... fN-1 are spawned, the last
+//    one runs on the calling thread
+//
+// sync() is the helping join of task_group: the waiting thread pops the
+// group's tasks newest first from its own queue, so a spawned function
+// nobody stole runs inline like a plain call, and executes other queued
+// work while the stolen ones finish. A worker never blocks and no thread
+// is created, recursion of any depth neither deadlocks nor oversubscribes.
+// Stop spawning below a cutoff, a task costs far more than a small call.
+// An exception of a spawned function is rethrown by sync()
+//----------------------------------------------------------------------------//
+
+#include "madthreading/threading/thread_pool.hh"
+#include "madthreading/threading/task/task.hh"
+#include "madthreading/threading/task/task_group.hh"
+
+#include <utility>
+#include <type_traits>
+
+namespace mad
+{
+
+//============================================================================//
+
+class spawn_group
+{
+public:
+    // nullptr: the pool of the thread_manager instance (like task_group)
+    explicit spawn_group(thread_pool* tp = nullptr)
+    : m_group(tp)
+    { }
+
+    // everything spawned has finished once the group goes out of scope.
+    // Call sync() to see exceptions of the spawned functions, they are
+    // dropped here (e.g. while unwinding from another exception)
+    ~spawn_group()
+    {
+        try { sync(); }
+        catch(...) { }
+    }
+
+public:
+    template <typename _Func>
+    void spawn(_Func&& func)
+    {
+        typedef typename std::decay<_Func>::type function_type;
+        m_group.pool()->add_task(new task<void>(&m_group,
+                                 function_type(std::forward<_Func>(func))));
+    }
+
+    void sync() { m_group.join(); }
+
+    task_group& group() { return m_group; }
+    thread_pool* pool() const { return m_group.pool(); }
+
+private:
+    task_group      m_group;
+
+private:
+    spawn_group(const spawn_group&);
+    spawn_group& operator=(const spawn_group&);
+};
+
+//============================================================================//
+
+namespace details
+{
+
+//----------------------------------------------------------------------------//
+template <typename _Func>
+void invoke_all(spawn_group&, _Func&& func)
+{
+    func();
+}
+
+//----------------------------------------------------------------------------//
+template <typename _Func, typename... _Funcs>
+void invoke_all(spawn_group& sg, _Func&& func, _Funcs&&... funcs)
+{
+    sg.spawn(std::forward<_Func>(func));
+    invoke_all(sg, std::forward<_Funcs>(funcs)...);
+}
+
+//----------------------------------------------------------------------------//
+
+} // namespace details
+
+//============================================================================//
+
+template <typename... _Funcs>
+void parallel_invoke(thread_pool* tp, _Funcs&&... funcs)
+{
+    spawn_group sg(tp);
+    details::invoke_all(sg, std::forward<_Funcs>(funcs)...);
+    sg.sync();
+}
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
@@ -0,0 +1,201 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#ifndef parallel_reduce_hh_
+#define parallel_reduce_hh_
+
+//----------------------------------------------------------------------------//
+// parallel_reduce over a splittable range (e.g. blocked_range)
+//
+//  value = parallel_reduce(range, identity, map, combine)
+//
+//      map(const range_type&, const value_type& init) -> value_type
+//          folds one piece of the range into "init" (TBB lambda form)
+//      combine(const value_type&, const value_type&) -> value_type
+//          must be associative and have "identity" as its neutral element
+//
+// Default (auto_partitioner): the range is split lazily like parallel_for
+// and every thread folds its pieces into its own cache-line padded partial,
+// so there is no atomic or lock per piece. The partials are combined in a
+// pairwise (log-depth) tree once all the pieces are done. The assignment
+// of pieces to partials depends on scheduling, so "combine" must also be
+// commutative and floating-point results can vary in the last bits.
+//
+// deterministic_partitioner: the range is split into the same pieces
+// every time (independent of the number of threads and of scheduling),
+// each piece is mapped from "identity" into its own slot and the slots are
+// combined in a fixed pairwise tree. Reproducible results, "combine" only
+// has to be associative.
+//
+// Use via thread_manager::parallel_reduce
+//----------------------------------------------------------------------------//
+
+#include "madthreading/types.hh"
+#include "madthreading/threading/thread_pool.hh"
+#include "madthreading/threading/fast_mutex.hh"
+#include "madthreading/threading/blocked_range.hh"
+#include "madthreading/threading/parallel_for.hh"
+
+#include <vector>
+#include <thread>
+#include <cstddef>
+
+namespace mad
+{
+
+//============================================================================//
+
+class deterministic_partitioner
+{
+public:
+    typedef std::size_t size_type;
+
+public:
+    // the range is split breadth-first until there are at least
+    // "max_pieces" pieces or nothing is divisible (the grainsize of the
+    // range bounds the piece size from below)
+    explicit deterministic_partitioner(size_type _max_pieces = 1024)
+    : m_max_pieces((_max_pieces == 0) ? 1 : _max_pieces)
+    { }
+
+    size_type max_pieces() const { return m_max_pieces; }
+
+private:
+    size_type   m_max_pieces;
+};
+
+//============================================================================//
+
+namespace details
+{
+
+//----------------------------------------------------------------------------//
+// a value on its own cache line(s)
+template <typename _Tp>
+struct padded_partial
+{
+    typedef char cache_pad_t[64];
+
+    explicit padded_partial(const _Tp& _init) : value(_init) { }
+
+    _Tp         value;
+    cache_pad_t m_pad;
+};
+
+//----------------------------------------------------------------------------//
+// in-order pairwise combine: ((v0 v1) (v2 v3)) ((v4 v5) ...)
+template <typename _Tp, typename _Combine>
+_Tp tree_combine(std::vector<_Tp>& _values, const _Combine& combine)
+{
+    std::size_t _n = _values.size();
+    for(std::size_t _stride = 1; _stride < _n; _stride *= 2)
+        for(std::size_t i = 0; i + _stride < _n; i += 2*_stride)
+            _values[i] = combine(_values[i], _values[i + _stride]);
+    return _values.front();
+}
+
+//----------------------------------------------------------------------------//
+
+template <typename _Range, typename _Tp, typename _Map, typename _Combine>
+_Tp parallel_reduce(thread_pool* tp, const _Range& range, const _Tp& identity,
+                    const _Map& map, const _Combine& combine,
+                    const auto_partitioner& partitioner)
+{
+    typedef padded_partial<_Tp> partial_type;
+
+    if(range.empty())
+        return identity;
+
+    // one partial per worker, one for the calling thread and one (guarded)
+    // for any other thread that ends up running a piece while helping
+    const long _nworkers = tp->size();
+    const std::thread::id _caller = std::this_thread::get_id();
+    std::vector<partial_type> _partials(_nworkers + 2, partial_type(identity));
+    spin_mutex _foreign_lock;
+
+    // map() starts from the identity and is folded into the slot afterwards:
+    // a map that joins nested work can run other pieces of this reduction
+    // on the same thread, which then update the same slot meanwhile
+    auto _body = [&] (const _Range& r)
+    {
+        _Tp _value = map(r, identity);
+        long _index = tp->get_this_thread_index();
+        if(_index >= 0 && _index < _nworkers)
+            _partials[_index].value = combine(_partials[_index].value, _value);
+        else if(std::this_thread::get_id() == _caller)
+            _partials[_nworkers].value = combine(_partials[_nworkers].value,
+                                                 _value);
+        else
+        {
+            spin_lock l(_foreign_lock);
+            _partials[_nworkers+1].value = combine(_partials[_nworkers+1].value,
+                                                   _value);
+        }
+    };
+
+    parallel_for(tp, range, _body, partitioner);
+
+    std::vector<_Tp> _values;
+    _values.reserve(_partials.size());
+    for(auto& itr : _partials)
+        _values.push_back(itr.value);
+    return tree_combine(_values, combine);
+}
+
+//----------------------------------------------------------------------------//
+
+template <typename _Range, typename _Tp, typename _Map, typename _Combine>
+_Tp parallel_reduce(thread_pool* tp, const _Range& range, const _Tp& identity,
+                    const _Map& map, const _Combine& combine,
+                    const deterministic_partitioner& partitioner)
+{
+    typedef blocked_range<std::size_t> index_range;
+
+    if(range.empty())
+        return identity;
+
+    std::vector<_Range> _pieces = split_pieces(range, partitioner.max_pieces());
+    // every slot is written exactly once, by the task owning the piece
+    std::vector<_Tp> _values(_pieces.size(), identity);
+
+    auto _body = [&] (const index_range& r)
+    {
+        for(std::size_t i = r.begin(); i < r.end(); ++i)
+            _values[i] = map(_pieces[i], identity);
+    };
+
+    parallel_for(tp, index_range(0, _pieces.size()), _body,
+                 auto_partitioner());
+    return tree_combine(_values, combine);
+}
+
+//----------------------------------------------------------------------------//
+
+} // namespace details
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
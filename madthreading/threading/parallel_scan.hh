@@ -0,0 +1,281 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#ifndef parallel_scan_hh_
+#define parallel_scan_hh_
+
+//----------------------------------------------------------------------------//
+// parallel prefix scan (inclusive and exclusive) with an associative "op"
+//
+// Two-pass block scan:
+//  1. the input is cut into a few large blocks per worker and every block
+//     but the last is reduced in parallel
+//  2. the block sums are scanned serially into block offsets (a handful
+//     of values)
+//  3. every block is scanned in parallel starting from its offset
+//
+// The input is read twice and the output written once. The block kernels
+// are plain loops, except for sums (std::plus) of arithmetic types over
+// raw pointers, which use OpenMP SIMD reductions/scans when available
+// (pass vec.data() rather than vec.begin() to get them).
+//
+// In-place scans (out == first) are supported.
+//
+// Use via thread_manager::parallel_inclusive_scan / parallel_exclusive_scan
+//----------------------------------------------------------------------------//
+
+#include "madthreading/macros.hh"
+#include "madthreading/threading/thread_pool.hh"
+#include "madthreading/threading/blocked_range.hh"
+#include "madthreading/threading/parallel_for.hh"
+
+#include <vector>
+#include <iterator>
+#include <functional>
+#include <type_traits>
+#include <algorithm>
+#include <cstddef>
+
+// "omp simd reduction(inscan, ...)" is OpenMP 5.0 (GCC >= 10)
+#if defined(USE_OPENMP) && defined(_OPENMP) && \
+    (_OPENMP >= 201811 || \
+     (defined(__GNUC__) && !defined(__clang__) && \
+      !defined(__INTEL_COMPILER) && __GNUC__ >= 10))
+#   define MAD_OMP_SIMD_SCAN
+#endif
+
+namespace mad
+{
+
+namespace details
+{
+
+//============================================================================//
+//  generic block kernels
+//============================================================================//
+
+template <typename _InIter, typename _Tp, typename _Op>
+_Tp reduce_block(_InIter first, _InIter last, _Tp init, const _Op& op)
+{
+    for(; first != last; ++first)
+        init = op(init, *first);
+    return init;
+}
+
+//----------------------------------------------------------------------------//
+
+template <typename _InIter, typename _OutIter, typename _Tp, typename _Op>
+void inclusive_scan_block(_InIter first, _InIter last, _OutIter out,
+                          _Tp init, const _Op& op)
+{
+    for(; first != last; ++first, ++out)
+    {
+        init = op(init, *first);
+        *out = init;
+    }
+}
+
+//----------------------------------------------------------------------------//
+
+template <typename _InIter, typename _OutIter, typename _Tp, typename _Op>
+void exclusive_scan_block(_InIter first, _InIter last, _OutIter out,
+                          _Tp init, const _Op& op)
+{
+    for(; first != last; ++first, ++out)
+    {
+        // read before writing for in-place scans
+        _Tp _val = *first;
+        *out = init;
+        init = op(init, _val);
+    }
+}
+
+#if defined(MAD_OMP_SIMD_SCAN)
+
+//============================================================================//
+//  SIMD block kernels: sums of arithmetic types on contiguous memory
+//============================================================================//
+
+template <typename _Up, typename _Tp>
+struct is_simd_sum
+: std::integral_constant<bool,
+    std::is_arithmetic<_Tp>::value &&
+    std::is_same<typename std::remove_const<_Up>::type, _Tp>::value>
+{ };
+
+//----------------------------------------------------------------------------//
+
+template <typename _Up, typename _Tp>
+typename std::enable_if<is_simd_sum<_Up, _Tp>::value, _Tp>::type
+reduce_block(_Up* first, _Up* last, _Tp init, const std::plus<_Tp>&)
+{
+    const std::ptrdiff_t _n = last - first;
+    #pragma omp simd reduction(+:init)
+    for(std::ptrdiff_t i = 0; i < _n; ++i)
+        init += first[i];
+    return init;
+}
+
+//----------------------------------------------------------------------------//
+
+template <typename _Up, typename _Tp>
+typename std::enable_if<is_simd_sum<_Up, _Tp>::value>::type
+inclusive_scan_block(_Up* first, _Up* last, _Tp* out, _Tp init,
+                     const std::plus<_Tp>&)
+{
+    const std::ptrdiff_t _n = last - first;
+    #pragma omp simd reduction(inscan, +:init)
+    for(std::ptrdiff_t i = 0; i < _n; ++i)
+    {
+        init += first[i];
+        #pragma omp scan inclusive(init)
+        out[i] = init;
+    }
+}
+
+//----------------------------------------------------------------------------//
+
+template <typename _Up, typename _Tp>
+typename std::enable_if<is_simd_sum<_Up, _Tp>::value>::type
+exclusive_scan_block(_Up* first, _Up* last, _Tp* out, _Tp init,
+                     const std::plus<_Tp>& op)
+{
+    // the output is written before the input is read
+    if(static_cast<const void*>(first) == static_cast<const void*>(out))
+    {
+        exclusive_scan_block<_Up*, _Tp*, _Tp, std::plus<_Tp>>(first, last,
+                                                             out, init, op);
+        return;
+    }
+
+    const std::ptrdiff_t _n = last - first;
+    #pragma omp simd reduction(inscan, +:init)
+    for(std::ptrdiff_t i = 0; i < _n; ++i)
+    {
+        out[i] = init;
+        #pragma omp scan exclusive(init)
+        init += first[i];
+    }
+}
+
+#endif
+
+//============================================================================//
+//  driver
+//============================================================================//
+
+// smallest block worth a task, a few blocks per worker otherwise
+static const std::size_t scan_min_block = 1 << 16;
+static const std::size_t scan_blocks_per_worker = 4;
+
+//----------------------------------------------------------------------------//
+// "init" is the initial value of an exclusive scan and ignored (nullptr)
+// for an inclusive scan
+template <typename _InIter, typename _OutIter, typename _Tp, typename _Op>
+_OutIter parallel_scan(thread_pool* tp, _InIter first, _InIter last,
+                       _OutIter out, const _Tp* init, const _Op& op)
+{
+    typedef blocked_range<std::size_t> index_range;
+
+    const std::size_t _n = std::distance(first, last);
+    if(_n == 0)
+        return out;
+
+    const bool _inclusive = (init == nullptr);
+    std::size_t _nblocks = std::min<std::size_t>(_n / scan_min_block,
+                                   scan_blocks_per_worker * tp->size());
+    if(tp->size() < 2 || _nblocks < 2)
+        _nblocks = 1;
+
+    auto _begin = [=] (std::size_t b) { return block_offset(_n, _nblocks, b); };
+
+    //------------------------------------------------------------------------//
+    // pass 1: block sums (seeded with the first element, no identity needed)
+    std::vector<_Tp> _offsets(_nblocks + 1);
+    if(_nblocks > 1)
+    {
+        std::vector<_Tp> _sums(_nblocks - 1);
+        auto _reduce = [&] (const index_range& r)
+        {
+            for(std::size_t b = r.begin(); b < r.end(); ++b)
+            {
+                _InIter _first = first + _begin(b);
+                _sums[b] = reduce_block(_first + 1, first + _begin(b+1),
+                                        _Tp(*_first), op);
+            }
+        };
+        parallel_for(tp, index_range(0, _nblocks - 1), _reduce,
+                     simple_partitioner());
+
+        // offsets[b] is the combined value of everything before block b
+        // (unused for the first block of an inclusive scan)
+        _offsets[1] = (_inclusive) ? _sums[0] : op(*init, _sums[0]);
+        for(std::size_t b = 1; b + 1 < _nblocks; ++b)
+            _offsets[b+1] = op(_offsets[b], _sums[b]);
+    }
+    if(!_inclusive)
+        _offsets[0] = *init;
+
+    //------------------------------------------------------------------------//
+    // pass 2: scan every block from its offset
+    auto _scan = [&] (const index_range& r)
+    {
+        for(std::size_t b = r.begin(); b < r.end(); ++b)
+        {
+            std::size_t _b0 = _begin(b);
+            std::size_t _b1 = _begin(b+1);
+            if(!_inclusive)
+                exclusive_scan_block(first + _b0, first + _b1, out + _b0,
+                                     _offsets[b], op);
+            else if(b > 0)
+                inclusive_scan_block(first + _b0, first + _b1, out + _b0,
+                                     _offsets[b], op);
+            else
+            {
+                _Tp _first = *first;
+                *out = _first;
+                inclusive_scan_block(first + 1, first + _b1, out + 1,
+                                     _first, op);
+            }
+        }
+    };
+
+    if(_nblocks > 1)
+        parallel_for(tp, index_range(0, _nblocks), _scan,
+                     simple_partitioner());
+    else
+        _scan(index_range(0, 1));
+
+    return out + _n;
+}
+
+//----------------------------------------------------------------------------//
+
+} // namespace details
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
@@ -0,0 +1,453 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#ifndef parallel_sort_hh_
+#define parallel_sort_hh_
+
+//----------------------------------------------------------------------------//
+// parallel sorting and partitioning on the thread pool
+//
+//  - merge sort (any comparator): blocks are sorted with std::sort in
+//    parallel, then runs are merged pairwise. Every merge round is split
+//    into equal output segments (merge-path co-ranking), so the last
+//    rounds stay parallel even though only a couple of runs are left
+//  - LSD radix sort (integer keys): one pass per byte, each block builds
+//    a histogram, the (digit, block) counts are scanned into offsets and
+//    each block scatters its elements stably. Passes where every key has
+//    the same byte are skipped (e.g. the high bytes of pixel indices)
+//  - partition: flags and per-block counts in parallel, then a parallel
+//    stable scatter. Returns the partition point like std::partition
+//
+// All of them use an O(n) temporary buffer and return once all their tasks
+// have been joined. Use via thread_manager::parallel_sort,
+// parallel_radix_sort and parallel_partition
+//----------------------------------------------------------------------------//
+
+#include "madthreading/threading/thread_pool.hh"
+#include "madthreading/threading/blocked_range.hh"
+#include "madthreading/threading/parallel_for.hh"
+
+#include <vector>
+#include <iterator>
+#include <functional>
+#include <type_traits>
+#include <algorithm>
+#include <limits>
+#include <cstddef>
+
+namespace mad
+{
+
+namespace details
+{
+
+// smallest block worth a task, a few blocks per worker otherwise
+static const std::size_t sort_min_block = 1 << 14;
+static const std::size_t sort_blocks_per_worker = 4;
+
+//----------------------------------------------------------------------------//
+// number of blocks for _n elements (1 = do it serially)
+inline std::size_t sort_num_blocks(thread_pool* tp, std::size_t _n)
+{
+    if(tp->size() < 2)
+        return 1;
+    std::size_t _nblocks = std::min<std::size_t>(_n / sort_min_block,
+                                   sort_blocks_per_worker * tp->size());
+    return (_nblocks < 2) ? 1 : _nblocks;
+}
+
+//============================================================================//
+//  merge sort
+//============================================================================//
+
+//----------------------------------------------------------------------------//
+// number of elements of _a among the first _k elements of the stable merge
+// of _a and _b (merge path)
+template <typename _Iter, typename _Compare>
+std::size_t merge_corank(std::size_t _k, _Iter _a, std::size_t _na,
+                         _Iter _b, std::size_t _nb, const _Compare& comp)
+{
+    std::size_t _lo = (_k > _nb) ? _k - _nb : 0;
+    std::size_t _hi = std::min(_k, _na);
+    while(_lo < _hi)
+    {
+        std::size_t i = _lo + (_hi - _lo) / 2;
+        std::size_t j = _k - i;
+        // a[i] <= b[j-1] : a[i] is among the first _k, i is too small
+        if(j > 0 && i < _na && !comp(*(_b + (j-1)), *(_a + i)))
+            _lo = i + 1;
+        else
+            _hi = i;
+    }
+    return _lo;
+}
+
+//----------------------------------------------------------------------------//
+// merge neighbouring runs of _src (boundaries in _bounds) into _dst,
+// _bounds is updated to the boundaries of the merged runs
+template <typename _SrcIter, typename _DstIter, typename _Compare>
+void merge_round(thread_pool* tp, _SrcIter _src, _DstIter _dst,
+                 std::vector<std::size_t>& _bounds, std::size_t _segment,
+                 const _Compare& comp)
+{
+    typedef blocked_range<std::size_t> index_range;
+    // one piece of work: output [k0, k1) of the merge of pair "p"
+    struct piece_type { std::size_t pair, k0, k1; };
+
+    std::size_t _nruns = _bounds.size() - 1;
+    std::vector<piece_type> _pieces;
+    for(std::size_t p = 0; 2*p < _nruns; ++p)
+    {
+        std::size_t _first = _bounds[2*p];
+        std::size_t _last = _bounds[std::min(2*p + 2, _nruns)];
+        for(std::size_t k = 0; k < _last - _first; k += _segment)
+        {
+            piece_type _piece = { p, k, std::min(k + _segment,
+                                                 _last - _first) };
+            _pieces.push_back(_piece);
+        }
+    }
+
+    auto _merge = [&] (const index_range& r)
+    {
+        for(std::size_t i = r.begin(); i < r.end(); ++i)
+        {
+            const piece_type& _piece = _pieces[i];
+            std::size_t _first = _bounds[2*_piece.pair];
+            std::size_t _mid = _bounds[std::min(2*_piece.pair + 1, _nruns)];
+            std::size_t _last = _bounds[std::min(2*_piece.pair + 2, _nruns)];
+            _SrcIter _a = _src + _first;
+            _SrcIter _b = _src + _mid;
+            std::size_t _na = _mid - _first;
+            std::size_t _nb = _last - _mid;
+            std::size_t _i0 = merge_corank(_piece.k0, _a, _na, _b, _nb, comp);
+            std::size_t _i1 = merge_corank(_piece.k1, _a, _na, _b, _nb, comp);
+            std::merge(std::make_move_iterator(_a + _i0),
+                       std::make_move_iterator(_a + _i1),
+                       std::make_move_iterator(_b + (_piece.k0 - _i0)),
+                       std::make_move_iterator(_b + (_piece.k1 - _i1)),
+                       _dst + (_first + _piece.k0), comp);
+        }
+    };
+    parallel_for(tp, index_range(0, _pieces.size()), _merge,
+                 simple_partitioner());
+
+    std::vector<std::size_t> _merged;
+    for(std::size_t i = 0; i < _nruns; i += 2)
+        _merged.push_back(_bounds[i]);
+    _merged.push_back(_bounds.back());
+    _bounds.swap(_merged);
+}
+
+//----------------------------------------------------------------------------//
+
+template <typename _Iter, typename _Compare>
+void parallel_merge_sort(thread_pool* tp, _Iter first, _Iter last,
+                         const _Compare& comp)
+{
+    typedef typename std::iterator_traits<_Iter>::value_type value_type;
+    typedef typename std::vector<value_type>::iterator buffer_iterator;
+    typedef blocked_range<std::size_t> index_range;
+
+    const std::size_t _n = std::distance(first, last);
+    const std::size_t _nblocks = sort_num_blocks(tp, _n);
+    if(_nblocks < 2)
+    {
+        std::sort(first, last, comp);
+        return;
+    }
+
+    std::vector<std::size_t> _bounds(_nblocks + 1);
+    for(std::size_t b = 0; b <= _nblocks; ++b)
+        _bounds[b] = block_offset(_n, _nblocks, b);
+
+    auto _sort = [&] (const index_range& r)
+    {
+        for(std::size_t b = r.begin(); b < r.end(); ++b)
+            std::sort(first + _bounds[b], first + _bounds[b+1], comp);
+    };
+    parallel_for(tp, index_range(0, _nblocks), _sort, simple_partitioner());
+
+    // ping-pong between the input and the buffer
+    std::vector<value_type> _buffer(_n);
+    const std::size_t _segment = std::max(_n / _nblocks, sort_min_block);
+    bool _in_buffer = false;
+    while(_bounds.size() > 2)
+    {
+        if(_in_buffer)
+            merge_round<buffer_iterator, _Iter>(tp, _buffer.begin(), first,
+                                                _bounds, _segment, comp);
+        else
+            merge_round<_Iter, buffer_iterator>(tp, first, _buffer.begin(),
+                                                _bounds, _segment, comp);
+        _in_buffer = !_in_buffer;
+    }
+
+    if(_in_buffer)
+    {
+        auto _move = [&] (const index_range& r)
+        {
+            std::move(_buffer.begin() + r.begin(), _buffer.begin() + r.end(),
+                      first + r.begin());
+        };
+        parallel_for(tp, index_range(0, _n, sort_min_block), _move,
+                     auto_partitioner());
+    }
+}
+
+//============================================================================//
+//  LSD radix sort
+//============================================================================//
+
+template <typename _Tp>
+struct is_radix_sortable
+: std::integral_constant<bool, std::is_integral<_Tp>::value &&
+                               !std::is_same<_Tp, bool>::value>
+{ };
+
+//----------------------------------------------------------------------------//
+// order-preserving map to an unsigned key (flip the sign bit)
+template <typename _Tp>
+typename std::make_unsigned<_Tp>::type radix_key(const _Tp& _val)
+{
+    typedef typename std::make_unsigned<_Tp>::type key_type;
+    const key_type _flip = (std::numeric_limits<_Tp>::is_signed)
+                           ? key_type(1) << (8*sizeof(_Tp) - 1) : 0;
+    return key_type(_val) ^ _flip;
+}
+
+//----------------------------------------------------------------------------//
+// one stable counting pass on byte "_shift/8" from _src to _dst, returns
+// false (and moves nothing) if every key has the same byte
+template <typename _SrcIter, typename _DstIter>
+bool radix_pass(thread_pool* tp, _SrcIter _src, _DstIter _dst, std::size_t _n,
+                std::size_t _nblocks, unsigned _shift)
+{
+    typedef typename std::iterator_traits<_SrcIter>::value_type value_type;
+    typedef blocked_range<std::size_t> index_range;
+    static const std::size_t _radix = 256;
+
+    auto _digit = [_shift] (const value_type& _val)
+    {
+        return std::size_t((radix_key(_val) >> _shift) & (_radix - 1));
+    };
+
+    // histogram per block, block-major
+    std::vector<std::size_t> _count(_nblocks * _radix, 0);
+    auto _histogram = [&] (const index_range& r)
+    {
+        for(std::size_t b = r.begin(); b < r.end(); ++b)
+        {
+            std::size_t* _hist = &_count[b * _radix];
+            std::size_t _end = block_offset(_n, _nblocks, b+1);
+            for(std::size_t i = block_offset(_n, _nblocks, b); i < _end; ++i)
+                ++_hist[_digit(*(_src + i))];
+        }
+    };
+    if(_nblocks > 1)
+        parallel_for(tp, index_range(0, _nblocks), _histogram,
+                     simple_partitioner());
+    else
+        _histogram(index_range(0, 1));
+
+    // all keys in a single bucket: this byte does not change the order
+    for(std::size_t d = 0; d < _radix; ++d)
+    {
+        std::size_t _total = 0;
+        for(std::size_t b = 0; b < _nblocks; ++b)
+            _total += _count[b * _radix + d];
+        if(_total == _n)
+            return false;
+        if(_total > 0)
+            break;
+    }
+
+    // exclusive scan in (digit, block) order gives every block the
+    // start of its elements in every bucket
+    std::size_t _offset = 0;
+    for(std::size_t d = 0; d < _radix; ++d)
+        for(std::size_t b = 0; b < _nblocks; ++b)
+        {
+            std::size_t _c = _count[b * _radix + d];
+            _count[b * _radix + d] = _offset;
+            _offset += _c;
+        }
+
+    auto _scatter = [&] (const index_range& r)
+    {
+        for(std::size_t b = r.begin(); b < r.end(); ++b)
+        {
+            std::size_t* _pos = &_count[b * _radix];
+            std::size_t _end = block_offset(_n, _nblocks, b+1);
+            for(std::size_t i = block_offset(_n, _nblocks, b); i < _end; ++i)
+                *(_dst + _pos[_digit(*(_src + i))]++) = *(_src + i);
+        }
+    };
+    if(_nblocks > 1)
+        parallel_for(tp, index_range(0, _nblocks), _scatter,
+                     simple_partitioner());
+    else
+        _scatter(index_range(0, 1));
+
+    return true;
+}
+
+//----------------------------------------------------------------------------//
+
+template <typename _Iter>
+void parallel_radix_sort(thread_pool* tp, _Iter first, _Iter last)
+{
+    typedef typename std::iterator_traits<_Iter>::value_type value_type;
+    typedef typename std::vector<value_type>::iterator buffer_iterator;
+    typedef blocked_range<std::size_t> index_range;
+
+    static_assert(is_radix_sortable<value_type>::value,
+                  "parallel_radix_sort requires integer keys");
+
+    const std::size_t _n = std::distance(first, last);
+    if(_n < 256)
+    {
+        std::sort(first, last);
+        return;
+    }
+    const std::size_t _nblocks = sort_num_blocks(tp, _n);
+
+    std::vector<value_type> _buffer(_n);
+    bool _in_buffer = false;
+    for(unsigned _shift = 0; _shift < 8*sizeof(value_type); _shift += 8)
+    {
+        bool _moved = (_in_buffer)
+            ? radix_pass<buffer_iterator, _Iter>(tp, _buffer.begin(), first,
+                                                 _n, _nblocks, _shift)
+            : radix_pass<_Iter, buffer_iterator>(tp, first, _buffer.begin(),
+                                                 _n, _nblocks, _shift);
+        if(_moved)
+            _in_buffer = !_in_buffer;
+    }
+
+    if(_in_buffer)
+    {
+        auto _copy = [&] (const index_range& r)
+        {
+            std::copy(_buffer.begin() + r.begin(), _buffer.begin() + r.end(),
+                      first + r.begin());
+        };
+        parallel_for(tp, index_range(0, _n, sort_min_block), _copy,
+                     auto_partitioner());
+    }
+}
+
+//----------------------------------------------------------------------------//
+// integer keys with the default ordering go through the radix sort
+template <typename _Iter>
+void parallel_sort(thread_pool* tp, _Iter first, _Iter last, std::true_type)
+{
+    parallel_radix_sort(tp, first, last);
+}
+
+template <typename _Iter>
+void parallel_sort(thread_pool* tp, _Iter first, _Iter last, std::false_type)
+{
+    typedef typename std::iterator_traits<_Iter>::value_type value_type;
+    parallel_merge_sort(tp, first, last, std::less<value_type>());
+}
+
+//============================================================================//
+//  partition
+//============================================================================//
+
+template <typename _Iter, typename _Predicate>
+_Iter parallel_partition(thread_pool* tp, _Iter first, _Iter last,
+                         const _Predicate& pred)
+{
+    typedef typename std::iterator_traits<_Iter>::value_type value_type;
+    typedef blocked_range<std::size_t> index_range;
+
+    const std::size_t _n = std::distance(first, last);
+    const std::size_t _nblocks = sort_num_blocks(tp, _n);
+    if(_nblocks < 2)
+        return std::stable_partition(first, last, pred);
+
+    // evaluate the predicate once per element, count per block
+    std::vector<char> _flags(_n);
+    std::vector<std::size_t> _ntrue(_nblocks + 1, 0);
+    auto _test = [&] (const index_range& r)
+    {
+        for(std::size_t b = r.begin(); b < r.end(); ++b)
+        {
+            std::size_t _count = 0;
+            std::size_t _end = block_offset(_n, _nblocks, b+1);
+            for(std::size_t i = block_offset(_n, _nblocks, b); i < _end; ++i)
+                _count += (_flags[i] = pred(*(first + i)) ? 1 : 0);
+            _ntrue[b] = _count;
+        }
+    };
+    parallel_for(tp, index_range(0, _nblocks), _test, simple_partitioner());
+
+    // exclusive scan of the counts, _ntrue[_nblocks] is the partition point
+    std::size_t _total = 0;
+    for(std::size_t b = 0; b <= _nblocks; ++b)
+    {
+        std::size_t _c = _ntrue[b];
+        _ntrue[b] = _total;
+        _total += _c;
+    }
+    const std::size_t _split = _ntrue[_nblocks];
+
+    std::vector<value_type> _buffer(_n);
+    auto _scatter = [&] (const index_range& r)
+    {
+        for(std::size_t b = r.begin(); b < r.end(); ++b)
+        {
+            std::size_t _begin = block_offset(_n, _nblocks, b);
+            std::size_t _end = block_offset(_n, _nblocks, b+1);
+            // falses before this block = _begin - trues before this block
+            std::size_t _t = _ntrue[b];
+            std::size_t _f = _split + (_begin - _ntrue[b]);
+            for(std::size_t i = _begin; i < _end; ++i)
+                _buffer[(_flags[i]) ? _t++ : _f++] = std::move(*(first + i));
+        }
+    };
+    parallel_for(tp, index_range(0, _nblocks), _scatter, simple_partitioner());
+
+    auto _move = [&] (const index_range& r)
+    {
+        std::move(_buffer.begin() + r.begin(), _buffer.begin() + r.end(),
+                  first + r.begin());
+    };
+    parallel_for(tp, index_range(0, _n, sort_min_block), _move,
+                     auto_partitioner());
+
+    return first + _split;
+}
+
+//----------------------------------------------------------------------------//
+
+} // namespace details
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
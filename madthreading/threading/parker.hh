@@ -0,0 +1,132 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#ifndef parker_hh_
+#define parker_hh_
+
+//----------------------------------------------------------------------------//
+// Single-waiter park/unpark slot used to put an idle worker to sleep.
+//
+//  - the owner calls prepare_park(), re-checks for work (after publishing
+//    itself as a sleeper) and then either cancel_park() or park()
+//  - any thread may call unpark(), which only succeeds (and only issues a
+//    wake-up system call) if the owner is actually parked
+//
+// On Linux the owner sleeps on a futex of the state word, elsewhere it falls
+// back to a mutex + condition variable.
+//----------------------------------------------------------------------------//
+
+#include "madthreading/threading/futex.hh"
+
+#include <atomic>
+#include <thread>
+
+#if !defined(MAD_USE_FUTEX)
+#   include <mutex>
+#   include <condition_variable>
+#endif
+
+namespace mad
+{
+
+//============================================================================//
+
+class parker
+{
+public:
+    enum { RUNNING = 0, PARKED = 1, NOTIFIED = 2 };
+
+public:
+    parker() : m_state(RUNNING) { }
+
+public:
+    //------------------------------------------------------------------------//
+    // owner: announce the intent to sleep
+    void prepare_park() { m_state.store(PARKED, std::memory_order_seq_cst); }
+    //------------------------------------------------------------------------//
+    // owner: back out of prepare_park(). Returns false if someone unparked
+    // us in between (and therefore already accounted for the wake-up)
+    bool cancel_park()
+    {
+        int _expected = PARKED;
+        if(m_state.compare_exchange_strong(_expected, RUNNING))
+            return true;
+        m_state.store(RUNNING, std::memory_order_relaxed);
+        return false;
+    }
+    //------------------------------------------------------------------------//
+    // owner: sleep until unpark()
+    void park()
+    {
+#if defined(MAD_USE_FUTEX)
+        while(m_state.load(std::memory_order_acquire) == PARKED)
+            futex_wait(&m_state, PARKED);
+#else
+        std::unique_lock<std::mutex> l(m_mutex);
+        while(m_state.load(std::memory_order_acquire) == PARKED)
+            m_cond.wait(l);
+#endif
+        m_state.store(RUNNING, std::memory_order_relaxed);
+    }
+    //------------------------------------------------------------------------//
+    // any thread: returns true if the owner was parked and is now woken
+    bool unpark()
+    {
+        int _expected = PARKED;
+        if(!m_state.compare_exchange_strong(_expected, NOTIFIED))
+            return false;
+#if defined(MAD_USE_FUTEX)
+        futex_wake(&m_state, 1);
+#else
+        std::lock_guard<std::mutex> l(m_mutex);
+        m_cond.notify_one();
+#endif
+        return true;
+    }
+    //------------------------------------------------------------------------//
+    bool is_parked() const
+    {
+        return m_state.load(std::memory_order_relaxed) == PARKED;
+    }
+
+private:
+    // keep neighbouring parkers of other workers off this cache line
+    char                        m_pad0[64];
+    std::atomic<int>            m_state;
+#if !defined(MAD_USE_FUTEX)
+    std::mutex                  m_mutex;
+    std::condition_variable     m_cond;
+#endif
+    char                        m_pad1[64];
+
+private:
+    parker(const parker&);
+    parker& operator=(const parker&);
+};
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
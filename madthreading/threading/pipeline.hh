@@ -0,0 +1,367 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#ifndef pipeline_hh_
+#define pipeline_hh_
+
+//----------------------------------------------------------------------------//
+// Streaming pipeline with bounded tokens (cf. TBB parallel_pipeline)
+//
+//      mad::pipeline<chunk_t> p(8);            // at most 8 chunks in flight
+//      p.add_source([&] (chunk_t& c) { return read(c); })  // false = end
+//       .add_filter(mad::filter_mode::parallel,        expand_pointing)
+//       .add_filter(mad::filter_mode::parallel,        weight_noise)
+//       .add_filter(mad::filter_mode::serial_in_order, accumulate_map);
+//      p.run();
+//
+// Every token owns one _Tp buffer, allocated once when the pipeline is
+// built and handed to the source again when the token has passed the last
+// filter, so memory is capped at "max_tokens" buffers and buffers (and the
+// capacity of any containers inside them) are reused.
+//
+// Filter modes:
+//  - parallel            : any number of tokens at the same time
+//  - serial_out_of_order : one token at a time, in any order
+//  - serial_in_order     : one token at a time, in the order the source
+//                          produced them
+// The source is serial. A token that cannot enter a serial filter is
+// parked there (no thread blocks) and is re-submitted by the token that
+// leaves the filter. Different tokens are in different filters at the
+// same time, so filter N+1 of chunk k overlaps filter N of chunk k+1.
+//
+// Each token has a persistent task that is re-submitted to the pool, so
+// run() does not create tasks. run() must not be called concurrently on
+// the same pipeline.
+//----------------------------------------------------------------------------//
+
+#include "madthreading/threading/thread_pool.hh"
+#include "madthreading/threading/fast_mutex.hh"
+#include "madthreading/threading/task/task.hh"
+#include "madthreading/threading/task/task_group.hh"
+#include "madthreading/threading/task/small_function.hh"
+
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <stdexcept>
+
+namespace mad
+{
+
+//============================================================================//
+
+enum class filter_mode
+{
+    serial_in_order,
+    serial_out_of_order,
+    parallel
+};
+
+//============================================================================//
+
+template <typename _Tp>
+class pipeline
+{
+public:
+    typedef pipeline<_Tp>                   this_type;
+    typedef _Tp                             value_type;
+    typedef std::size_t                     size_type;
+    typedef small_function<bool(_Tp&)>      source_type;
+    typedef small_function<void(_Tp&)>      function_type;
+
+protected:
+    //------------------------------------------------------------------------//
+    struct token_type
+    {
+        token_type() : seq(0), stage(0), work(nullptr) { }
+
+        _Tp         data;
+        size_type   seq;    // position in the stream
+        size_type   stage;  // 0 = source, i = filter i-1
+        vtask*      work;
+    };
+
+    //------------------------------------------------------------------------//
+    // re-submitted every time its token has to be scheduled. get() does not
+    // wait (vtask default)
+    class token_task : public vtask
+    {
+    public:
+        token_task(this_type* _pipe, token_type* _token)
+        : vtask(&_pipe->m_group), m_pipe(_pipe), m_token(_token)
+        { }
+
+        virtual void operator()() { m_pipe->process(m_token); }
+
+    private:
+        this_type*  m_pipe;
+        token_type* m_token;
+    };
+
+    //------------------------------------------------------------------------//
+    // ownership of a serial filter and the tokens parked in front of it
+    struct serial_state
+    {
+        serial_state() : busy(false), next_seq(0) { }
+
+        fast_mutex                  lock;
+        bool                        busy;
+        size_type                   next_seq;
+        // in order: slot seq % max_tokens, out of order: a stack
+        std::vector<token_type*>    waiting;
+    };
+
+    //------------------------------------------------------------------------//
+    struct filter_type
+    {
+        template <typename _Func>
+        filter_type(filter_mode _mode, _Func _func)
+        : mode(_mode), function(std::move(_func))
+        { }
+
+        filter_mode     mode;
+        function_type   function;
+        serial_state    state;
+    };
+
+public:
+    // "tp" defaults to the pool of the thread_manager
+    explicit pipeline(size_type _max_tokens, thread_pool* tp = nullptr)
+    : m_group(tp),
+      m_tokens((_max_tokens == 0) ? 1 : _max_tokens),
+      m_done(false),
+      m_next_seq(0),
+      m_nstarted(0)
+    {
+        for(auto& itr : m_tokens)
+            itr.work = new token_task(this, &itr); // deleted by m_group
+        m_source_state.waiting.reserve(m_tokens.size());
+    }
+
+    virtual ~pipeline() { }
+
+public:
+    // first stage: fills the buffer of a token, returns false at the end of
+    // the stream (the buffer is then discarded)
+    template <typename _Func>
+    this_type& add_source(_Func func)
+    {
+        m_source.reset(new source_type(std::move(func)));
+        return *this;
+    }
+
+    // following stages, in order of addition
+    template <typename _Func>
+    this_type& add_filter(filter_mode mode, _Func func)
+    {
+        m_filters.emplace_back(mode, std::move(func));
+        m_filters.back().state.waiting.reserve(m_tokens.size());
+        return *this;
+    }
+
+    // process the whole stream, returns when every token is done
+    void run();
+
+    size_type max_tokens() const { return m_tokens.size(); }
+    size_type num_filters() const { return m_filters.size(); }
+    // the buffer of token "i", e.g. to reserve memory up front
+    _Tp& buffer(size_type i) { return m_tokens.at(i).data; }
+
+protected:
+    void process(token_type*);
+    bool acquire(serial_state&, token_type*, bool _in_order);
+    token_type* release(serial_state&, bool _in_order);
+    void submit(token_type* _token) { m_group.pool()->add_task(_token->work); }
+
+protected:
+    task_group                      m_group;
+    std::vector<token_type>         m_tokens;
+    std::unique_ptr<source_type>    m_source;
+    std::deque<filter_type>         m_filters;
+    serial_state                    m_source_state;
+    // owned by the token holding the source
+    bool                            m_done;
+    size_type                       m_next_seq;
+    std::atomic<size_type>          m_nstarted;
+
+private:
+    // the tasks point back to the pipeline
+    pipeline(const pipeline&);
+    pipeline& operator=(const pipeline&);
+};
+
+//============================================================================//
+
+template <typename _Tp>
+void pipeline<_Tp>::run()
+{
+    if(!m_source)
+        throw std::runtime_error("mad::pipeline::run -- no source added");
+
+    m_done = false;
+    m_next_seq = 0;
+    m_nstarted.store(1);
+    m_source_state.busy = false;
+    m_source_state.waiting.clear();
+    for(auto& itr : m_filters)
+    {
+        itr.state.busy = false;
+        itr.state.next_seq = 0;
+        itr.state.waiting.clear();
+        if(itr.mode == filter_mode::serial_in_order)
+            itr.state.waiting.resize(m_tokens.size(), nullptr);
+    }
+
+    // more tokens are started by the source, one at a time
+    m_tokens.front().stage = 0;
+    submit(&m_tokens.front());
+    m_group.join();
+}
+
+//============================================================================//
+
+template <typename _Tp>
+void pipeline<_Tp>::process(token_type* _token)
+{
+    size_type _stage = _token->stage;
+    while(true)
+    {
+        //--------------------------------------------------------------------//
+        // source
+        if(_stage == 0)
+        {
+            _token->stage = 0;
+            if(!acquire(m_source_state, _token, false))
+                return;
+
+            bool _valid = !m_done && (*m_source)(_token->data);
+            if(_valid)
+                _token->seq = m_next_seq++;
+            else
+                m_done = true;
+
+            token_type* _next = release(m_source_state, false);
+            if(_next)
+                submit(_next);
+
+            // end of stream: the token retires
+            if(!_valid)
+                return;
+
+            // let one more token read while this one moves on
+            size_type _n = m_nstarted.load(std::memory_order_relaxed);
+            if(_n < m_tokens.size() &&
+               m_nstarted.compare_exchange_strong(_n, _n + 1))
+            {
+                m_tokens[_n].stage = 0;
+                submit(&m_tokens[_n]);
+            }
+            _stage = 1;
+        }
+
+        //--------------------------------------------------------------------//
+        // filters
+        for(; _stage <= m_filters.size(); ++_stage)
+        {
+            filter_type& _filter = m_filters[_stage - 1];
+            if(_filter.mode == filter_mode::parallel)
+            {
+                _filter.function(_token->data);
+                continue;
+            }
+
+            bool _in_order = (_filter.mode == filter_mode::serial_in_order);
+            // record where to resume before the token becomes visible
+            _token->stage = _stage;
+            if(!acquire(_filter.state, _token, _in_order))
+                return;
+
+            _filter.function(_token->data);
+
+            token_type* _next = release(_filter.state, _in_order);
+            if(_next)
+                submit(_next);
+        }
+
+        // the buffer goes back to the source
+        _stage = 0;
+    }
+}
+
+//============================================================================//
+
+template <typename _Tp>
+bool pipeline<_Tp>::acquire(serial_state& _state, token_type* _token,
+                            bool _in_order)
+{
+    fast_lock l(_state.lock);
+    if(!_state.busy && (!_in_order || _token->seq == _state.next_seq))
+    {
+        _state.busy = true;
+        return true;
+    }
+
+    // at most max_tokens consecutive sequence numbers are in flight
+    if(_in_order)
+        _state.waiting[_token->seq % m_tokens.size()] = _token;
+    else
+        _state.waiting.push_back(_token);
+    return false;
+}
+
+//============================================================================//
+
+template <typename _Tp>
+typename pipeline<_Tp>::token_type*
+pipeline<_Tp>::release(serial_state& _state, bool _in_order)
+{
+    fast_lock l(_state.lock);
+    _state.busy = false;
+
+    token_type* _next = nullptr;
+    if(_in_order)
+    {
+        ++_state.next_seq;
+        token_type*& _slot = _state.waiting[_state.next_seq % m_tokens.size()];
+        if(_slot && _slot->seq == _state.next_seq)
+        {
+            _next = _slot;
+            _slot = nullptr;
+        }
+    }
+    else if(!_state.waiting.empty())
+    {
+        _next = _state.waiting.back();
+        _state.waiting.pop_back();
+    }
+    return _next;
+}
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
@@ -0,0 +1,149 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef slot_array_hh_
+#define slot_array_hh_
+
+//----------------------------------------------------------------------------//
+// Array of per-worker slots that grows without moving its elements.
+//
+// The elements live in fixed-size segments reached through a directory of
+// fixed length, so growing never reallocates what other threads are
+// reading: the thread pool adds workers while the running ones index the
+// slots of each other without a lock.
+//
+//  - resize() (grow only) and clear() must not race with each other
+//  - operator[] may run concurrently with resize() for indices that were
+//    published before, e.g. through an atomic count with release/acquire
+//----------------------------------------------------------------------------//
+
+#include <atomic>
+#include <cstddef>
+#include <sstream>
+#include <stdexcept>
+
+namespace mad
+{
+
+//============================================================================//
+
+template <typename _Tp>
+class slot_array
+{
+public:
+    typedef _Tp             value_type;
+    typedef std::size_t     size_type;
+
+    static const size_type segment_bits = 6;
+    static const size_type segment_size = size_type(1) << segment_bits;
+    static const size_type max_segments = 1024;
+
+public:
+    slot_array() : m_size(0)
+    {
+        for(size_type i = 0; i < max_segments; ++i)
+            m_segments[i] = nullptr;
+    }
+
+    ~slot_array() { clear(); }
+
+public:
+    //------------------------------------------------------------------------//
+    size_type size() const { return m_size.load(std::memory_order_acquire); }
+    bool empty() const { return size() == 0; }
+    //------------------------------------------------------------------------//
+    _Tp& operator[](size_type _i)
+    {
+        return m_segments[_i >> segment_bits][_i & (segment_size - 1)];
+    }
+    const _Tp& operator[](size_type _i) const
+    {
+        return m_segments[_i >> segment_bits][_i & (segment_size - 1)];
+    }
+    //------------------------------------------------------------------------//
+    _Tp& at(size_type _i)
+    {
+        check(_i);
+        return (*this)[_i];
+    }
+    const _Tp& at(size_type _i) const
+    {
+        check(_i);
+        return (*this)[_i];
+    }
+    //------------------------------------------------------------------------//
+    // grow to at least "_n" value-initialized elements, never shrinks
+    void resize(size_type _n)
+    {
+        if(_n <= size())
+            return;
+        if(_n > max_segments * segment_size)
+        {
+            std::stringstream ss;
+            ss << "mad::slot_array::resize - " << _n << " elements exceed "
+               << "the maximum of " << max_segments * segment_size;
+            throw std::length_error(ss.str());
+        }
+        for(size_type i = 0; i < (_n + segment_size - 1) / segment_size; ++i)
+            if(!m_segments[i])
+                m_segments[i] = new _Tp[segment_size]();
+        m_size.store(_n, std::memory_order_release);
+    }
+    //------------------------------------------------------------------------//
+    // release the storage, no other thread may access the elements
+    void clear()
+    {
+        for(size_type i = 0; i < max_segments && m_segments[i]; ++i)
+        {
+            delete [] m_segments[i];
+            m_segments[i] = nullptr;
+        }
+        m_size.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    void check(size_type _i) const
+    {
+        if(_i >= size())
+        {
+            std::stringstream ss;
+            ss << "mad::slot_array::at - index " << _i << " out of range "
+               << "[0, " << size() << ")";
+            throw std::out_of_range(ss.str());
+        }
+    }
+
+private:
+    _Tp*                    m_segments[max_segments];
+    std::atomic<size_type>  m_size;
+
+private:
+    slot_array(const slot_array&);
+    slot_array& operator=(const slot_array&);
+};
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
@@ -0,0 +1,107 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#ifndef bulk_task_hh_
+#define bulk_task_hh_
+
+//----------------------------------------------------------------------------//
+// A whole index range submitted as a single task
+//
+//      mad::task_group tg;
+//      tm->run_bulk(&tg, [&] (ulong_type i) { out[i] = f(in[i]); }, 0, n);
+//      tg.join();
+//
+// The submitter enqueues the task once and wakes every idle worker. The
+// workers claim chunks of indices from a shared atomic counter (see
+// loop_schedule.hh), so the cost of submission does not depend on the size
+// of the range. Instead of scanning a shared list of bulk tasks on every
+// pick, a worker that starts executing the task queues it again while
+// there are unclaimed indices, up to one copy per worker. Every copy is
+// an ordinary queued task of the task_group, so join() returns once all
+// of them (and therefore every claimed chunk) are done.
+//----------------------------------------------------------------------------//
+
+#include "madthreading/threading/task/task.hh"
+#include "madthreading/threading/task/task_group.hh"
+#include "madthreading/threading/loop_schedule.hh"
+#include "madthreading/threading/thread_pool.hh"
+
+#include <atomic>
+#include <cstddef>
+
+namespace mad
+{
+
+//============================================================================//
+
+template <typename _Func, typename _Arg>
+class bulk_task : public vtask
+{
+public:
+    typedef std::size_t                     size_type;
+    typedef details::loop_counter<_Arg>     counter_type;
+
+public:
+    bulk_task(task_group* tg, thread_pool* tp, _Func _function,
+              _Arg _begin, _Arg _end, const loop_schedule& _schedule)
+    : vtask(tg),
+      m_pool(tp),
+      m_function(_function),
+      m_counter(_begin, _end, _schedule, std::max<size_type>(tp->size(), 1)),
+      m_copies(1),
+      m_max_copies((tp->is_alive()) ? std::max<size_type>(tp->size(), 1)
+                                    : 1)
+    { }
+
+    virtual ~bulk_task() { }
+
+public:
+    virtual void operator()()
+    {
+        // let one more worker in while there is something left to share
+        if(m_copies.load(std::memory_order_relaxed) < m_max_copies &&
+           !m_counter.exhausted() &&
+           m_copies.fetch_add(1, std::memory_order_relaxed) < m_max_copies)
+            m_pool->add_task(this);
+
+        // stop claiming once the group is canceled
+        _Arg _first, _last;
+        while(!m_group->is_canceled() && m_counter.claim(_first, _last))
+            for(_Arg i = _first; i < _last; ++i)
+                m_function(i);
+    }
+
+private:
+    thread_pool*            m_pool;
+    _Func                   m_function;
+    counter_type            m_counter;
+    std::atomic<size_type>  m_copies;
+    const size_type         m_max_copies;
+};
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
@@ -0,0 +1,597 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#ifndef future_hh_
+#define future_hh_
+
+//----------------------------------------------------------------------------//
+// Composable futures for thread_manager::exec
+//
+//      mad::future<double> a = tm->exec<double>(&tg, compute);
+//      mad::future<void>   b = a.then([] (const double& v) { store(v); });
+//      mad::future<std::vector<double>> c = mad::when_all(futures);
+//      mad::future<std::size_t> d = mad::when_any(futures);  // first index
+//      tg.join();
+//
+// A future is a pointer-sized handle to its task, which is owned (and
+// deleted) by the task_group like every other task: a future is valid as
+// long as the task_group of its task exists. Continuations are created in
+// the group of their parent and are counted by it from the start, so
+// task_group::join() waits for them too.
+//
+// Completion does not go through the task_group: the task that finishes
+// pops the continuations attached to it and pushes them directly onto the
+// pool (no join + resubmit round trip). Attaching to a task that already
+// completed schedules the continuation immediately.
+//
+// get()/wait() block, but run queued tasks of the pool while waiting.
+//
+// get() rethrows the exception of a task that threw, or task_canceled if
+// its group was canceled before it started. The exception is passed on:
+// a continuation of a failed future, and when_all/when_any over it, fail
+// with the same exception without calling the user function.
+//----------------------------------------------------------------------------//
+
+#include "madthreading/threading/thread_pool.hh"
+#include "madthreading/threading/task/task.hh"
+#include "madthreading/threading/task/task_group.hh"
+#include "madthreading/threading/task/small_function.hh"
+
+#include <atomic>
+#include <vector>
+#include <tuple>
+#include <thread>
+#include <utility>
+#include <stdexcept>
+#include <type_traits>
+
+namespace mad
+{
+
+template <typename _Tp> class future;
+
+namespace details
+{
+
+//============================================================================//
+/// \brief a task that can be waited on and continued
+class future_base : public vtask
+{
+public:
+    //------------------------------------------------------------------------//
+    // something to do when a task completes, intrusive list node
+    struct continuation
+    {
+        continuation() : next(nullptr) { }
+        virtual ~continuation() { }
+        virtual void ready() = 0;
+
+        continuation* next;
+    };
+
+public:
+    explicit future_base(task_group* tg)
+    : vtask(tg), m_continuations(nullptr), m_link(this)
+    { }
+
+    virtual ~future_base() { }
+
+public:
+    bool is_ready() const { return m_done.is_set(); }
+    // what the task threw (null if it did not or is not ready yet)
+    std::exception_ptr exception() const
+    {
+        return (is_ready()) ? m_done.exception() : std::exception_ptr();
+    }
+
+    // block until completion, executing queued tasks meanwhile
+    void wait() const
+    {
+        thread_pool* _pool = m_group->pool();
+        for(unsigned i = 0; !is_ready(); ++i)
+        {
+            if(_pool && _pool->run_pending_task())
+                i = 0;
+            else if(i < 64)
+                cpu_relax();
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    // run _cont->ready() when this task completes (now if it already has)
+    void attach(continuation* _cont)
+    {
+        continuation* _head = m_continuations.load(std::memory_order_acquire);
+        do
+        {
+            if(_head == closed())
+            {
+                _cont->ready();
+                return;
+            }
+            _cont->next = _head;
+        } while(!m_continuations.compare_exchange_weak(_head, _cont,
+                                                      std::memory_order_acq_rel,
+                                                      std::memory_order_acquire));
+    }
+
+    // "this" is a continuation of "_parent": count it in the group now and
+    // push it onto the pool when "_parent" completes
+    void continue_after(future_base* _parent)
+    {
+        defer();
+        _parent->attach(&m_link);
+    }
+
+    // canceled before it started: ready with task_canceled, the
+    // continuations are released (and skipped as well, being in the same
+    // group)
+    virtual void skip()
+    {
+        set_exception(std::make_exception_ptr(task_canceled()));
+    }
+
+    // threw (the exception also goes to the group): ready with the
+    // exception, the continuations are released and fail with it
+    virtual void set_exception(std::exception_ptr _ptr)
+    {
+        m_done.set_exception(_ptr);
+        release();
+    }
+
+    // count in the group before being submitted (see schedule)
+    void defer() { m_group->add_pending(); }
+
+    // submit a deferred task
+    void schedule()
+    {
+        task_group* _group = m_group;
+        _group->pool()->add_task(this);
+        // drop the count taken by defer() like thread_pool::run
+        _group->task_done();
+    }
+
+protected:
+    // result is stored: mark ready and release the continuations
+    void complete()
+    {
+        m_done.set();
+        release();
+    }
+
+    void rethrow() const { m_done.rethrow(); }
+
+private:
+    void release()
+    {
+        continuation* _head = m_continuations.exchange(closed(),
+                                                       std::memory_order_acq_rel);
+        while(_head)
+        {
+            // read "next" first, ready() may delete or reuse the node
+            continuation* _next = _head->next;
+            _head->ready();
+            _head = _next;
+        }
+    }
+
+private:
+    //------------------------------------------------------------------------//
+    // schedules the owning task, used when it continues a single parent
+    struct schedule_link : public continuation
+    {
+        explicit schedule_link(future_base* _task) : task(_task) { }
+        virtual void ready() { task->schedule(); }
+        future_base* task;
+    };
+
+    static continuation* closed()
+    {
+        static schedule_link _closed(nullptr);
+        return &_closed;
+    }
+
+private:
+    std::atomic<continuation*>  m_continuations;
+    schedule_link               m_link;
+    task_completion             m_done;
+};
+
+//============================================================================//
+/// \brief future_base with a result
+template <typename _Tp>
+class future_value : public future_base
+{
+public:
+    explicit future_value(task_group* tg) : future_base(tg), m_result() { }
+
+    virtual void* get() const
+    {
+        wait();
+        rethrow();
+        return (void*) &m_result;
+    }
+
+    const _Tp& result() const
+    {
+        wait();
+        rethrow();
+        return m_result;
+    }
+
+protected:
+    template <typename _Func>
+    void invoke(_Func& _func)
+    {
+        m_result = _func();
+        complete();
+    }
+
+protected:
+    _Tp m_result;
+};
+
+//----------------------------------------------------------------------------//
+
+template <>
+class future_value<void> : public future_base
+{
+public:
+    explicit future_value(task_group* tg) : future_base(tg) { }
+
+    virtual void* get() const
+    {
+        wait();
+        rethrow();
+        return nullptr;
+    }
+
+    void result() const
+    {
+        wait();
+        rethrow();
+    }
+
+protected:
+    template <typename _Func>
+    void invoke(_Func& _func)
+    {
+        _func();
+        complete();
+    }
+};
+
+//============================================================================//
+/// \brief the task behind a future: a callable without arguments
+template <typename _Tp>
+class future_task : public future_value<_Tp>
+{
+public:
+    typedef small_function<_Tp()> callable_type;
+
+public:
+    template <typename _Func>
+    future_task(task_group* tg, _Func _func)
+    : future_value<_Tp>(tg), m_function(std::move(_func))
+    { }
+
+    virtual void operator()() { this->invoke(m_function); }
+
+private:
+    callable_type   m_function;
+};
+
+//============================================================================//
+// a function with its arguments bound by value
+template <typename _Ret, typename _Func, typename... _Args>
+class bound_call
+{
+public:
+    bound_call(_Func _func, _Args... _args)
+    : m_function(std::move(_func)), m_args(std::move(_args)...)
+    { }
+
+    _Ret operator()()
+    {
+        return invoke(make_index_sequence<sizeof...(_Args)>());
+    }
+
+private:
+    template <std::size_t... _Idx>
+    _Ret invoke(index_sequence<_Idx...>)
+    {
+        return m_function(std::get<_Idx>(m_args)...);
+    }
+
+private:
+    _Func                   m_function;
+    std::tuple<_Args...>    m_args;
+};
+
+//============================================================================//
+// calls the user continuation with the value of the parent
+template <typename _Tp>
+struct then_call
+{
+    template <typename _Func>
+    static auto call(_Func& _func, const future_value<_Tp>* _parent)
+    -> decltype(_func(_parent->result()))
+    {
+        return _func(_parent->result());
+    }
+};
+
+template <>
+struct then_call<void>
+{
+    template <typename _Func>
+    static auto call(_Func& _func, const future_value<void>* _parent)
+    -> decltype(_func())
+    {
+        _parent->result();
+        return _func();
+    }
+};
+
+template <typename _Tp, typename _Func>
+struct then_result
+{
+    typedef decltype(then_call<_Tp>::call(std::declval<_Func&>(),
+                     std::declval<const future_value<_Tp>*>())) type;
+};
+
+//============================================================================//
+// when_all / when_any: a task continuing several parents, with one
+// continuation node per parent
+class multi_task : public future_value<std::size_t>
+{
+public:
+    multi_task(task_group* tg, std::size_t _n, bool _any)
+    : future_value<std::size_t>(tg),
+      m_links(_n), m_remaining(_any ? 1 : _n), m_any(_any)
+    {
+        for(std::size_t i = 0; i < _n; ++i)
+        {
+            m_links[i].owner = this;
+            m_links[i].index = i;
+        }
+    }
+
+    void attach_to(const std::vector<future_base*>& _parents)
+    {
+        defer();
+        if(_parents.empty())
+        {
+            schedule();
+            return;
+        }
+        for(std::size_t i = 0; i < _parents.size(); ++i)
+        {
+            m_links[i].parent = _parents[i];
+            _parents[i]->attach(&m_links[i]);
+        }
+    }
+
+    // result: index of the parent that completed first (any) or last (all).
+    // Fails with the exception of that parent (any) or of the first failed
+    // parent in order (all)
+    virtual void operator()()
+    {
+        if(m_exception)
+            set_exception(m_exception);
+        else
+            complete();
+    }
+
+private:
+    struct link : public continuation
+    {
+        link() : owner(nullptr), parent(nullptr), index(0) { }
+        virtual void ready() { owner->arrive(index); }
+        multi_task* owner;
+        future_base* parent;
+        std::size_t index;
+    };
+
+    void arrive(std::size_t _index)
+    {
+        // when_all: the last arrival schedules. when_any: the first one
+        // (1 -> 0) does, the following ones go below zero and do nothing
+        if(m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            m_result = _index;
+            // every parent is ready for when_all, only this one for when_any
+            if(m_any)
+                m_exception = m_links[_index].parent->exception();
+            for(std::size_t i = 0; i < m_links.size() && !m_any &&
+                !m_exception; ++i)
+                m_exception = m_links[i].parent->exception();
+            schedule();
+        }
+    }
+
+private:
+    std::vector<link>   m_links;
+    std::atomic<long>   m_remaining;
+    bool                m_any;
+    std::exception_ptr  m_exception;
+};
+
+//----------------------------------------------------------------------------//
+
+} // namespace details
+
+//============================================================================//
+/// \brief handle to the result of a task, see top of file
+template <typename _Tp>
+class future
+{
+public:
+    typedef _Tp                                 value_type;
+    typedef details::future_value<_Tp>          task_type;
+
+public:
+    future() : m_task(nullptr) { }
+    explicit future(task_type* _task) : m_task(_task) { }
+
+public:
+    bool valid() const { return m_task != nullptr; }
+    bool is_ready() const { check(); return m_task->is_ready(); }
+    void wait() const { check(); m_task->wait(); }
+
+    // blocks (while helping the pool) until the value is available
+    auto get() const -> decltype(std::declval<task_type>().result())
+    {
+        check();
+        return m_task->result();
+    }
+
+    // run "func(value)" (or "func()" for future<void>) on the pool once
+    // this future is ready
+    template <typename _Func>
+    future<typename details::then_result<_Tp, _Func>::type>
+    then(_Func func) const
+    {
+        typedef typename details::then_result<_Tp, _Func>::type result_type;
+        typedef details::future_task<result_type> child_type;
+
+        check();
+        const task_type* _parent = m_task;
+        child_type* _child = new child_type(m_task->group(),
+            [_parent, func] () mutable -> result_type
+            {
+                return details::then_call<_Tp>::call(func, _parent);
+            });
+        _child->continue_after(m_task);
+        return future<result_type>(_child);
+    }
+
+    task_type* task() const { return m_task; }
+    task_group* group() const { return (m_task) ? m_task->group() : nullptr; }
+
+private:
+    void check() const
+    {
+        if(!m_task)
+            throw std::runtime_error("mad::future -- no associated task");
+    }
+
+private:
+    task_type*  m_task;
+};
+
+//============================================================================//
+
+namespace details
+{
+
+template <typename _Tp>
+std::vector<future_base*> tasks_of(const std::vector<future<_Tp>>& _futures)
+{
+    std::vector<future_base*> _tasks;
+    _tasks.reserve(_futures.size());
+    for(const auto& itr : _futures)
+    {
+        if(!itr.valid())
+            throw std::runtime_error("mad::when_all/when_any -- invalid future");
+        _tasks.push_back(itr.task());
+    }
+    return _tasks;
+}
+
+// the group of the combining task. Every input must be in it: the task is
+// deleted with its group, a completing input of another group could
+// outlive it
+inline task_group* group_of(const std::vector<future_base*>& _tasks)
+{
+    if(_tasks.empty())
+        throw std::runtime_error("mad::when_all/when_any -- no futures");
+    task_group* _group = _tasks.front()->group();
+    for(const auto& itr : _tasks)
+        if(itr->group() != _group)
+            throw std::invalid_argument("mad::when_all/when_any -- the "
+                                        "futures are in different "
+                                        "task_groups");
+    return _group;
+}
+
+// values of all the futures, in order
+template <typename _Tp>
+struct collect
+{
+    typedef std::vector<_Tp> type;
+    static type get(const std::vector<future<_Tp>>& _futures)
+    {
+        type _values;
+        _values.reserve(_futures.size());
+        for(const auto& itr : _futures)
+            _values.push_back(itr.get());
+        return _values;
+    }
+};
+
+template <>
+struct collect<void>
+{
+    typedef void type;
+    static void get(const std::vector<future<void>>&) { }
+};
+
+} // namespace details
+
+//============================================================================//
+/// ready when every future is ready, holds their values in order. All the
+/// futures must belong to the same task_group (std::invalid_argument)
+template <typename _Tp>
+future<typename details::collect<_Tp>::type>
+when_all(const std::vector<future<_Tp>>& _futures)
+{
+    std::vector<details::future_base*> _tasks = details::tasks_of(_futures);
+    details::multi_task* _all = new details::multi_task(
+                details::group_of(_tasks), _tasks.size(), false);
+    _all->attach_to(_tasks);
+    return future<std::size_t>(_all).then(
+                [_futures] (const std::size_t&)
+                { return details::collect<_Tp>::get(_futures); });
+}
+
+//----------------------------------------------------------------------------//
+/// ready when any future is ready, holds the index of the first one. All
+/// the futures must belong to the same task_group (std::invalid_argument)
+template <typename _Tp>
+future<std::size_t> when_any(const std::vector<future<_Tp>>& _futures)
+{
+    std::vector<details::future_base*> _tasks = details::tasks_of(_futures);
+    details::multi_task* _any = new details::multi_task(
+                details::group_of(_tasks), _tasks.size(), true);
+    _any->attach_to(_tasks);
+    return future<std::size_t>(_any);
+}
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
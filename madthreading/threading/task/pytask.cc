@@ -30,9 +30,7 @@
 
 namespace py = pybind11;
 
-typedef mad::task_group::task_count_type task_count_type;
-
-typedef const task_count_type& (mad::task_group::*task_count_func_type)() const;
+typedef long (mad::task_group::*task_count_func_type)() const;
 typedef const mad::ulong_type& (mad::task_group::*id_func_type)() const;
 typedef void (std::promise<int>::*int_promise_func_type)(const int&);
 typedef void (mad::task_group::*join_void_func)();
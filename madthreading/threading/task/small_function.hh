@@ -0,0 +1,135 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#ifndef small_function_hh_
+#define small_function_hh_
+
+//----------------------------------------------------------------------------//
+// Type-erased callable with inline (small-buffer) storage.
+//
+// Unlike std::function, a callable that fits in "_Size" bytes is constructed
+// directly inside the object, so wrapping a lambda with a few captures does
+// not allocate. Larger callables fall back to the heap. The wrapper is
+// neither copyable nor movable, which is all a task needs and keeps it
+// free of the copy/move machinery.
+//----------------------------------------------------------------------------//
+
+#include <new>
+#include <utility>
+#include <cstddef>
+#include <type_traits>
+
+namespace mad
+{
+
+//============================================================================//
+
+template <typename _Sig, std::size_t _Size = 48>
+class small_function;
+
+//============================================================================//
+
+template <typename _Ret, typename... _Args, std::size_t _Size>
+class small_function<_Ret(_Args...), _Size>
+{
+public:
+    typedef _Ret    result_type;
+
+    static const std::size_t buffer_size = _Size;
+
+public:
+    //------------------------------------------------------------------------//
+    template <typename _Func>
+    small_function(_Func _func)
+    {
+        typedef typename std::decay<_Func>::type _Fp;
+        typedef std::integral_constant<bool,
+                sizeof(_Fp) <= _Size &&
+                std::alignment_of<_Fp>::value <=
+                std::alignment_of<storage_type>::value> fits_inline;
+
+        construct<_Fp>(std::move(_func), fits_inline());
+        m_invoke = &invoke<_Fp>;
+    }
+    //------------------------------------------------------------------------//
+    ~small_function() { m_destroy(m_callable); }
+    //------------------------------------------------------------------------//
+    _Ret operator()(_Args... _args) const
+    {
+        return m_invoke(m_callable, std::forward<_Args>(_args)...);
+    }
+    //------------------------------------------------------------------------//
+    // true if the callable did not fit the inline buffer
+    bool is_heap_allocated() const
+    {
+        return m_callable != static_cast<const void*>(&m_storage);
+    }
+
+private:
+    template <typename _Fp>
+    void construct(_Fp&& _func, std::true_type)
+    {
+        m_callable = new (&m_storage) _Fp(std::move(_func));
+        m_destroy = &destroy_inline<_Fp>;
+    }
+
+    template <typename _Fp>
+    void construct(_Fp&& _func, std::false_type)
+    {
+        m_callable = new _Fp(std::move(_func));
+        m_destroy = &destroy_heap<_Fp>;
+    }
+
+    template <typename _Fp>
+    static _Ret invoke(void* _ptr, _Args... _args)
+    {
+        return (*static_cast<_Fp*>(_ptr))(std::forward<_Args>(_args)...);
+    }
+
+    template <typename _Fp>
+    static void destroy_inline(void* _ptr) { static_cast<_Fp*>(_ptr)->~_Fp(); }
+
+    template <typename _Fp>
+    static void destroy_heap(void* _ptr) { delete static_cast<_Fp*>(_ptr); }
+
+private:
+    typedef typename std::aligned_storage<_Size>::type storage_type;
+    typedef _Ret (*invoke_type)(void*, _Args...);
+    typedef void (*destroy_type)(void*);
+
+    storage_type    m_storage;
+    void*           m_callable;
+    invoke_type     m_invoke;
+    destroy_type    m_destroy;
+
+private:
+    small_function(const small_function&);
+    small_function& operator=(const small_function&);
+};
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
@@ -32,6 +32,7 @@
 #include "madthreading/threading/task/task.hh"
 #include "madthreading/threading/task/task_group.hh"
 #include "madthreading/threading/thread_manager.hh"
+#include "madthreading/threading/futex.hh"
 #include <cassert>
 
 namespace mad
@@ -56,4 +57,67 @@ void vtask::_check_group()
 
 //============================================================================//
 
+namespace details
+{
+
+//============================================================================//
+
+void task_completion::wait(task_group* tg) const
+{
+    thread_pool* _pool = (tg) ? tg->pool() : nullptr;
+    // a worker never sleeps here, same as task_group::wait
+    bool _is_worker = _pool && _pool->get_this_thread_index() >= 0;
+
+    for(size_t _spin = 0; !is_set(); )
+    {
+        // help: execute queued tasks while waiting
+        if(_pool && _pool->is_alive() && _pool->run_pending_task(tg))
+        {
+            _spin = 0;
+            continue;
+        }
+
+        if(++_spin < 64)
+        {
+            cpu_relax();
+            continue;
+        }
+
+        if(_is_worker)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+#if defined(MAD_USE_FUTEX)
+        // flag the sleep so set() issues the wake-up, then re-check
+        int _state = m_state.fetch_or(WAITING, std::memory_order_acq_rel);
+        if(!(_state & DONE))
+            futex_wait(&m_state, _state | WAITING);
+#else
+        std::this_thread::yield();
+#endif
+        _spin = 0;
+    }
+}
+
+//============================================================================//
+
+// the waiter can return (and the task be deleted) between the exchange in
+// set() and this call: a futex wake-up on a stale address wakes nobody or,
+// if the memory was reused for another futex word, causes a spurious
+// wake-up, which every futex_wait loop tolerates
+void task_completion::wake() const
+{
+#if defined(MAD_USE_FUTEX)
+    futex_wake(&m_state);
+#endif
+}
+
+//============================================================================//
+
+} // namespace details
+
+//============================================================================//
+
 } // namespace mad
@@ -35,6 +35,8 @@
 #include "madthreading/threading/threading.hh"
 #include "madthreading/threading/auto_lock.hh"
 #include "madthreading/allocator/allocator.hh"
+#include "madthreading/allocator/freelist.hh"
+#include "madthreading/threading/task/small_function.hh"
 
 #include <functional>
 #include <utility>
@@ -42,8 +44,9 @@
 #include <cstddef>
 #include <string>
 #include <array>
-#include <future>
+#include <atomic>
 #include <thread>
+#include <exception>
 
 namespace mad  { class task_group; }
 
@@ -52,7 +55,9 @@ namespace mad
 
 //============================================================================//
 /// \brief vtask is the abstract class stored in thread_pool
-class vtask : public mad::Allocator
+/// memory comes from a thread-local free-list so creating and deleting
+/// tasks at a high rate does not touch the global heap
+class vtask : public mad::FreeListAllocator_tl
 {
 public:
     typedef vtask*          iterator;
@@ -72,6 +77,13 @@ public:
 
 public:
     virtual void operator()() = 0;
+    // called instead of operator() when the group was canceled before the
+    // task started: release whoever waits on the result
+    virtual void skip() { }
+    // operator() threw: keep the exception for get() and release waiters
+    virtual void set_exception(std::exception_ptr) { skip(); }
+    // block until executed (or skipped), unlike get() does not rethrow
+    virtual void wait() const { }
 
     virtual void* get() const { return nullptr; }
     virtual void set_result(void*)
@@ -95,86 +107,105 @@ protected:
 
 //============================================================================//
 
-/// \brief The task class is supplied to thread_pool.
-template <typename _Ret, typename... _Args>
-class task : public vtask
+namespace details
+{
+
+//----------------------------------------------------------------------------//
+// compile-time list of tuple indices (std::index_sequence is C++14)
+template <std::size_t... _Idx>
+struct index_sequence { };
+
+template <std::size_t _N, std::size_t... _Idx>
+struct make_index_sequence : make_index_sequence<_N-1, _N-1, _Idx...> { };
+
+template <std::size_t... _Idx>
+struct make_index_sequence<0, _Idx...> : index_sequence<_Idx...> { };
+
+//----------------------------------------------------------------------------//
+// completion flag, replaces the std::future (and its shared state) that
+// was previously allocated for every task. Like the std::future it keeps
+// the exception thrown by the task, get() rethrows it
+class task_completion
 {
 public:
-    typedef _Ret                            result_type;
-    typedef std::function<_Ret(_Args...)>   function_type;
-    typedef std::future<result_type>        future_type;
-    typedef std::packaged_task<_Ret()>      packaged_task_type;
+    // state bits: executed, someone sleeps on the flag
+    enum { DONE = 1, WAITING = 2 };
 
 public:
-    // pass a free function pointer
-    task(task_group* tg, function_type fn_ptr, _Args... args)
-    : vtask(tg),
-      m_future_retrieved(false),
-      m_function(fn_ptr),
-      m_ptask(std::bind(m_function, std::forward<_Args>(std::move(args))...)),
-      m_result(new result_type())
-    { }
+    task_completion() : m_state(0) { }
 
-    virtual ~task() { delete m_result; }
+    // a re-executed task: clear DONE, keep WAITING for a sleeping waiter
+    void reset()
+    {
+        if(m_state.load(std::memory_order_relaxed) & DONE)
+            m_state.fetch_and(~DONE, std::memory_order_relaxed);
+        m_exception = std::exception_ptr();
+    }
 
-    template <typename... _Tp>
-    void set(_Tp... args)
+    void set()
     {
-        m_ptask = packaged_task_type(
-                      std::bind(m_function,
-                                std::forward<_Args>(std::move(args))...));
+        if(m_state.exchange(DONE, std::memory_order_acq_rel) & WAITING)
+            wake();
     }
 
-    virtual void set_result(void* ptr) { *m_result = *(result_type*) ptr; }
-    virtual void* get() const
+    void set_exception(std::exception_ptr _ptr)
     {
-        if(!m_future_retrieved)
-            *m_result = m_future.get();
-        m_future_retrieved = true;
-        return (void*) m_result;
+        m_exception = _ptr;
+        set();
     }
 
-    inline result_type get_result() const
+    bool is_set() const
     {
-        return *((result_type*)(this->get()));
+        return m_state.load(std::memory_order_acquire) & DONE;
     }
 
-public:
-    virtual void operator()()
+    // block like std::future::get() until the task has been executed:
+    // runs queued tasks of the group's pool meanwhile and, unless called
+    // from a worker, sleeps when there is nothing to run
+    void wait(task_group* tg) const;
+
+    void rethrow() const
     {
-        m_future = m_ptask.get_future();
-        m_ptask();
-        m_future_retrieved = false;
+        if(m_exception)
+            std::rethrow_exception(m_exception);
     }
 
+    std::exception_ptr exception() const { return m_exception; }
+
+private:
+    void wake() const;
+
 private:
-    mutable bool                    m_future_retrieved;
-    function_type                   m_function;
-    packaged_task_type              m_ptask;
-    mutable future_type             m_future;
-    result_type*                    m_result;
+    mutable std::atomic<int>    m_state;
+    std::exception_ptr          m_exception;
 };
 
+//----------------------------------------------------------------------------//
+
+} // namespace details
+
 //============================================================================//
 
 /// \brief The task class is supplied to thread_pool.
-template <typename... _Args>
-class task<void, _Args...> : public vtask
+/// The callable is stored in-place (small_function) and the arguments in a
+/// tuple, so constructing a task does not allocate beyond the task itself
+template <typename _Ret, typename... _Args>
+class task : public vtask
 {
 public:
-    typedef void                            _Ret;
     typedef _Ret                            result_type;
     typedef std::function<_Ret(_Args...)>   function_type;
-    typedef std::future<result_type>        future_type;
-    typedef std::packaged_task<_Ret()>      packaged_task_type;
+    typedef small_function<_Ret(_Args...)>  callable_type;
+    typedef std::tuple<_Args...>            argument_type;
 
 public:
-    // pass a free function pointer
-    task(task_group* tg, function_type fn_ptr, _Args... args)
+    // pass a free function pointer, lambda or any other callable
+    template <typename _Func>
+    task(task_group* tg, _Func fn_ptr, _Args... args)
     : vtask(tg),
-      m_future_retrieved(false),
-      m_function(fn_ptr),
-      m_ptask(std::bind(m_function, std::forward<_Args>(std::move(args))...))
+      m_function(std::move(fn_ptr)),
+      m_args(std::move(args)...),
+      m_result()
     { }
 
     virtual ~task() { }
@@ -182,83 +213,122 @@ public:
     template <typename... _Tp>
     void set(_Tp... args)
     {
-        m_ptask = packaged_task_type(
-                      std::bind(m_function,
-                                std::forward<_Args>(std::move(args))...));
-
+        m_args = argument_type(std::move(args)...);
     }
 
+    virtual void set_result(void* ptr) { m_result = *(result_type*) ptr; }
     virtual void* get() const
     {
-        if(!m_future_retrieved)
-            m_future.get();
-        m_future_retrieved = true;
-        return nullptr;
+        m_done.wait(m_group);
+        m_done.rethrow();
+        return (void*) &m_result;
+    }
+
+    inline result_type get_result() const
+    {
+        return *((result_type*)(this->get()));
     }
 
+    bool is_done() const { return m_done.is_set(); }
+
 public:
+    virtual void skip() { m_done.set(); }
+    virtual void set_exception(std::exception_ptr _ptr)
+    {
+        m_done.set_exception(_ptr);
+    }
+    virtual void wait() const { m_done.wait(m_group); }
+
     virtual void operator()()
     {
-        m_future = m_ptask.get_future();
-        m_ptask();
-        m_future_retrieved = false;
+        m_done.reset();
+        m_result = invoke(details::make_index_sequence<sizeof...(_Args)>());
+        m_done.set();
+    }
+
+private:
+    template <std::size_t... _Idx>
+    _Ret invoke(details::index_sequence<_Idx...>)
+    {
+        return m_function(std::get<_Idx>(m_args)...);
     }
 
 private:
-    mutable bool                    m_future_retrieved;
-    function_type                   m_function;
-    packaged_task_type              m_ptask;
-    mutable future_type             m_future;
+    callable_type                   m_function;
+    argument_type                   m_args;
+    result_type                     m_result;
+    details::task_completion        m_done;
 };
 
 //============================================================================//
 
 /// \brief The task class is supplied to thread_pool.
-template <>
-class task<void> : public vtask
+template <typename... _Args>
+class task<void, _Args...> : public vtask
 {
 public:
     typedef void                            _Ret;
     typedef _Ret                            result_type;
-    typedef std::function<result_type()>    function_type;
-    typedef std::future<result_type>        future_type;
-    typedef std::packaged_task<_Ret()>      packaged_task_type;
+    typedef std::function<_Ret(_Args...)>   function_type;
+    typedef small_function<_Ret(_Args...)>  callable_type;
+    typedef std::tuple<_Args...>            argument_type;
 
 public:
-    // pass a free function pointer
-    task(task_group* tg, function_type fn_ptr)
+    // pass a free function pointer, lambda or any other callable
+    template <typename _Func>
+    task(task_group* tg, _Func fn_ptr, _Args... args)
     : vtask(tg),
-      m_future_retrieved(false),
-      m_ptask(fn_ptr)
+      m_function(std::move(fn_ptr)),
+      m_args(std::move(args)...)
     { }
 
     virtual ~task() { }
 
+    template <typename... _Tp>
+    void set(_Tp... args)
+    {
+        m_args = argument_type(std::move(args)...);
+    }
+
     virtual void* get() const
     {
-        if(!m_future_retrieved)
-            m_future.get();
-        m_future_retrieved = true;
+        m_done.wait(m_group);
+        m_done.rethrow();
         return nullptr;
     }
 
+    bool is_done() const { return m_done.is_set(); }
+
 public:
+    virtual void skip() { m_done.set(); }
+    virtual void set_exception(std::exception_ptr _ptr)
+    {
+        m_done.set_exception(_ptr);
+    }
+    virtual void wait() const { m_done.wait(m_group); }
+
     virtual void operator()()
     {
-        m_future = m_ptask.get_future();
-        m_ptask();
-        m_future_retrieved = false;
+        m_done.reset();
+        invoke(details::make_index_sequence<sizeof...(_Args)>());
+        m_done.set();
+    }
+
+private:
+    template <std::size_t... _Idx>
+    void invoke(details::index_sequence<_Idx...>)
+    {
+        m_function(std::get<_Idx>(m_args)...);
     }
 
 private:
-    mutable bool                    m_future_retrieved;
-    packaged_task_type              m_ptask;
-    mutable future_type             m_future;
+    callable_type                   m_function;
+    argument_type                   m_args;
+    details::task_completion        m_done;
 };
 
 //============================================================================//
 
-
 } // namespace mad
 
 
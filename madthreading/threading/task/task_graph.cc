@@ -0,0 +1,136 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#include "madthreading/threading/task/task_graph.hh"
+#include "madthreading/threading/thread_pool.hh"
+
+#include <sstream>
+#include <stdexcept>
+
+namespace mad
+{
+
+//============================================================================//
+
+task_graph::task_graph(thread_pool* tp)
+: m_group(tp),
+  m_dirty(true)
+{ }
+
+//============================================================================//
+
+void task_graph::precede(const node& _before, const node& _after)
+{
+    if(_before.empty() || _after.empty())
+        throw std::runtime_error("task_graph::precede -- empty node handle");
+
+    _before.m_node->successors.push_back(_after.m_node);
+    ++_after.m_node->in_degree;
+    m_dirty = true;
+}
+
+//============================================================================//
+
+void task_graph::prepare()
+{
+    m_sources.clear();
+    for(auto& itr : m_nodes)
+        if(itr.in_degree == 0)
+            m_sources.push_back(&itr);
+
+    // Kahn's algorithm: every node must become ready exactly once
+    for(auto& itr : m_nodes)
+        itr.pending.store(itr.in_degree, std::memory_order_relaxed);
+    std::vector<node_type*> _ready(m_sources);
+    size_type _nvisited = 0;
+    while(!_ready.empty())
+    {
+        node_type* _node = _ready.back();
+        _ready.pop_back();
+        ++_nvisited;
+        for(auto& itr : _node->successors)
+            if(--itr->pending == 0)
+                _ready.push_back(itr);
+    }
+
+    if(_nvisited != m_nodes.size())
+    {
+        std::stringstream ss;
+        ss << "task_graph: " << (m_nodes.size() - _nvisited) << " of "
+           << m_nodes.size() << " nodes are part of a dependency cycle";
+        throw std::runtime_error(ss.str());
+    }
+
+    m_dirty = false;
+}
+
+//============================================================================//
+
+void task_graph::run()
+{
+    if(m_nodes.empty())
+        return;
+
+    if(m_dirty)
+        prepare();
+
+    for(auto& itr : m_nodes)
+        itr.pending.store(itr.in_degree, std::memory_order_relaxed);
+
+    // the pushes publish the counters to the workers
+    thread_pool* _pool = m_group.pool();
+    for(auto& itr : m_sources)
+        _pool->add_task(itr->work);
+
+    m_group.join();
+}
+
+//============================================================================//
+
+void task_graph::execute(node_type* _node)
+{
+    thread_pool* _pool = m_group.pool();
+    while(_node)
+    {
+        _node->function();
+
+        // release our writes to the successors, the last predecessor to
+        // finish acquires the writes of all the others
+        node_type* _next = nullptr;
+        for(auto& itr : _node->successors)
+        {
+            if(itr->pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                continue;
+            // keep one ready successor for this worker, hand out the rest
+            if(_next)
+                _pool->add_task(_next->work);
+            _next = itr;
+        }
+        _node = _next;
+    }
+}
+
+//============================================================================//
+
+} // namespace mad
@@ -0,0 +1,170 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#ifndef task_graph_hh_
+#define task_graph_hh_
+
+//----------------------------------------------------------------------------//
+// Dependency graph (DAG) of tasks
+//
+//      mad::task_graph g;
+//      auto a = g.emplace([] () { slerp(); });
+//      auto b = g.emplace([] () { rotate(); });
+//      auto c = g.emplace([] () { accumulate(); });
+//      g.precede(a, b);                // a before b
+//      g.precede(b, c);
+//      for(...) g.run();               // blocks until every node ran
+//
+// Every node keeps an atomic count of unfinished predecessors. When a node
+// finishes it decrements the count of its successors: the successors that
+// become ready are pushed onto the pool directly and the last one is run
+// in place by the same worker (continuation), so there is no barrier
+// between "stages" and no task is created while running the graph.
+//
+// The nodes, their tasks and the edge lists are allocated when the graph
+// is built. run() only resets the counters, so a graph can be executed any
+// number of times without allocating. run() must not be called
+// concurrently on the same graph.
+//----------------------------------------------------------------------------//
+
+#include "madthreading/threading/task/task.hh"
+#include "madthreading/threading/task/task_group.hh"
+
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+namespace mad
+{
+
+class thread_pool;
+
+//============================================================================//
+
+class task_graph
+{
+public:
+    typedef task_graph                      this_type;
+    typedef std::size_t                     size_type;
+    typedef small_function<void()>          function_type;
+
+protected:
+    struct node_type;
+
+    //------------------------------------------------------------------------//
+    // the task of a node, submitted again on every run(). get() does not
+    // wait: a node executed as a continuation never runs its own task
+    class node_task : public vtask
+    {
+    public:
+        node_task(task_graph* _graph, node_type* _node)
+        : vtask(&_graph->m_group), m_graph(_graph), m_node(_node)
+        { }
+
+        virtual void operator()() { m_graph->execute(m_node); }
+
+    private:
+        task_graph* m_graph;
+        node_type*  m_node;
+    };
+
+    //------------------------------------------------------------------------//
+    struct node_type
+    {
+        template <typename _Func>
+        node_type(task_graph* _graph, _Func _func)
+        : function(std::move(_func)), in_degree(0), pending(0),
+          work(new node_task(_graph, this)) // deleted by the task_group
+        { }
+
+        function_type           function;
+        std::vector<node_type*> successors;
+        long                    in_degree;
+        std::atomic<long>       pending;
+        vtask*                  work;
+    };
+
+public:
+    //------------------------------------------------------------------------//
+    // handle to a node of the graph
+    class node
+    {
+    public:
+        node() : m_node(nullptr) { }
+        bool empty() const { return m_node == nullptr; }
+
+    private:
+        friend class task_graph;
+        explicit node(node_type* _node) : m_node(_node) { }
+        node_type* m_node;
+    };
+
+public:
+    task_graph(thread_pool* tp = nullptr);
+    virtual ~task_graph() { }
+
+public:
+    // add a node executing "func"
+    template <typename _Func>
+    node emplace(_Func func)
+    {
+        m_nodes.emplace_back(this, std::move(func));
+        m_dirty = true;
+        return node(&m_nodes.back());
+    }
+
+    // "_before" must finish before "_after" starts
+    void precede(const node& _before, const node& _after);
+
+    // execute every node once, respecting the dependencies, and wait
+    void run();
+
+    size_type size() const { return m_nodes.size(); }
+    bool empty() const { return m_nodes.empty(); }
+    thread_pool* pool() const { return m_group.pool(); }
+
+protected:
+    // body of the task of a node
+    void execute(node_type*);
+    // cache the nodes without predecessors and check for cycles
+    void prepare();
+
+protected:
+    task_group              m_group;
+    std::deque<node_type>   m_nodes;
+    std::vector<node_type*> m_sources;
+    bool                    m_dirty;
+
+private:
+    // the tasks point back to the graph
+    task_graph(const task_graph&);
+    task_graph& operator=(const task_graph&);
+};
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
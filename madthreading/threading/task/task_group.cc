@@ -38,8 +38,8 @@ task_group::task_group(thread_pool* tp)
 : m_task_count(0),
   m_id(m_group_count++),
   m_pool(tp),
-  m_save_lock(),
-  m_join_lock()
+  m_canceled(false),
+  m_save_lock()
 {
     if(!m_pool)
         m_pool = mad::thread_manager::instance()->thread_pool();
@@ -49,6 +49,14 @@ task_group::task_group(thread_pool* tp)
 
 task_group::~task_group()
 {
+    // e.g. an exception thrown by the submitting thread skipped join(): the
+    // tasks must not be deleted (or outlive the data they point to) while
+    // they are still queued or running. A set join_waiting alone means the
+    // last task may still be notifying (see task_done)
+    if(m_task_count.load(std::memory_order_acquire) != 0 && m_pool &&
+       m_pool->is_alive())
+        wait();
+
     for(auto& itr : m_task_list)
         delete itr;
 }
@@ -59,51 +67,127 @@ void task_group::join()
 {
 #ifdef VERBOSE_THREAD_POOL
     std::cout << "Joining " << pending() << " tasks..." << std::endl;
-    std::cout << std::boolalpha << "is alive: " << is_alive_flag << std::endl;
+    std::cout << std::boolalpha << "is alive: " << m_pool->is_alive() << std::endl;
 #endif
 
-    // return if thread pool isn't built
+    // return if thread pool isn't built, the tasks were executed inline
     if(!m_pool->is_alive())
+    {
+        rethrow_exception();
         return;
+    }
+
+    wait();
 
-    while (m_pool->state() != state::STOPPED)
+    for(auto& itr : m_task_list)
+        itr->wait();
+
+    if(pending() > 0)
     {
-        m_join_lock.lock();
+        long_type ntask = pending();
+        std::stringstream ss;
+        ss << "\bError! Join operation failure! " << ntask << " tasks still "
+           << "are running!" << std::endl;
+        throw std::runtime_error(ss.str().c_str());
+    }
+
+    rethrow_exception();
+}
 
-        while(pending() > 0 && m_pool->state() != state::STOPPED)
+//============================================================================//
+
+void task_group::wait()
+{
+    // called from a task (nested parallelism): never block the worker, if
+    // every worker blocked in a join, queued tasks would never run
+    bool _is_worker = (m_pool->get_this_thread_index() >= 0);
+
+    for(size_type _spin = 0; ; )
+    {
+        long_type _count = m_task_count.load(std::memory_order_acquire);
+        if(_count == 0)
+            break;
+
+        // nothing pending but the task that finished last has not cleared
+        // join_waiting yet: it may still be notifying m_join_event, so the
+        // group must not be destroyed (see task_done)
+        if(_count == join_waiting)
         {
-            #if defined(DEBUG)
-            long_type ntasks = pending();
-            if(false)
-            {
-                static mad::mutex _mutex;
-                mad::auto_lock l(_mutex);
-                tmcout << "# of tasks: " << ntasks << std::endl;
-            }
-            #endif
-            // Wait until signaled that a task has been competed
-            // Unlock mutex while wait, then lock it back when signaled
-            m_join_cond.wait(m_join_lock);
+            std::this_thread::yield();
+            continue;
         }
 
-        // if pending is not greater than zero, we are joined
-        if(!(0 < pending()))
+        if(m_pool->state() == state::STOPPED)
             break;
+
+        // help: execute queued tasks while waiting
+        if(m_pool->run_pending_task(this))
+        {
+            _spin = 0;
+            continue;
+        }
+
+        if(_is_worker)
+        {
+            if(++_spin < 64)
+                cpu_relax();
+            else
+                std::this_thread::yield();
+            continue;
+        }
+
+        #if defined(DEBUG)
+        long_type ntasks = pending();
+        if(false)
+        {
+            static mad::mutex _mutex;
+            mad::auto_lock l(_mutex);
+            tmcout << "# of tasks: " << ntasks << std::endl;
+        }
+        #endif
+        // register as a waiter and flag the count, the task that brings it
+        // to zero wakes us. Re-check so a completion in between is not missed
+        Event_t::key_type _key = m_join_event.prepare_wait();
+        _count = m_task_count.fetch_or(join_waiting, std::memory_order_acq_rel);
+        if((_count & ~join_waiting) == 0 ||
+           m_pool->state() == state::STOPPED)
+        {
+            m_join_event.cancel_wait();
+            // flagged a zero count: no task will clear it, take it back
+            // (unless tasks were added meanwhile, then we wait for them)
+            if(_count == 0)
+            {
+                long_type _flag = join_waiting;
+                m_task_count.compare_exchange_strong(_flag, 0,
+                                                     std::memory_order_relaxed);
+            }
+            continue;
+        }
+        // Wait until signaled that the last task has been competed
+        m_join_event.wait(_key);
     }
+}
 
-    for(auto& itr : m_task_list)
-        itr->get();
+//============================================================================//
+
+void task_group::set_exception(std::exception_ptr _ptr)
+{
+    mad::fast_lock l(m_save_lock);
+    if(!m_exception)
+        m_exception = _ptr;
+}
+
+//============================================================================//
 
-    if(m_task_count > 0)
+void task_group::rethrow_exception()
+{
+    std::exception_ptr _ptr;
     {
-        long_type ntask = m_task_count;
-        std::stringstream ss;
-        ss << "\bError! Join operation failure! " << ntask << " tasks still "
-           << "are running!" << std::endl;
-        throw std::runtime_error(ss.str().c_str());
+        mad::fast_lock l(m_save_lock);
+        std::swap(_ptr, m_exception);
     }
-
-    m_join_lock.unlock();
+    if(_ptr)
+        std::rethrow_exception(_ptr);
 }
 
 //============================================================================//
@@ -13,8 +13,8 @@
 #define task_group_hh_
 
 #include "madthreading/threading/threading.hh"
-#include "madthreading/threading/mutex.hh"
-#include "madthreading/threading/condition.hh"
+#include "madthreading/threading/fast_mutex.hh"
+#include "madthreading/threading/eventcount.hh"
 #include "madthreading/allocator/allocator.hh"
 #include "madthreading/atomics/atomic.hh"
 #include "madthreading/types.hh"
@@ -26,6 +26,9 @@
 #include <map>
 #include <queue>
 #include <stack>
+#include <atomic>
+#include <exception>
+#include <stdexcept>
 
 //----------------------------------------------------------------------------//
 
@@ -34,6 +37,41 @@ namespace mad
 
 class thread_pool;
 
+//----------------------------------------------------------------------------//
+// what a future of a task that was skipped by cancellation holds
+//----------------------------------------------------------------------------//
+
+class task_canceled : public std::runtime_error
+{
+public:
+    task_canceled() : std::runtime_error("mad -- task was canceled") { }
+};
+
+//----------------------------------------------------------------------------//
+// read-only view of the cancellation state of a task_group. Cheap to copy,
+// capture it in the tasks that should stop early:
+//      cancellation_token _token = tg.token();
+//      tm->exec(&tg, [=] () { while(!_token.is_canceled()) { ... } });
+// Only valid while the task_group exists
+//----------------------------------------------------------------------------//
+
+class cancellation_token
+{
+public:
+    cancellation_token() : m_flag(nullptr) { }
+    explicit cancellation_token(const std::atomic<bool>* _flag)
+    : m_flag(_flag)
+    { }
+
+    bool is_canceled() const
+    {
+        return m_flag && m_flag->load(std::memory_order_acquire);
+    }
+
+private:
+    const std::atomic<bool>* m_flag;
+};
+
 //----------------------------------------------------------------------------//
 
 class task_group
@@ -45,10 +83,10 @@ public:
     typedef mad::vtask                                      task_type;
     typedef std::size_t                                     size_type;
     typedef std::deque<task_type*>                          TaskContainer_t;
-    typedef mad::mutex                                      Lock_t;
-    typedef long_ts                                         task_count_type;
+    typedef mad::fast_mutex                                 Lock_t;
+    typedef std::atomic<long>                               task_count_type;
     typedef volatile int                                    pool_state_type;
-    typedef mad::condition                                  Condition_t;
+    typedef mad::eventcount                                 Event_t;
     typedef TaskContainer_t::iterator                       iterator;
     typedef TaskContainer_t::const_iterator                 const_iterator;
 
@@ -60,19 +98,53 @@ public:
     virtual ~task_group();
 
 public:
-    // wait for threads to finish tasks
+    // wait for threads to finish tasks. If tasks threw, the first exception
+    // is rethrown here (the others are dropped) once every task is done
     void join();
 
-    // get the task count
-    task_count_type& task_count() { return m_task_count; }
-    const task_count_type& task_count() const { return m_task_count; }
+    // store the exception of a task for join(), called by the thread pool
+    void set_exception(std::exception_ptr _ptr);
 
-    // get the locks/conditions
-    Lock_t& join_lock()      { return m_join_lock; }
-    Condition_t& join_cond() { return m_join_cond; }
+    // cooperative cancellation: tasks of the group that have not started
+    // yet are skipped by the thread pool (their results are left default
+    // constructed), running tasks stop early by polling is_canceled() or a
+    // token. Stays set until clear_cancel(), join() still has to be called
+    void cancel() { m_canceled.store(true, std::memory_order_release); }
+    void clear_cancel() { m_canceled.store(false, std::memory_order_relaxed); }
+    bool is_canceled() const
+    {
+        return m_canceled.load(std::memory_order_acquire);
+    }
+    cancellation_token token() const { return cancellation_token(&m_canceled); }
 
-    const Lock_t& join_lock() const      { return m_join_lock; }
-    const Condition_t& join_cond() const { return m_join_cond; }
+    // number of tasks submitted and not finished yet
+    long_type task_count() const { return pending(); }
+
+    // a task was submitted, counted before other threads can see it
+    void add_pending(long_type _n = 1)
+    {
+        m_task_count.fetch_add(_n, std::memory_order_relaxed);
+    }
+
+    // a task finished (or was skipped). One fetch_sub: a joiner that helps
+    // or spins may destroy the group as soon as the count is zero, so the
+    // last task only touches the group again when a joiner went to sleep
+    // (join_waiting is set). It wakes the joiner and clears the flag as its
+    // very last access: a joiner does not return while the count is exactly
+    // join_waiting (see wait). If tasks were added in between, the flag
+    // stays and the task finishing last among those does the same
+    void task_done()
+    {
+        if(m_task_count.fetch_sub(1, std::memory_order_release) ==
+           join_waiting + 1)
+        {
+            m_join_event.notify_all();
+            long_type _flag = join_waiting;
+            m_task_count.compare_exchange_strong(_flag, 0,
+                                                 std::memory_order_release,
+                                                 std::memory_order_relaxed);
+        }
+    }
 
     // add task
     this_type& operator+=(task_type* _task);
@@ -101,17 +173,28 @@ public:
     _Tp join(_Func func, _Tp result = _Tp());
 
 protected:
+    // set in the task count while a joiner sleeps
+    static const long_type join_waiting = 1L << (8 * sizeof(long) - 2);
+
     // check if any tasks are still pending
-    int pending() { return m_task_count; }
+    long_type pending() const
+    {
+        return m_task_count.load(std::memory_order_acquire) & ~join_waiting;
+    }
+    // wait (and help) until no task is pending, does not throw
+    void wait();
+    // rethrow and clear the stored exception
+    void rethrow_exception();
 
 private:
     // Private variables
     task_count_type     m_task_count;
     ulong_type          m_id;
     thread_pool*        m_pool;
-    Condition_t         m_join_cond;
+    Event_t             m_join_event;
+    std::atomic<bool>   m_canceled;
+    std::exception_ptr  m_exception;
     Lock_t              m_save_lock;
-    Lock_t              m_join_lock;
     TaskContainer_t     m_task_list;
 
 };
@@ -120,6 +203,8 @@ private:
 inline task_group::this_type&
 task_group::operator+=(task_type* _task)
 {
+    // tasks may be created concurrently from within other tasks
+    mad::fast_lock l(m_save_lock);
     m_task_list.push_back(_task);
     return *this;
 }
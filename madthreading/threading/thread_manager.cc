@@ -59,18 +59,17 @@ thread_manager* thread_manager::instance()
 
 //============================================================================//
 
+// the first thread_manager is the one returned by instance(), others (e.g. a
+// separate pool for I/O) own their pool and are only reachable through their
+// pointer
 void thread_manager::check_instance(thread_manager* local_instance)
 {
-    static std::string exist_msg
-            = "Instance of singleton \"mad::thread_manager\" already exists!";
     static std::string null_msg
             = "Local instance to \"mad::thread_manager\" is a null pointer!";
 
-    if(fgInstance)
-        throw std::runtime_error(exist_msg);
-    else if(!local_instance)
+    if(!local_instance)
         throw std::runtime_error(null_msg);
-    else
+    else if(!fgInstance)
         fgInstance = local_instance;
 }
 
@@ -132,7 +131,8 @@ thread_manager::~thread_manager()
     finalize();
     delete m_data;
     m_data = nullptr;
-    fgInstance = nullptr;
+    if(fgInstance == this)
+        fgInstance = nullptr;
 }
 
 //============================================================================//
@@ -38,6 +38,18 @@
 #include "madthreading/threading/task/task.hh"
 #include "madthreading/threading/task/task_tree.hh"
 #include "madthreading/threading/task/task_group.hh"
+#include "madthreading/threading/task/task_graph.hh"
+#include "madthreading/threading/task/bulk_task.hh"
+#include "madthreading/threading/task/future.hh"
+#include "madthreading/threading/blocked_range.hh"
+#include "madthreading/threading/parallel_for.hh"
+#include "madthreading/threading/parallel_reduce.hh"
+#include "madthreading/threading/parallel_scan.hh"
+#include "madthreading/threading/parallel_sort.hh"
+#include "madthreading/threading/parallel_invoke.hh"
+#include "madthreading/threading/parallel_find.hh"
+#include "madthreading/threading/pipeline.hh"
+#include "madthreading/threading/loop_schedule.hh"
 #include "madthreading/allocator/allocator.hh"
 
 // task.hh defines mad::function and mad::bind if CXX11 or USE_BOOST
@@ -47,6 +59,7 @@
 #include <iomanip>
 #include <cmath>
 #include <cassert>
+#include <memory>
 
 #if defined(USE_OPENMP)
 #   include <omp.h>
@@ -85,20 +98,24 @@ public:
     //------------------------------------------------------------------------//
     size_type size() const { return m_size; }
     //------------------------------------------------------------------------//
+    // remove _n threads (all if _n == 0). The remaining threads keep
+    // running, see thread_pool::set_size
     void delete_threads(const int& _n = 0)
     {
         int n_new_threads = 0;
         if(_n > 0)
             n_new_threads = m_tp->size() - _n;
 
-        delete m_tp;
-        m_tp = 0;
-
         if(n_new_threads > 0)
         {
-            m_size = n_new_threads;
-            m_tp = new mad::thread_pool(m_size);
+            m_tp->set_size(n_new_threads);
+            m_size = m_tp->size();
+            return;
         }
+
+        delete m_tp;
+        m_tp = 0;
+        m_size = 0;
     }
     //------------------------------------------------------------------------//
     void allocate_threads(size_type _n)
@@ -174,20 +191,21 @@ public:
     static thread_manager* get_thread_manager(const uint32_t& nthreads,
                                               const int& verbose = 0);
 
-    /// function for returning the thread id
+    /// function for returning the thread id: the worker index in its pool
+    /// (-1 if not a worker). The calling thread is looked up thread-locally
+    /// without a lock, other threads in the pool of the singleton
     template <typename _Tp>
     static long id(_Tp thread_self)
     {
-        long _id = -1;
-        static mad::mutex _mtx;
-        auto_lock l(_mtx);
-        thread_manager* _tm = thread_manager::Instance();
+        if(thread_self == std::this_thread::get_id())
+            return thread_pool::GetThisThreadID();
+
+        thread_manager* _tm = fgInstance;
         if(!_tm)
-            return _id;
-        if(_tm->m_data->tp()->GetThreadIDs().find(thread_self) !=
-           _tm->m_data->tp()->GetThreadIDs().end())
-            _id = _tm->m_data->tp()->GetThreadIDs().find(thread_self)->second;
-        return _id;
+            return -1;
+        thread_pool::tid_type _tids = _tm->m_data->tp()->GetThreadIDs();
+        thread_pool::tid_type::const_iterator itr = _tids.find(thread_self);
+        return (itr == _tids.end()) ? -1 : (long) itr->second;
     }
 
     /// function for returning the thread id in string format
@@ -228,6 +246,10 @@ private:
 public:
     // Public functions
     void use_affinity(bool _val) { m_data->tp()->use_affinity(_val); }
+    void set_placement(placement_policy _val)
+    { m_data->tp()->set_placement(_val); }
+    void set_idle_policy(idle_policy _val)
+    { m_data->tp()->set_idle_policy(_val); }
 
     void SetMaxThreads(const size_type& _n)   { max_threads = _n; }
     void set_max_threads(const size_type& _n) { max_threads = _n; }
@@ -267,37 +289,83 @@ private:
 public:
     //------------------------------------------------------------------------//
     // public exec functions
+    //  - return a mad::future to the result, which can be waited on or
+    //    continued with future::then, when_all and when_any (future.hh)
+    //  - the overloads taking a task_priority place the task in that lane
+    //    of the thread pool (see thread_pool.hh)
     //------------------------------------------------------------------------//
     template <typename _Ret, typename _Func, typename... _Args>
     _inline_
-    void exec(mad::task_group* tg, _Func function, _Args... args)
+    future<_Ret> exec(mad::task_group* tg, task_priority priority,
+                      _Func function, _Args... args)
     {
-        typedef task<_Ret, _Args...> task_type;
-        m_data->tp()->add_task(new task_type(tg, function, args...));
+        typedef details::future_task<_Ret> task_type;
+        typedef details::bound_call<_Ret, _Func, _Args...> call_type;
+        task_type* _task = new task_type(tg, call_type(function, args...));
+        m_data->tp()->add_task(_task, priority);
+        return future<_Ret>(_task);
     }
     //------------------------------------------------------------------------//
     template <typename _Func, typename... _Args>
     _inline_
-    void exec(mad::task_group* tg, _Func function, _Args... args)
+    future<void> exec(mad::task_group* tg, task_priority priority,
+                      _Func function, _Args... args)
     {
-        typedef task<void, _Args...> task_type;
-        m_data->tp()->add_task(new task_type(tg, function, args...));
+        typedef details::future_task<void> task_type;
+        typedef details::bound_call<void, _Func, _Args...> call_type;
+        task_type* _task = new task_type(tg, call_type(function, args...));
+        m_data->tp()->add_task(_task, priority);
+        return future<void>(_task);
     }
     //------------------------------------------------------------------------//
     template <typename _Ret, typename _Func>
     _inline_
-    void exec(mad::task_group* tg, _Func function)
+    future<_Ret> exec(mad::task_group* tg, task_priority priority,
+                      _Func function)
     {
-        typedef task<_Ret> task_type;
-        m_data->tp()->add_task(new task_type(tg, function));
+        typedef details::future_task<_Ret> task_type;
+        task_type* _task = new task_type(tg, function);
+        m_data->tp()->add_task(_task, priority);
+        return future<_Ret>(_task);
     }
     //------------------------------------------------------------------------//
     template <typename _Func>
     _inline_
-    void exec(mad::task_group* tg, _Func function)
+    future<void> exec(mad::task_group* tg, task_priority priority,
+                      _Func function)
     {
-        typedef task<void> task_type;
-        m_data->tp()->add_task(new task_type(tg, function));
+        typedef details::future_task<void> task_type;
+        task_type* _task = new task_type(tg, function);
+        m_data->tp()->add_task(_task, priority);
+        return future<void>(_task);
+    }
+    //------------------------------------------------------------------------//
+    template <typename _Ret, typename _Func, typename... _Args>
+    _inline_
+    future<_Ret> exec(mad::task_group* tg, _Func function, _Args... args)
+    {
+        return exec<_Ret>(tg, task_priority::normal, function, args...);
+    }
+    //------------------------------------------------------------------------//
+    template <typename _Func, typename... _Args>
+    _inline_
+    future<void> exec(mad::task_group* tg, _Func function, _Args... args)
+    {
+        return exec(tg, task_priority::normal, function, args...);
+    }
+    //------------------------------------------------------------------------//
+    template <typename _Ret, typename _Func>
+    _inline_
+    future<_Ret> exec(mad::task_group* tg, _Func function)
+    {
+        return exec<_Ret>(tg, task_priority::normal, function);
+    }
+    //------------------------------------------------------------------------//
+    template <typename _Func>
+    _inline_
+    future<void> exec(mad::task_group* tg, _Func function)
+    {
+        return exec(tg, task_priority::normal, function);
     }
     //------------------------------------------------------------------------//
 
@@ -423,7 +491,7 @@ public:
         size_type _n = _grainsize;
         for(size_type i = 0; i < _n; ++i)
         {
-            _Arg _f = _diff*i; // first
+            _Arg _f = _s + _diff*i; // first
             _Arg _l = _f + _diff; // last
             if(i+1 == _n)
                 _l = _e;
@@ -445,7 +513,7 @@ public:
         size_type _n = _grainsize;
         for(size_type i = 0; i < _n; ++i)
         {
-            _Arg _f = _diff*i; // first
+            _Arg _f = _s + _diff*i; // first
             _Arg _l = _f + _diff; // last
             if(i+1 == _n)
                 _l = _e;
@@ -455,6 +523,83 @@ public:
         }
     }
     //------------------------------------------------------------------------//
+    // chunks with a NUMA locality hint: locality(first, last) returns the
+    // node of the memory the chunk touches (negative for no preference), e.g.
+    //      [&] (ulong_type f, ulong_type) -> long
+    //      { return topology::instance().node_of_address(&data[f]); }
+    // Requires workers grouped by node, see placement_policy::per_numa_node
+    //------------------------------------------------------------------------//
+    template <typename _Func, typename _Arg1, typename _Arg,
+              typename _Locality>
+    _inline_
+    void run_loop(mad::task_group* tg,
+                  _Func function, const _Arg1& _s, const _Arg& _e,
+                  unsigned long chunks, _Locality locality)
+    {
+        typedef task<void, _Arg, _Arg> task_type;
+
+        _Arg _grainsize = (chunks == 0) ? size() : chunks;
+        _Arg _diff = (_e - _s)/_grainsize;
+        size_type _n = _grainsize;
+        for(size_type i = 0; i < _n; ++i)
+        {
+            _Arg _f = _s + _diff*i; // first
+            _Arg _l = _f + _diff; // last
+            if(i+1 == _n)
+                _l = _e;
+            task_type* t = new task_type(tg, function, _f, _l);
+            m_data->tp()->add_task(t, numa_hint(locality(_f, _l)));
+        }
+    }
+    //------------------------------------------------------------------------//
+    // self-balancing run_loop, see loop_schedule.hh. One task per thread
+    // calls function(first, last) on chunks claimed from a shared counter,
+    // e.g. run_loop(&tg, func, 0, n, loop_schedule::guided(16))
+    //------------------------------------------------------------------------//
+    template <typename _Func, typename _Arg1, typename _Arg>
+    _inline_
+    void run_loop(mad::task_group* tg,
+                  _Func function, const _Arg1& _s, const _Arg& _e,
+                  const loop_schedule& schedule)
+    {
+        typedef task<void> task_type;
+        typedef details::loop_counter<_Arg> counter_type;
+
+        // shared by the tasks, released by the last one destroyed
+        std::shared_ptr<counter_type> _counter(
+                    new counter_type(_s, _e, schedule, size()));
+
+        // stops claiming chunks once the group is canceled
+        auto _claim_loop = [_counter, function, tg] ()
+        {
+            _Arg _f, _l;
+            while(!tg->is_canceled() && _counter->claim(_f, _l))
+                function(_f, _l);
+        };
+
+        size_type _n = std::max<size_type>(size(), 1);
+        task_list_t _tasks(_n, nullptr);
+        for(size_type i = 0; i < _n; ++i)
+            _tasks[i] = new task_type(tg, _claim_loop);
+        m_data->tp()->add_tasks(_tasks);
+    }
+    //------------------------------------------------------------------------//
+    // the whole range as a single task, see bulk_task.hh. function(i) is
+    // called for every i in [_s, _e), the workers claim the indices in
+    // chunks according to "schedule". Submission costs one enqueue however
+    // large the range is
+    //------------------------------------------------------------------------//
+    template <typename _Func, typename _Arg1, typename _Arg>
+    _inline_
+    void run_bulk(mad::task_group* tg,
+                  _Func function, const _Arg1& _s, const _Arg& _e,
+                  const loop_schedule& schedule = loop_schedule::guided())
+    {
+        typedef bulk_task<_Func, _Arg> task_type;
+        m_data->tp()->add_bulk_task(new task_type(tg, m_data->tp(), function,
+                                                  _s, _e, schedule));
+    }
+    //------------------------------------------------------------------------//
     template <typename _Ret,
               typename _Func,
               typename _Arg1, typename _Arg,
@@ -479,7 +624,7 @@ public:
         std::deque<task_tree_node_type*> _nodes;
         for(size_type i = 0; i < _n; ++i)
         {
-            _Arg _f = _diff*i; // first
+            _Arg _f = _s + _diff*i; // first
             _Arg _l = _f + _diff; // last
             if(i+1 == _n)
                 _l = _e;
@@ -500,41 +645,245 @@ public:
     }
     //------------------------------------------------------------------------//
 
+public:
+    //------------------------------------------------------------------------//
+    // public parallel_for functions
+    //  - range is a splittable range, e.g. blocked_range<ulong_type>
+    //  - body is called as body(const range_type&) on each piece
+    //  - returns when the whole range has been processed
+    //------------------------------------------------------------------------//
+    template <typename _Range, typename _Body>
+    _inline_
+    void parallel_for(const _Range& range, const _Body& body)
+    {
+        details::parallel_for(m_data->tp(), range, body, auto_partitioner());
+    }
+    //------------------------------------------------------------------------//
+    template <typename _Range, typename _Body>
+    _inline_
+    void parallel_for(const _Range& range, const _Body& body,
+                      const simple_partitioner& partitioner)
+    {
+        details::parallel_for(m_data->tp(), range, body, partitioner);
+    }
+    //------------------------------------------------------------------------//
+    template <typename _Range, typename _Body>
+    _inline_
+    void parallel_for(const _Range& range, const _Body& body,
+                      const auto_partitioner& partitioner)
+    {
+        details::parallel_for(m_data->tp(), range, body, partitioner);
+    }
+    //------------------------------------------------------------------------//
+    // reuse the same partitioner object across loops over the same range to
+    // replay the placement of pieces on workers
+    template <typename _Range, typename _Body>
+    _inline_
+    void parallel_for(const _Range& range, const _Body& body,
+                      affinity_partitioner& partitioner)
+    {
+        details::parallel_for(m_data->tp(), range, body, partitioner);
+    }
+    //------------------------------------------------------------------------//
+
+public:
+    //------------------------------------------------------------------------//
+    // public parallel_reduce functions
+    //  - map is called as map(const range_type&, const _Tp& init) and
+    //    returns "init" folded with the piece
+    //  - combine is called as combine(const _Tp&, const _Tp&)
+    //  - returns the combined value of the whole range
+    //------------------------------------------------------------------------//
+    template <typename _Range, typename _Tp, typename _Map, typename _Combine>
+    _inline_
+    _Tp parallel_reduce(const _Range& range, const _Tp& identity,
+                        const _Map& map, const _Combine& combine)
+    {
+        return details::parallel_reduce(m_data->tp(), range, identity, map,
+                                        combine, auto_partitioner());
+    }
+    //------------------------------------------------------------------------//
+    template <typename _Range, typename _Tp, typename _Map, typename _Combine>
+    _inline_
+    _Tp parallel_reduce(const _Range& range, const _Tp& identity,
+                        const _Map& map, const _Combine& combine,
+                        const auto_partitioner& partitioner)
+    {
+        return details::parallel_reduce(m_data->tp(), range, identity, map,
+                                        combine, partitioner);
+    }
+    //------------------------------------------------------------------------//
+    // fixed decomposition and combine order: reproducible floating-point
+    // results for any number of threads
+    template <typename _Range, typename _Tp, typename _Map, typename _Combine>
+    _inline_
+    _Tp parallel_reduce(const _Range& range, const _Tp& identity,
+                        const _Map& map, const _Combine& combine,
+                        const deterministic_partitioner& partitioner)
+    {
+        return details::parallel_reduce(m_data->tp(), range, identity, map,
+                                        combine, partitioner);
+    }
+    //------------------------------------------------------------------------//
+
+public:
+    //------------------------------------------------------------------------//
+    // public parallel scan functions
+    //  - [first, last) and out are random-access iterators, out may be first
+    //  - op is associative, std::plus by default
+    //  - inclusive: out[i] = in[0] op ... op in[i]
+    //  - exclusive: out[i] = init op in[0] op ... op in[i-1]
+    //  - return the end of the output range
+    //------------------------------------------------------------------------//
+    template <typename _InIter, typename _OutIter, typename _Op>
+    _inline_
+    _OutIter parallel_inclusive_scan(_InIter first, _InIter last,
+                                     _OutIter out, const _Op& op)
+    {
+        typedef typename std::iterator_traits<_InIter>::value_type value_type;
+        return details::parallel_scan(m_data->tp(), first, last, out,
+                                      (const value_type*) nullptr, op);
+    }
+    //------------------------------------------------------------------------//
+    template <typename _InIter, typename _OutIter>
+    _inline_
+    _OutIter parallel_inclusive_scan(_InIter first, _InIter last,
+                                     _OutIter out)
+    {
+        typedef typename std::iterator_traits<_InIter>::value_type value_type;
+        return parallel_inclusive_scan(first, last, out,
+                                       std::plus<value_type>());
+    }
+    //------------------------------------------------------------------------//
+    template <typename _InIter, typename _OutIter, typename _Tp, typename _Op>
+    _inline_
+    _OutIter parallel_exclusive_scan(_InIter first, _InIter last,
+                                     _OutIter out, const _Tp& init,
+                                     const _Op& op)
+    {
+        return details::parallel_scan(m_data->tp(), first, last, out, &init,
+                                      op);
+    }
+    //------------------------------------------------------------------------//
+    template <typename _InIter, typename _OutIter, typename _Tp>
+    _inline_
+    _OutIter parallel_exclusive_scan(_InIter first, _InIter last,
+                                     _OutIter out, const _Tp& init)
+    {
+        return parallel_exclusive_scan(first, last, out, init,
+                                       std::plus<_Tp>());
+    }
+    //------------------------------------------------------------------------//
+
+public:
+    //------------------------------------------------------------------------//
+    // public parallel sort and partition functions
+    //  - [first, last) are random-access iterators
+    //  - integer keys without a comparator use the LSD radix sort, anything
+    //    else the merge sort
+    //  - parallel_partition is stable and returns the partition point
+    //------------------------------------------------------------------------//
+    template <typename _Iter>
+    _inline_
+    void parallel_sort(_Iter first, _Iter last)
+    {
+        typedef typename std::iterator_traits<_Iter>::value_type value_type;
+        details::parallel_sort(m_data->tp(), first, last,
+                               details::is_radix_sortable<value_type>());
+    }
+    //------------------------------------------------------------------------//
+    template <typename _Iter, typename _Compare>
+    _inline_
+    void parallel_sort(_Iter first, _Iter last, const _Compare& comp)
+    {
+        details::parallel_merge_sort(m_data->tp(), first, last, comp);
+    }
+    //------------------------------------------------------------------------//
+    template <typename _Iter>
+    _inline_
+    void parallel_radix_sort(_Iter first, _Iter last)
+    {
+        details::parallel_radix_sort(m_data->tp(), first, last);
+    }
+    //------------------------------------------------------------------------//
+    template <typename _Iter, typename _Predicate>
+    _inline_
+    _Iter parallel_partition(_Iter first, _Iter last, const _Predicate& pred)
+    {
+        return details::parallel_partition(m_data->tp(), first, last, pred);
+    }
+    //------------------------------------------------------------------------//
+
+public:
+    //------------------------------------------------------------------------//
+    // public parallel search functions
+    //  - [first, last) are random-access iterators
+    //  - returns the first element for which pred is true (last if none),
+    //    the remaining work is canceled as soon as a match is found
+    //------------------------------------------------------------------------//
+    template <typename _Iter, typename _Predicate>
+    _inline_
+    _Iter parallel_find_if(_Iter first, _Iter last, const _Predicate& pred)
+    {
+        return details::parallel_find_if(m_data->tp(), first, last, pred);
+    }
+    //------------------------------------------------------------------------//
+
+public:
+    //------------------------------------------------------------------------//
+    // public fork-join functions (see parallel_invoke.hh)
+    //  - runs every function and returns when all of them are done, the
+    //    last one on the calling thread
+    //  - may be called recursively from within the functions, e.g.
+    //      tm->parallel_invoke([&] () { a = fib(n-1); },
+    //                          [&] () { b = fib(n-2); });
+    //  - for an open-ended number of spawns use a spawn_group on
+    //    thread_pool()
+    //------------------------------------------------------------------------//
+    template <typename... _Funcs>
+    _inline_
+    void parallel_invoke(_Funcs&&... funcs)
+    {
+        mad::parallel_invoke(m_data->tp(), std::forward<_Funcs>(funcs)...);
+    }
+    //------------------------------------------------------------------------//
+
 public:
     //------------------------------------------------------------------------//
     // public run in background functions
+    //  - the task runs on a dedicated background thread every time it is
+    //    signalled, the returned channel is the lock-free way to signal it
     //------------------------------------------------------------------------//
     template <typename _Ret, typename _Arg, typename _Func>
     _inline_
-    void add_background_task(mad::task_group* tg,
-                             void* _id, _Func function, _Arg argument)
+    background_channel* add_background_task(mad::task_group* tg,
+                                            void* _id, _Func function,
+                                            _Arg argument)
     {
         typedef task<_Ret, _Arg> task_type;
         task_type* t = new task_type(tg, function, argument);
-        m_data->tp()->add_background_task(_id, t);
+        return m_data->tp()->add_background_task(_id, t);
     }
     //------------------------------------------------------------------------//
     template <typename _Arg, typename _Func>
     _inline_
-    void add_background_task(mad::task_group* tg,
-                             void* _id, _Func function, _Arg argument)
+    background_channel* add_background_task(mad::task_group* tg,
+                                            void* _id, _Func function,
+                                            _Arg argument)
     {
         typedef task<void, _Arg> task_type;
         task_type* t = new task_type(tg, function, argument);
-        m_data->tp()->add_background_task(_id, t);
+        return m_data->tp()->add_background_task(_id, t);
     }
     //------------------------------------------------------------------------//
     template <typename _Func>
     _inline_
-    void add_background_task(mad::task_group* tg,
-                             void* _id, _Func function)
+    background_channel* add_background_task(mad::task_group* tg,
+                                            void* _id, _Func function)
     {
         typedef task<void> task_type;
-        for(size_type i = 0; i < size(); ++i)
-        {
-            task_type* t = new task_type(tg, function);
-            m_data->tp()->add_background_task(_id, t);
-        }
+        task_type* t = new task_type(tg, function);
+        return m_data->tp()->add_background_task(_id, t);
     }
     //------------------------------------------------------------------------//
 
@@ -545,20 +894,20 @@ public:
     // in a class, call thread_manager::Instance()->signal_background(this);
     // to wake up a thread to complete the background task
     // use case: a dedicated thread for generate random numbers
+    // every signal executes the task once, the future tells when
     //------------------------------------------------------------------------//
     _inline_
-    void signal_background(void* _id)
+    background_future signal_background(void* _id)
     {
-        m_data->tp()->signal_background(_id);
+        return m_data->tp()->signal_background(_id);
     }
     //------------------------------------------------------------------------//
-    // same as above but set argument to "val"
+    // same as above without the look-up of the id
     //------------------------------------------------------------------------//
-    template <typename _Tp>
     _inline_
-    void signal_background(void* _id, _Tp val)
+    background_future signal_background(background_channel* _channel)
     {
-        m_data->tp()->signal_background<_Tp>(_id, val);
+        return m_data->tp()->signal_background(_channel);
     }
     //------------------------------------------------------------------------//
     // check if background is done
@@ -566,7 +915,7 @@ public:
     //      while(!thread_manager::Instance()->is_done(this);
     //------------------------------------------------------------------------//
     _inline_
-    volatile bool& is_done(void* _id)
+    bool is_done(void* _id)
     {
         return m_data->tp()->is_done(_id);
     }
@@ -40,11 +40,7 @@
 #include "madthreading/utility/fpe_detection.hh"
 
 #include <cstdlib>
-
-#if !defined(WIN32) && !defined(__MACH__)
-#define ALLOW_AFFINITY
-#   include <pthread.h>
-#endif
+#include <algorithm>
 
 static mad::mutex io_mutex;
 
@@ -60,12 +56,12 @@ inline int ncores()
 
 //============================================================================//
 
-static mad::mutex tid_mutex;
-
-//============================================================================//
-
-thread_pool::tid_type thread_pool::tids;
-volatile bool thread_pool::is_alive_flag = false;
+// pool and worker index of the calling thread
+ThreadLocalStatic thread_pool* this_thread_pool = nullptr;
+ThreadLocalStatic long         this_thread_index = -1;
+// number of tasks run from run_pending_task (helping joins) on the stack
+// of the calling thread
+ThreadLocalStatic long         this_thread_help_depth = 0;
 
 //============================================================================//
 
@@ -78,13 +74,39 @@ static const int NONINIT = 2;
 
 //============================================================================//
 
+// defaults for idle_policy::adaptive, a pause is ~10-100 cycles so a worker
+// keeps polling for several microseconds before giving up the core
+static const std::size_t default_spin_count = 2048;
+static const std::size_t default_yield_count = 32;
+// a worker serves the lower lanes first on every 32nd pick
+static const std::size_t default_priority_aging = 32;
+// beyond this many nested helping joins a thread only runs tasks of the
+// group it waits for: with recursive fork-join every join would otherwise
+// pick up unrelated work and the stack grows without bound
+static const long max_help_depth = 32;
+// threads of the background_executor
+static const std::size_t default_background_size = 2;
+
+//============================================================================//
+
 thread_pool::thread_pool(bool _use_affinity)
 : m_use_affinity(_use_affinity),
+  m_placement(GetEnvPlacement()),
+  m_is_placed(false),
   m_pool_size(std::thread::hardware_concurrency()),
   m_pool_state(state::NONINIT),
-  m_task_lock(), // recursive
+  m_task_lock(),
   m_back_lock(),
-  m_back_task_to_do(nullptr)
+  m_background_size(default_background_size),
+  m_background(nullptr),
+  m_idle_policy(GetEnvIdlePolicy()),
+  m_spin_count(default_spin_count),
+  m_yield_count(default_yield_count),
+  m_priority_aging(default_priority_aging),
+  m_num_sleeping(0),
+  m_num_threads(0),
+  m_num_active(0),
+  m_is_alive(false)
 {
 
 #ifdef VERBOSE_THREAD_POOL
@@ -105,11 +127,22 @@ thread_pool::thread_pool(bool _use_affinity)
 
 thread_pool::thread_pool(size_type pool_size, bool _use_affinity)
 : m_use_affinity(_use_affinity),
+  m_placement(GetEnvPlacement()),
+  m_is_placed(false),
   m_pool_size(pool_size),
   m_pool_state(state::NONINIT),
-  m_task_lock(), // recursive
+  m_task_lock(),
   m_back_lock(),
-  m_back_task_to_do(nullptr)
+  m_background_size(default_background_size),
+  m_background(nullptr),
+  m_idle_policy(GetEnvIdlePolicy()),
+  m_spin_count(default_spin_count),
+  m_yield_count(default_yield_count),
+  m_priority_aging(default_priority_aging),
+  m_num_sleeping(0),
+  m_num_threads(0),
+  m_num_active(0),
+  m_is_alive(false)
 {
 
 #ifdef VERBOSE_THREAD_POOL
@@ -133,21 +166,18 @@ thread_pool::~thread_pool()
     if (m_pool_state != state::STOPPED)
         destroy_threadpool();
 
-    // delete all background tasks
-    for(TaskMap_t::iterator itr = m_back_tasks.begin();
-        itr != m_back_tasks.end(); ++itr)
-        delete itr->second;
+    // executes the pending signals and joins the background threads. The
+    // tasks themselves belong to their task_group
+    delete m_background;
 
     // wait until thread pool is fully destroyed
-    while(mad::thread_pool::is_alive());
-    // delete thread-local allocator and erase thread IDS
+    while(is_alive());
+    // delete thread-local allocator
     if(mad::details::allocator_list_tl::get_allocator_list_if_exists())
     {
-        auto _self = std::this_thread::get_id();
-        ulong_type _id = mad::thread_pool::GetThreadIDs().find(_self)->second;
-        if(tids.find(_self) != tids.end())
-            tids.erase(tids.find(_self));
-        mad::details::allocator_list_tl::get_allocator_list()->Destroy(_id, 1);
+        long_type _id = GetThisThreadID();
+        mad::details::allocator_list_tl::get_allocator_list()
+                ->Destroy((_id < 0) ? 0 : _id, 1);
     }
 
 }
@@ -164,35 +194,22 @@ bool thread_pool::is_initialized() const
 // We can't pass a non-static member function to CORETHREADCREATE.
 // So created the static member function that calls the member function
 // we want to run in the thread.
-void* thread_pool::start_thread(void* arg)
+void* thread_pool::start_thread(void* arg, size_type _index)
 {
-    {
-        mad::Lock_t lock(tid_mutex);
-        tids[std::this_thread::get_id()] = tids.size();
-#ifdef VERBOSE_THREAD_POOL
-        tmcout << "--> [MAIN THREAD QUEUE] thread ids size: " << tids.size()
-                  << std::endl;
-#endif
-    }
     thread_pool* tp = (thread_pool*) arg;
-    tp->execute_thread();
-    return nullptr;
-}
-
-//============================================================================//
-
-void* thread_pool::start_background(void* arg)
-{
-    { // a background thread is not in thread pool
-        mad::Lock_t lock(tid_mutex);
-        tids[std::this_thread::get_id()] = tids.size();
+    {
+        mad::auto_lock l(tp->m_tid_lock);
+        tp->m_tids[std::this_thread::get_id()] = _index;
 #ifdef VERBOSE_THREAD_POOL
-        tmcout << "--> [BACK THREAD QUEUE] thread ids size: "
-                  << tids.size() << std::endl;
+        tmcout << "--> [MAIN THREAD QUEUE] thread ids size: "
+               << tp->m_tids.size() << std::endl;
 #endif
     }
-    thread_pool* tp = (thread_pool*) arg;
-    tp->background_thread();
+    this_thread_pool = tp;
+    this_thread_index = _index;
+    tp->execute_thread(_index);
+    this_thread_pool = nullptr;
+    this_thread_index = -1;
     return nullptr;
 }
 
@@ -203,7 +220,7 @@ int thread_pool::initialize_threadpool()
     if(m_pool_size == 1)
         return 1;
 
-    is_alive_flag = true;
+    m_is_alive = true;
 
 #ifdef VERBOSE_THREAD_POOL
     tmcout << "--> Creating " << m_pool_size
@@ -212,36 +229,83 @@ int thread_pool::initialize_threadpool()
 #endif
 
     //--------------------------------------------------------------------//
-    // destroy any existing thread pool
+    // a running pool keeps its threads, only the size changes
     if(m_pool_state == state::STARTED)
-        destroy_threadpool();
+    {
+        set_size(m_pool_size);
+        return m_pool_size;
+    }
 
     //--------------------------------------------------------------------//
     m_pool_state = state::STARTED;
 
-    for (size_type i = 0; i < m_pool_size; i++)
+    // one queue per NUMA node, at least one per worker so that nodes can be
+    // assigned with set_worker_nodes when the topology is not known
+    size_type _nnodes = std::max<size_type>(m_pool_size,
+                                            topology::instance().num_nodes());
+    for(size_type i = 0; i < _nnodes; ++i)
+        m_node_tasks.push_back(new TaskContainer_t(256));
+
+    m_num_active.store(m_pool_size);
+    m_pool_size = spawn_workers(m_pool_size);
+    m_num_active.store(m_pool_size);
+    //------------------------------------------------------------------------//
+
+    // CPUs are chosen from the topology, not by worker index, so that SMT
+    // siblings, NUMA nodes and restricted affinity masks are respected
+    apply_placement();
+
+#ifdef VERBOSE_THREAD_POOL
+    tmcout << "--> " << m_pool_size
+              << " threads created by the thread pool" << std::endl;
+#endif
+
+    // thread pool size doesn't match with join vector
+    // this will screw up joining later
+    if(m_is_joined.size() != m_main_threads.size())
     {
+        std::stringstream ss;
+        ss << "thread_pool::initialize_threadpool - boolean is_joined vector "
+           << "is a different size than threads vector: " << m_is_joined.size()
+           << " vs. " << m_main_threads.size() << " (tid: "
+           << std::this_thread::get_id() << ")";
+
+        throw std::runtime_error(ss.str());
+    }
+
+    return m_main_threads.size();
+}
+
+//============================================================================//
+
+thread_pool::size_type thread_pool::spawn_workers(size_type _n)
+{
+    for(size_type i = m_main_threads.size(); i < _n; ++i)
+    {
+        // the slot arrays never move their elements when they grow: the
+        // running workers keep indexing them without a lock. A slot left
+        // by a thread that failed to start is reused
+        if(i == m_work_queues.size())
+        {
+            m_work_queues.resize(i + 1);
+            m_mailboxes.resize(i + 1);
+            m_parkers.resize(i + 1);
+            m_worker_nodes.resize(i + 1);
+            m_work_queues[i] = new WorkQueue_t;
+            m_mailboxes[i] = new TaskContainer_t(256);
+            m_parkers[i] = new parker;
+        }
+        m_worker_nodes[i].store(0, std::memory_order_relaxed);
+        // publish the slot before its thread starts, other workers only
+        // look at the slots below m_num_threads
+        m_num_threads.store(i + 1, std::memory_order_release);
+
         // add the threads
         thread* tid = new std::thread;
         bool _add_thread = true;
         try
         {
-            *tid = std::thread(thread_pool::start_thread, (void*)(this));
-#if defined(ALLOW_AFFINITY)
-            if(m_use_affinity)
-            {
-                // Create a cpu_set_t object representing a set of CPUs. Clear it and mark
-                // only CPU i as set.
-                cpu_set_t cpuset;
-                CPU_ZERO(&cpuset);
-                CPU_SET(i, &cpuset);
-                int rc = pthread_setaffinity_np(tid->native_handle(),
-                                                sizeof(cpu_set_t), &cpuset);
-                if (rc != 0)
-                    std::cerr << "Error calling pthread_setaffinity_np: " << rc
-                              << std::endl;
-            }
-#endif
+            *tid = std::thread(thread_pool::start_thread, (void*)(this), i);
         } catch(std::runtime_error& e)
         {
             std::cerr << e.what() << std::endl; // issue creating thread
@@ -252,44 +316,68 @@ int thread_pool::initialize_threadpool()
             _add_thread = false;
         }
 
-        // successful creation of thread
-        if(_add_thread)
+        // the slot stays allocated (and empty) until the pool is destroyed
+        if(!_add_thread)
         {
-            m_main_threads.push_back(std::move(tid));
-            // TODO: FIGURE THIS OUT
-            m_is_joined.push_back(false);
+            delete tid;
+            m_num_threads.store(i, std::memory_order_release);
+            break;
         }
-    }
-    //------------------------------------------------------------------------//
 
-    m_pool_size = m_main_threads.size();
+        m_main_threads.push_back(std::move(tid));
+        // TODO: FIGURE THIS OUT
+        m_is_joined.push_back(false);
+    }
+    return m_main_threads.size();
+}
 
-#ifdef VERBOSE_THREAD_POOL
-    tmcout << "--> " << m_pool_size
-              << " threads created by the thread pool" << std::endl;
-#endif
+//============================================================================//
 
-    // thread pool size doesn't match with join vector
-    // this will screw up joining later
-    if(m_is_joined.size() != m_main_threads.size())
+void thread_pool::set_size(size_type _n)
+{
+    _n = std::max<size_type>(_n, 1);
+    if(m_pool_state != state::STARTED)
     {
-        std::stringstream ss;
-        ss << "thread_pool::initialize_threadpool - boolean is_joined vector "
-           << "is a different size than threads vector: " << m_is_joined.size()
-           << " vs. " << m_main_threads.size() << " (tid: "
-           << std::this_thread::get_id() << ")";
+        m_pool_size = _n;
+        return;
+    }
 
-        throw std::runtime_error(ss.str());
+    m_task_lock.lock();
+    size_type _active = m_num_active.load();
+    if(_n < _active)
+    {
+        // the retired workers notice on their next pick (or right away if
+        // they sleep) and move their queued tasks to the injection queue
+        m_num_active.store(_n);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for(size_type i = _n; i < _active; ++i)
+            if(m_parkers[i]->unpark())
+                --m_num_sleeping;
+    }
+    else if(_n > _active)
+    {
+        // retired workers are woken first, threads are only started for
+        // the slots that never had one, adding slots as needed
+        m_num_active.store(_n);
+        _n = spawn_workers(_n);
+        m_num_active.store(_n);
+        m_resize_event.notify_all();
     }
+    m_pool_size = _n;
+    apply_placement();
+    m_task_lock.unlock();
 
-    return m_main_threads.size();
+#ifdef VERBOSE_THREAD_POOL
+    tmcout << "--> thread pool resized to " << m_pool_size << " of "
+           << m_main_threads.size() << " threads" << std::endl;
+#endif
 }
 
 //============================================================================//
 
 int thread_pool::destroy_threadpool()
 {
-    if(!is_alive_flag)
+    if(!m_is_alive)
         return 0;
 
     // Note: this is not for synchronization, its for thread communication!
@@ -299,12 +387,13 @@ int thread_pool::destroy_threadpool()
     //------------------------------------------------------------------------//
     m_task_lock.lock();
     m_pool_state = state::STOPPED;
+    m_num_active.store(m_num_threads.load());
     m_task_lock.unlock();
 
     //------------------------------------------------------------------------//
     // notify all threads we are shutting down
-    m_task_cond.notify_all();
-    m_back_cond.notify_all();
+    m_resize_event.notify_all();
+    notify_workers(m_parkers.size());
     //------------------------------------------------------------------------//
 
     if(m_is_joined.size() != m_main_threads.size())
@@ -332,8 +421,10 @@ int thread_pool::destroy_threadpool()
 
         //--------------------------------------------------------------------//
         // erase thread from thread ID list
-        if(tids.find(m_main_threads[i]->get_id()) != tids.end())
-            tids.erase(tids.find(m_main_threads[i]->get_id()));
+        {
+            mad::auto_lock l(m_tid_lock);
+            m_tids.erase(m_main_threads[i]->get_id());
+        }
 
         //--------------------------------------------------------------------//
         // it's joined
@@ -341,25 +432,7 @@ int thread_pool::destroy_threadpool()
 
         //--------------------------------------------------------------------//
         // try waking up a bunch of threads that are still waiting
-        m_task_cond.notify_all();
-        //--------------------------------------------------------------------//
-    }
-
-    for (size_type i = 0; i < m_back_threads.size(); i++)
-    {
-        //--------------------------------------------------------------------//
-        // erase background threads
-        if(tids.find(m_back_threads[i]->get_id()) != tids.end())
-            tids.erase(tids.find(m_back_threads[i]->get_id()));
-
-        //--------------------------------------------------------------------//
-        // set join
-        if(!(std::this_thread::get_id() == m_back_threads[i]->get_id()))
-            m_back_threads[i]->join();
-
-        //--------------------------------------------------------------------//
-        // try waking up a bunch of threads that are still waiting
-        m_back_cond.notify_all();
+        notify_workers(m_parkers.size());
         //--------------------------------------------------------------------//
     }
 
@@ -372,166 +445,466 @@ int thread_pool::destroy_threadpool()
     for(auto& itr : m_main_threads)
         delete itr;
     m_main_threads.clear();
-    for(auto& itr : m_back_threads)
-        delete itr;
-    m_back_threads.clear();
     m_is_joined.clear();
+    for(size_type i = 0; i < m_work_queues.size(); ++i)
+    {
+        delete m_work_queues[i];
+        delete m_mailboxes[i];
+        delete m_parkers[i];
+    }
+    m_work_queues.clear();
+    m_mailboxes.clear();
+    m_parkers.clear();
+    for(auto& itr : m_node_tasks)
+        delete itr;
+    m_node_tasks.clear();
+    m_worker_nodes.clear();
+    m_num_threads.store(0);
+    m_num_active.store(0);
 
-    is_alive_flag = false;
+    m_is_alive = false;
 
     return 0;
 }
 
 //============================================================================//
 
-void* thread_pool::execute_thread()
+void thread_pool::set_placement(placement_policy _val)
 {
-    vtask* task = nullptr;
-    while(true)
+    m_placement = _val;
+    if(m_pool_state == state::STARTED)
+        apply_placement();
+}
+
+//============================================================================//
+
+void thread_pool::apply_placement()
+{
+    placement_policy _policy = m_placement;
+    if(_policy == placement_policy::none && m_use_affinity)
+        _policy = placement_policy::one_per_core;
+
+    // nothing was bound so far, keep the threads as they are
+    if(_policy == placement_policy::none && !m_is_placed)
+        return;
+
+    std::vector<topology::cpu_list_t> _cpus =
+            topology::instance().placement(_policy, m_main_threads.size());
+    for(size_type i = 0; i < m_main_threads.size(); ++i)
     {
-        //--------------------------------------------------------------------//
-        // Try to pick a task
-        m_task_lock.lock();
-        //--------------------------------------------------------------------//
+        int rc = topology::bind(*m_main_threads[i], _cpus[i]);
+        if(rc != 0)
+            std::cerr << "Error calling pthread_setaffinity_np: " << rc
+                      << std::endl;
+        int _node = (_cpus[i].empty())
+                    ? 0 : topology::instance().node_of(_cpus[i].front());
+        m_worker_nodes[i].store(std::max(_node, 0), std::memory_order_relaxed);
+    }
+    m_is_placed = (_policy != placement_policy::none);
+}
+
+//============================================================================//
+
+void thread_pool::set_worker_nodes(const std::vector<int>& _nodes)
+{
+    if(m_pool_state != state::STARTED)
+        throw std::runtime_error("thread_pool::set_worker_nodes - the thread "
+                                 "pool is not running");
+
+    if(_nodes.size() != m_pool_size)
+    {
+        std::stringstream ss;
+        ss << "thread_pool::set_worker_nodes - expected " << m_pool_size
+           << " nodes, got " << _nodes.size();
+        throw std::runtime_error(ss.str());
+    }
 
-        // We need to put condition.wait() in a loop for two reasons:
-        // 1. There can be spurious wake-ups (due to signal/ENITR)
-        // 2. When mutex is released for waiting, another thread can be waken up
-        //    from a signal/broadcast and that thread can mess up the condition.
-        //    So when the current thread wakes up the condition may no longer be
-        //    actually true!
-        while ((m_pool_state != state::STOPPED) && (m_main_tasks.empty()))
+    for(const auto& itr : _nodes)
+    {
+        if(itr < 0 || itr >= (int) m_node_tasks.size())
         {
-            // Wait until there is a task in the queue
-            // Unlock mutex while wait, then lock it back when signaled
-            m_task_cond.wait(m_task_lock);
+            std::stringstream ss;
+            ss << "thread_pool::set_worker_nodes - invalid node " << itr
+               << ", expected [0, " << m_node_tasks.size() << ")";
+            throw std::runtime_error(ss.str());
         }
+    }
 
-        // If the thread was waked to notify process shutdown, return from here
-        if (m_pool_state == state::STOPPED)
+    for(size_type i = 0; i < _nodes.size(); ++i)
+        m_worker_nodes[i].store(_nodes[i], std::memory_order_relaxed);
+}
+
+//============================================================================//
+
+long_type thread_pool::get_this_thread_index() const
+{
+    return (this_thread_pool == this) ? this_thread_index : -1;
+}
+
+//============================================================================//
+
+long_type thread_pool::GetThisThreadID()
+{
+    return this_thread_index;
+}
+
+//============================================================================//
+
+thread_pool::tid_type thread_pool::GetThreadIDs() const
+{
+    mad::auto_lock l(m_tid_lock);
+    return m_tids;
+}
+
+//============================================================================//
+
+bool thread_pool::run_pending_task(task_group* tg)
+{
+    if(!m_is_alive || m_pool_state != state::STARTED)
+        return false;
+
+    task_type* task = nullptr;
+    long_type _index = get_this_thread_index();
+
+    if(_index >= 0)
+    {
+        //--------------------------------------------------------------------//
+        // newest task of our own queue, but only if it belongs to the group
+        // being joined, otherwise leave it in place
+        WorkQueue_t* _queue = m_work_queues[_index];
+        if(_queue->pop(task))
         {
-            // has exited.
-            m_task_lock.unlock();
-            //----------------------------------------------------------------//
-            if(mad::details::allocator_list_tl::get_allocator_list_if_exists()
-               && tids.find(std::this_thread::get_id()) != tids.end())
-                mad::details::allocator_list_tl::get_allocator_list()
-                        ->Destroy(tids.find(std::this_thread::get_id())->second, 1);
-            //----------------------------------------------------------------//
-            return nullptr;
+            if(!tg || task->group() == tg)
+            {
+                run_nested(task);
+                return true;
+            }
+            _queue->push(task);
+            task = nullptr;
         }
 
-        // get the task
-        task = m_main_tasks.front();
-        m_main_tasks.pop_front();
-        //--------------------------------------------------------------------//
+        if(this_thread_help_depth >= max_help_depth)
+            return false;
 
-        // Unlock
-        m_task_lock.unlock();
         //--------------------------------------------------------------------//
-
-        // execute the task
-        run(task);
+        // work placed for us, from outside the pool or from other workers
+        int _node = m_worker_nodes[_index].load(std::memory_order_relaxed);
+        if(!m_high_tasks.pop(task) && !m_mailboxes[_index]->pop(task) &&
+           !m_node_tasks[_node]->pop(task) && !m_main_tasks.pop(task) &&
+           !steal_task(_index, task) && !m_low_tasks.pop(task))
+            return false;
+    }
+    else
+    {
         //--------------------------------------------------------------------//
+        // not a worker of this pool: no local queue, take what is available
+        if(this_thread_help_depth >= max_help_depth)
+            return false;
+        if(!m_high_tasks.pop(task) && !m_main_tasks.pop(task) &&
+           !steal_task(m_work_queues.size(), task) && !m_low_tasks.pop(task))
+            return false;
+    }
+
+    run_nested(task);
+    return true;
+}
+
+//============================================================================//
+
+void thread_pool::run_nested(vtask*& task)
+{
+    ++this_thread_help_depth;
+    run(task);
+    --this_thread_help_depth;
+}
+
+//============================================================================//
 
+bool thread_pool::has_pending_work() const
+{
+    if(!m_main_tasks.empty() || !m_high_tasks.empty() || !m_low_tasks.empty())
+        return true;
+    size_type _n = m_num_threads.load(std::memory_order_acquire);
+    for(size_type i = 0; i < _n; ++i)
+        if(!m_work_queues[i]->empty() || !m_mailboxes[i]->empty())
+            return true;
+    for(const auto& itr : m_node_tasks)
+        if(!itr->empty())
+            return true;
+    return false;
+}
+
+//============================================================================//
+
+bool thread_pool::steal_task(size_type _index, task_type*& task)
+{
+    // _index may be out of range for threads that are not workers, they
+    // have no node and treat every queue as remote. Retired workers are
+    // still visited for tasks they have not handed off yet
+    size_type _n = m_num_threads.load(std::memory_order_acquire);
+    if(_n == 0)
+        return false;
+    int _node = (_index < _n)
+                ? m_worker_nodes[_index].load(std::memory_order_relaxed) : -1;
+
+    // xorshift -- only needs to be cheap and different per worker
+    ThreadLocalStatic uint32_t _seed = 0;
+    if(_seed == 0)
+        _seed = 2654435761U * (_index + 1);
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+
+    //------------------------------------------------------------------------//
+    // workers of our own node, their data is likely in local memory (or in
+    // a shared cache)
+    size_type _start = _seed % _n;
+    if(_node >= 0)
+    {
+        for(size_type i = 0; i < _n; ++i)
+        {
+            size_type _victim = (_start + i) % _n;
+            if(_victim == _index ||
+               m_worker_nodes[_victim].load(std::memory_order_relaxed) != _node)
+                continue;
+            if(m_work_queues[_victim]->steal(task) ||
+               m_mailboxes[_victim]->pop(task))
+                return true;
+        }
     }
-    return nullptr;
+
+    //------------------------------------------------------------------------//
+    // our node is out of work: cross to the tasks submitted for other nodes,
+    // then to the workers of other nodes
+    size_type _nnodes = m_node_tasks.size();
+    for(size_type i = 0; i < _nnodes; ++i)
+    {
+        size_type _victim = (_start + i) % _nnodes;
+        if((int) _victim != _node && m_node_tasks[_victim]->pop(task))
+            return true;
+    }
+
+    for(size_type i = 0; i < _n; ++i)
+    {
+        size_type _victim = (_start + i) % _n;
+        if(_victim == _index ||
+           m_worker_nodes[_victim].load(std::memory_order_relaxed) == _node)
+            continue;
+        if(m_work_queues[_victim]->steal(task) ||
+           m_mailboxes[_victim]->pop(task))
+            return true;
+    }
+    return false;
+}
+
+//============================================================================//
+
+bool thread_pool::get_task(size_type _index, task_type*& task)
+{
+    //------------------------------------------------------------------------//
+    // starvation protection: on every aging pick the low lane goes first and
+    // the high lane last, so neither lower lane waits forever behind a
+    // steady stream of higher priority work
+    ThreadLocalStatic size_type _picks = 0;
+    bool _aging = (m_priority_aging > 0 && ++_picks >= m_priority_aging);
+    if(_aging)
+    {
+        _picks = 0;
+        if(m_low_tasks.pop(task))
+            return true;
+    }
+    else if(m_high_tasks.pop(task))
+        return true;
+
+    //------------------------------------------------------------------------//
+    // newest task from own queue (LIFO)
+    if(m_work_queues[_index]->pop(task))
+        return true;
+
+    //------------------------------------------------------------------------//
+    // tasks placed for this worker
+    if(m_mailboxes[_index]->pop(task))
+        return true;
+
+    //------------------------------------------------------------------------//
+    // tasks submitted for the NUMA node of this worker
+    if(m_node_tasks[m_worker_nodes[_index].load(std::memory_order_relaxed)]
+            ->pop(task))
+        return true;
+
+    //------------------------------------------------------------------------//
+    // submissions from outside the pool (FIFO)
+    if(m_main_tasks.pop(task))
+        return true;
+
+    //------------------------------------------------------------------------//
+    // oldest task of another worker (FIFO)
+    if(steal_task(_index, task))
+        return true;
+
+    //------------------------------------------------------------------------//
+    // the lane skipped above
+    return (_aging) ? m_high_tasks.pop(task) : m_low_tasks.pop(task);
 }
 
 //============================================================================//
 
-void thread_pool::signal_background(void* ptr)
+void thread_pool::notify_workers(size_type n)
 {
-    if(m_back_tasks.find(ptr) == m_back_tasks.end())
+    // pairs with the fence in wait_for_work: either the sleeper sees the
+    // new task (or the shutdown) or we see the sleeper
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(n == 0 || m_num_sleeping.load() == 0)
         return;
 
-    m_back_lock.lock();
-    m_back_task_to_do = m_back_tasks[ptr];
-    m_back_pointer = ptr;
-    m_back_done.find(ptr)->second = false;
-    m_back_cond.notify_one();
-    m_back_lock.unlock();
+    // wake at most "n" parked workers. Always scanning from the front keeps
+    // the set of busy workers (and their caches) small when load is light
+    size_type _nactive = num_active();
+    for(size_type i = 0; i < _nactive && n > 0; ++i)
+    {
+        if(m_parkers[i]->unpark())
+        {
+            --m_num_sleeping;
+            --n;
+        }
+    }
 }
 
 //============================================================================//
 
-void thread_pool::background_thread()
+void thread_pool::wait_for_work(size_type _index)
 {
-    vtask* task = nullptr;
-    void*  task_key = 0;
+    //------------------------------------------------------------------------//
+    // spin, then yield, while polling for work
+    if(m_idle_policy != idle_policy::passive)
+    {
+        for(size_type i = 0; i < m_spin_count; ++i)
+        {
+            if(m_pool_state == state::STOPPED || has_pending_work() ||
+               _index >= m_num_active.load(std::memory_order_relaxed))
+                return;
+            cpu_relax();
+        }
+
+        do
+        {
+            for(size_type i = 0; i < m_yield_count; ++i)
+            {
+                if(m_pool_state == state::STOPPED || has_pending_work() ||
+                   _index >= m_num_active.load(std::memory_order_relaxed))
+                    return;
+                std::this_thread::yield();
+            }
+        } while(m_idle_policy == idle_policy::active);
+    }
 
-    while(m_pool_state == state::NONINIT)
-        m_back_cond.wait(m_back_lock);
+    //------------------------------------------------------------------------//
+    // park: publish ourselves as a sleeper, then re-check so a task added
+    // in between is not missed (see notify_workers)
+    parker* _parker = m_parkers[_index];
+    _parker->prepare_park();
+    ++m_num_sleeping;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if(m_pool_state == state::STOPPED || has_pending_work() ||
+       _index >= m_num_active.load())
+    {
+        // if someone already unparked us, they also decremented the count
+        if(_parker->cancel_park())
+            --m_num_sleeping;
+        return;
+    }
 
+    _parker->park();
+}
+
+//============================================================================//
+
+void* thread_pool::execute_thread(size_type _index)
+{
+    vtask* task = nullptr;
     while(true)
     {
         //--------------------------------------------------------------------//
-        // Try to pick a task
-        m_back_lock.lock();
-        //--------------------------------------------------------------------//
+        // the pool was shrunk below this worker
+        if(_index >= m_num_active.load(std::memory_order_acquire) &&
+           m_pool_state != state::STOPPED)
+        {
+            retire(_index);
+            continue;
+        }
 
-        // We need to put condition.wait() in a loop for two reasons:
-        // 1. There can be spurious wake-ups (due to signal/ENITR)
-        // 2. When mutex is released for waiting, another thread can be waken up
-        //    from a signal/broadcast and that thread can mess up the condition.
-        //    So when the current thread wakes up the condition may no longer be
-        //    actually true!
-        while ((m_pool_state != state::STOPPED) && !m_back_task_to_do)
+        //--------------------------------------------------------------------//
+        // Try to pick a task
+        if(get_task(_index, task))
         {
-            // Wait until there is a task in the queue
-            // Unlock mutex while wait, then lock it back when signaled
-            m_back_cond.wait(m_back_lock);
+            // execute the task
+            run(task);
+            continue;
         }
+        //--------------------------------------------------------------------//
 
         // If the thread was waked to notify process shutdown, return from here
         if (m_pool_state == state::STOPPED)
         {
-            //m_has_exited.
-            m_back_lock.unlock();
             //----------------------------------------------------------------//
-            if(mad::details::allocator_list::get_allocator_list_if_exists() &&
-               tids.find(std::this_thread::get_id()) != tids.end())
-                mad::details::allocator_list::get_allocator_list()
-                        ->Destroy(tids.find(std::this_thread::get_id())->second, 1);
+            if(mad::details::allocator_list_tl::get_allocator_list_if_exists())
+                mad::details::allocator_list_tl::get_allocator_list()
+                        ->Destroy(_index, 1);
             //----------------------------------------------------------------//
+            return nullptr;
         }
 
-        task_key = m_back_pointer;
-        task = m_back_task_to_do;
-        m_back_task_to_do = nullptr;
-        //--------------------------------------------------------------------//
-        // Unlock
-        m_back_lock.unlock();
+        wait_for_work(_index);
         //--------------------------------------------------------------------//
+    }
+    return nullptr;
+}
 
-        if(!task)
-        {
-            typedef TaskMap_t::iterator _iterator;
-            _iterator itr = m_back_tasks.begin();
-            std::cerr << "Background task has a null pointer. "
-                      << "Num background tasks: "
-                      << m_back_tasks.size()
-                      << " \t " << itr->first
-                      << " \t " << itr->second
-                      << " \t " << task_key
-                      << " \t " << task
-                      << std::endl;
-            continue;
-        }
+//============================================================================//
 
-        // execute the task
-        (*task)();
+void thread_pool::retire(size_type _index)
+{
+    // tasks spawned by the last task of this worker (or placed for it) go
+    // to the injection queue, any active worker picks them up from there
+    size_type _n = 0;
+    task_type* task = nullptr;
+    while(m_work_queues[_index]->pop(task) || m_mailboxes[_index]->pop(task))
+    {
+        m_main_tasks.push(task);
+        ++_n;
+    }
+    notify_workers(_n);
 
-        // notify that it is done
-        m_back_lock.lock();
-        m_back_done.find(task_key)->second = true;
-        m_back_lock.unlock();
+    m_resize_event.await([this, _index] ()
+    {
+        return _index < m_num_active.load() ||
+               m_pool_state == state::STOPPED;
+    });
+}
 
-        task = nullptr;
-        task_key = nullptr;
-        //--------------------------------------------------------------------//
+//============================================================================//
+
+background_future thread_pool::signal_background(void* ptr)
+{
+    background_channel* _channel = nullptr;
+    {
+        mad::auto_lock l(m_back_lock);
+        ChannelMap_t::iterator itr = m_back_channels.find(ptr);
+        if(itr == m_back_channels.end())
+            return background_future();
+        _channel = itr->second;
     }
-    //return nullptr;
+    return m_background->signal(_channel);
+}
+
+//============================================================================//
+
+bool thread_pool::is_done(void* ptr)
+{
+    mad::auto_lock l(m_back_lock);
+    ChannelMap_t::iterator itr = m_back_channels.find(ptr);
+    return (itr == m_back_channels.end()) || itr->second->is_done();
 }
 
 //============================================================================//
@@ -540,16 +913,26 @@ void thread_pool::run(vtask*& task)
 {
     task_group* tg = task->group();
 
-    // execute task
-    (*task)();
-
-    tg->task_count() -= 1;
-    if(tg->task_count().load() < 2)
+    // execute task, unless the group was canceled before it started. An
+    // exception is handed to the group for join() and to the task for its
+    // get(), the worker carries on and the task is counted as done
+    if(tg->is_canceled())
+        task->skip();
+    else
     {
-        tg->join_lock().lock();
-        tg->join_cond().notify_all();
-        tg->join_lock().unlock();
+        try
+        {
+            (*task)();
+        }
+        catch(...)
+        {
+            std::exception_ptr _ptr = std::current_exception();
+            tg->set_exception(_ptr);
+            task->set_exception(_ptr);
+        }
     }
+
+    tg->task_done();
 }
 
 //============================================================================//
@@ -561,79 +944,172 @@ int thread_pool::add_task(vtask* task)
     tmcout << "Adding task..." << std::endl;
 #endif
 
-    if(!is_alive_flag) // if we haven't built thread-pool, just execute
+    if(!m_is_alive) // if we haven't built thread-pool, just execute
     {
         run(task);
         return 0;
     }
 
-    // do outside of lock because is thread-safe and needs to be updated as
-    // soon as possible
-    task->group()->task_count() += 1;
-
-    m_task_lock.lock();
-
     // if the thread pool hasn't been initialize, initialize it
     if(m_pool_state == state::NONINIT)
-        initialize_threadpool();
+    {
+        m_task_lock.lock();
+        if(m_pool_state == state::NONINIT)
+            initialize_threadpool();
+        m_task_lock.unlock();
+    }
 
-    // TODO: put a limit on how many tasks can be added at most
-    m_main_tasks.push_back(task);
+    enqueue(task);
 
     // wake up one thread that is waiting for a task to be available
-    m_task_cond.notify_one();
-
-    m_task_lock.unlock();
+    notify_workers(1);
 
     return 0;
 }
 
 //============================================================================//
 
-int thread_pool::add_background_task(void* ptr, vtask* task)
+int thread_pool::add_bulk_task(vtask* task)
 {
-    thread* tid = new thread();
-    bool _add_thread = true;
-    try
+    if(!m_is_alive) // if we haven't built thread-pool, just execute
     {
-        // assign to core if affinity is set to on
-        *tid = std::thread(thread_pool::start_background, (void*)(this));
-#if defined(ALLOW_AFFINITY)
-        if(m_use_affinity)
-        {
-            static size_type cpu_i = 0;
-            size_type i = (cpu_i++) % std::thread::hardware_concurrency();
-            // Create a cpu_set_t object representing a set of CPUs. Clear it and mark
-            // only CPU i as set.
-            cpu_set_t cpuset;
-            CPU_ZERO(&cpuset);
-            CPU_SET(i, &cpuset);
-            int rc = pthread_setaffinity_np(tid->native_handle(),
-                                            sizeof(cpu_set_t), &cpuset);
-            if (rc != 0)
-                std::cerr << "Error calling pthread_setaffinity_np: " << rc
-                          << std::endl;
-        }
-#endif
-    } catch(std::runtime_error& e)
+        run(task);
+        return 0;
+    }
+
+    if(m_pool_state == state::NONINIT)
     {
-        std::cerr << e.what() << std::endl;
-        _add_thread = false;
-    } catch(std::bad_alloc& e)
+        m_task_lock.lock();
+        if(m_pool_state == state::NONINIT)
+            initialize_threadpool();
+        m_task_lock.unlock();
+    }
+
+    enqueue(task);
+
+    // the workers that join re-queue the task for the next ones, waking
+    // everybody right away saves them the wake-up latency of the chain
+    notify_workers(num_active());
+
+    return 0;
+}
+
+//============================================================================//
+
+int thread_pool::add_task(vtask* task, long_type worker)
+{
+    if(!m_is_alive || worker < 0 || m_pool_state != state::STARTED ||
+       worker >= (long_type) num_active())
+        return add_task(task);
+
+    task->group()->add_pending();
+    m_mailboxes[worker]->push(task);
+
+    // wake the target if it sleeps. If it is busy the task waits for it
+    // (or for a thief, idle workers also steal from mailboxes). If it was
+    // retired in the meantime, someone else has to steal it
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(m_num_sleeping.load() > 0 && m_parkers[worker]->unpark())
+        --m_num_sleeping;
+    else if(worker >= (long_type) m_num_active.load())
+        notify_workers(1);
+
+    return 0;
+}
+
+//============================================================================//
+
+int thread_pool::add_task(vtask* task, task_priority priority)
+{
+    if(!m_is_alive || priority == task_priority::normal)
+        return add_task(task);
+
+    if(m_pool_state == state::NONINIT)
     {
-        std::cerr << e.what() << std::endl;
-        _add_thread = false;
+        m_task_lock.lock();
+        if(m_pool_state == state::NONINIT)
+            initialize_threadpool();
+        m_task_lock.unlock();
     }
 
-    // successful creation, identifiable via pointer
-    if(_add_thread)
+    // the lanes are shared by all workers, also for submissions from a worker,
+    // otherwise a low priority task would be popped (LIFO) before the normal
+    // tasks already in the local queue
+    task->group()->add_pending();
+    if(priority == task_priority::high)
+        m_high_tasks.push(task);
+    else
+        m_low_tasks.push(task);
+
+    notify_workers(1);
+
+    return 0;
+}
+
+//============================================================================//
+
+int thread_pool::add_task(vtask* task, numa_hint hint)
+{
+    if(!m_is_alive || hint.node < 0 || m_pool_state != state::STARTED ||
+       hint.node >= (long) m_node_tasks.size())
+        return add_task(task);
+
+    int _node = hint.node;
+    bool _found = false;
+    size_type _nactive = num_active();
+    for(size_type i = 0; i < _nactive && !_found; ++i)
+        _found = (m_worker_nodes[i].load(std::memory_order_relaxed) == _node);
+    if(!_found)
+        return add_task(task);
+
+    task->group()->add_pending();
+    m_node_tasks[_node]->push(task);
+
+    // wake one sleeping worker of that node. If they are all busy the task
+    // waits for them, or for a worker of another node that ran out of work
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(m_num_sleeping.load() == 0)
+        return 0;
+    for(size_type i = 0; i < _nactive; ++i)
     {
-        m_back_threads.push_back(tid);
-        m_back_tasks[ptr] = task;
-        m_back_done.insert(std::pair<void*, bool>(ptr, true));
+        if(m_worker_nodes[i].load(std::memory_order_relaxed) == _node &&
+           m_parkers[i]->unpark())
+        {
+            --m_num_sleeping;
+            break;
+        }
     }
 
-    return m_back_threads.size();
+    return 0;
+}
+
+//============================================================================//
+
+void thread_pool::enqueue(vtask* task)
+{
+    // do before the task is visible to other threads because is thread-safe
+    // and needs to be updated as soon as possible
+    task->group()->add_pending();
+
+    long_type _index = get_this_thread_index();
+    if(_index < 0)
+        m_main_tasks.push(task);
+    else
+        m_work_queues[_index]->push(task);
+}
+
+//============================================================================//
+
+background_channel* thread_pool::add_background_task(void* ptr, vtask* task)
+{
+    mad::auto_lock l(m_back_lock);
+
+    if(!m_background)
+        m_background = new background_executor(m_background_size);
+
+    background_channel* _channel = m_background->add(task);
+    m_back_channels[ptr] = _channel;
+    return _channel;
 }
 
 //============================================================================//
@@ -662,5 +1138,31 @@ long_type thread_pool::GetEnvNumThreads(long_type _default)
 
 //============================================================================//
 
-} // namespace mad
+idle_policy thread_pool::GetEnvIdlePolicy(idle_policy _default)
+{
+    char* env_policy = getenv("MAD_IDLE_POLICY");
+
+    if(env_policy)
+    {
+        std::string str_policy = std::string(env_policy);
+        for(auto& itr : str_policy)
+            itr = tolower(itr);
+
+        if(str_policy == "passive" || str_policy == "0")
+            return idle_policy::passive;
+        else if(str_policy == "adaptive" || str_policy == "1")
+            return idle_policy::adaptive;
+        else if(str_policy == "active" || str_policy == "2")
+            return idle_policy::active;
+
+        std::cerr << "Warning! Unknown MAD_IDLE_POLICY \"" << env_policy
+                  << "\". Expected one of: passive, adaptive, active"
+                  << std::endl;
+    }
 
+    return _default;
+}
+
+//============================================================================//
+
+} // namespace mad
@@ -39,11 +39,19 @@
 #include "madthreading/threading/threading.hh"
 #include "madthreading/threading/mutex.hh"
 #include "madthreading/threading/condition.hh"
+#include "madthreading/threading/fast_mutex.hh"
 #include "madthreading/allocator/allocator.hh"
 #include "madthreading/atomics/atomic.hh"
 #include "madthreading/threading/task/task_group.hh"
 #include "madthreading/threading/task/task.hh"
 #include "madthreading/threading/task/task_tree.hh"
+#include "madthreading/threading/work_stealing_deque.hh"
+#include "madthreading/threading/mpmc_queue.hh"
+#include "madthreading/threading/slot_array.hh"
+#include "madthreading/threading/parker.hh"
+#include "madthreading/threading/eventcount.hh"
+#include "madthreading/threading/background_executor.hh"
+#include "madthreading/threading/topology.hh"
 #include "madthreading/types.hh"
 
 #include <iostream>
@@ -52,10 +60,50 @@
 #include <map>
 #include <queue>
 #include <stack>
+#include <algorithm>
 
 namespace mad
 {
 
+//----------------------------------------------------------------------------//
+// what an idle worker does when it runs out of tasks
+//  - passive  : go to sleep right away (lowest CPU usage)
+//  - adaptive : spin (with pause), then yield, then go to sleep
+//  - active   : spin, then yield forever (lowest latency, burns the core)
+enum class idle_policy
+{
+    passive,
+    adaptive,
+    active
+};
+
+//----------------------------------------------------------------------------//
+// scheduling lane of a task submitted with add_task(task, priority)
+//  - high   : latency-sensitive work, taken before anything else
+//  - normal : default, the work-stealing path used by add_task(task)
+//  - low    : bulk work that only runs when nothing else is queued
+// Higher lanes are drained first. To keep a saturated pool from starving
+// the lower lanes, every "priority aging" pick a worker visits the lanes
+// from the lowest up (see set_priority_aging)
+enum class task_priority
+{
+    high,
+    normal,
+    low
+};
+
+//----------------------------------------------------------------------------//
+// NUMA node (index in mad::topology) of the memory a task mostly touches,
+// e.g. numa_hint(topology::instance().node_of_address(ptr)). Negative means
+// no preference
+struct numa_hint
+{
+    explicit numa_hint(long _node = -1) : node(_node) { }
+    long node;
+};
+
+//----------------------------------------------------------------------------//
+
 class thread_pool
 {
 public:
@@ -64,19 +112,25 @@ public:
     typedef mad::vtask                                      task_type;
     typedef std::size_t                                     size_type;
     typedef std::vector<std::thread*>                       ThreadContainer_t;
-    typedef std::deque<task_type*, Allocator_t(task_type*)> TaskContainer_t;
+    typedef mpmc_queue<task_type*>                          TaskContainer_t;
+    typedef work_stealing_deque<task_type*>                 WorkQueue_t;
+    typedef slot_array<WorkQueue_t*>                        WorkQueueContainer_t;
+    typedef slot_array<TaskContainer_t*>                    MailboxContainer_t;
+    typedef std::vector<TaskContainer_t*>                   NodeQueueContainer_t;
+    typedef slot_array<parker*>                             ParkerContainer_t;
+    typedef slot_array<std::atomic<int>>                    NodeContainer_t;
     typedef std::vector<bool, Allocator_t(bool)>            JoinContainer_t;
-    typedef mutex                                           Lock_t;
+    typedef fast_mutex                                      Lock_t;
+    typedef mutex                                           BackLock_t;
     typedef ulong_ts                                        task_count_type;
     typedef volatile int                                    pool_state_type;
     typedef mad::condition                                  Condition_t;
-    typedef std::map<void*, task_type*>                     TaskMap_t;
-    typedef std::map<void*, volatile bool>                  JoinMap_t;
+    typedef std::map<void*, background_channel*>            ChannelMap_t;
     typedef std::map<std::thread::id, ulong_type>           tid_type;
 
 public:
     // Constructor and Destructors
-    // affinity assigns threads to certain cores
+    // affinity assigns threads to certain cores (see set_placement)
     explicit thread_pool(bool _use_affinity = false);
     thread_pool(size_type pool_size, bool _use_affinity = false);
     // Virtual destructors are required by abstract classes
@@ -85,12 +139,24 @@ public:
 
 public:
     // Public functions
-    int initialize_threadpool(); // start the threads
+    int initialize_threadpool(); // start the threads (or apply set_size)
     int destroy_threadpool(); // destroy the threads
 
 public:
     // add tasks for threads to process
     int add_task(task_type* task);
+    // add a task for a specific worker (e.g. to replay cache affinity), any
+    // idle worker may still steal it. Negative index -> add_task(task)
+    int add_task(task_type* task, long_type worker);
+    // add a task to one of the priority lanes. Normal -> add_task(task)
+    int add_task(task_type* task, task_priority priority);
+    // add a task for the workers of a NUMA node, workers of other nodes
+    // only take it when their own node has no work left. No worker on that
+    // node -> add_task(task)
+    int add_task(task_type* task, numa_hint hint);
+    // add a task that every worker may take part in (see bulk_task.hh):
+    // one enqueue and one wake-up of all idle workers
+    int add_bulk_task(task_type* task);
     // add tasks quickly
     //int fast_add_tasks(task_type* task);
     // add a generic container with iterator
@@ -109,94 +175,214 @@ public:
 
 public:
     // background tasks are task that you don't call join() on
-    // and are executed several times, e.g. generate random number
-    // task is identified by a unique pointer -- typically
-    // "this" in class method
-    int add_background_task(void*, task_type*);
-    // signal a thread to wake up and execute the task
-    void signal_background(void*);
-    // set the task argument to a value and signal a thread to wake up
-    // and execute
-    template <typename... _Tp>
-    void signal_background(void*, _Tp...);
-    // check is a background task is finished computing
-    volatile bool& is_done(void* ptr) { return m_back_done.find(ptr)->second; }
+    // and are executed several times, e.g. generate random number.
+    // They run on a background_executor with a few dedicated threads
+    // (created on first use) and are identified by a unique pointer --
+    // typically "this" in class method -- or by the returned channel
+    background_channel* add_background_task(void*, task_type*);
+    // execute the task again. The channel version is lock-free, the
+    // pointer version looks the channel up first
+    background_future signal_background(background_channel* _channel)
+    { return m_background->signal(_channel); }
+    background_future signal_background(void*);
+    // check if all signals of a background task have been executed
+    bool is_done(void*);
+    // number of background threads, only has an effect before the first
+    // background task is added
+    void set_background_size(size_type _n) { m_background_size = _n; }
     // get the pool state
     const pool_state_type& state() const { return m_pool_state; }
+    // index of calling thread in this pool (-1 if not a worker of this pool)
+    long_type get_this_thread_index() const;
+    // run one queued task on the calling thread, used by task_group::join
+    // to help instead of blocking. A worker prefers tasks of "tg" from its
+    // own queue, past a nesting depth of helping joins it only runs those.
+    // Returns false if no task was found
+    bool run_pending_task(task_group* tg = nullptr);
 
 public:
     // see how many main task threads there are
     size_type size() const { return m_pool_size; }
-    // set the thread pool size
-    void set_size(size_type _n) { m_pool_size = _n; }
+    // set the thread pool size. A running pool is resized in place, also
+    // with tasks in flight: surplus workers hand their queued tasks to the
+    // others and sleep until the pool grows again, growing wakes them
+    // before spawning only the missing threads (and adding their slots)
+    void set_size(size_type _n);
+    // number of worker slots of the running pool, one for every thread
+    // started so far
+    size_type capacity() const { return m_work_queues.size(); }
     // affinity assigns threads to cores, only affects threads when
-    // first initialized
+    // first initialized. Same as placement_policy::one_per_core unless
+    // another placement policy is set
     void use_affinity(bool _val) { m_use_affinity = _val; }
+    // bind the workers to CPUs according to the topology of the machine,
+    // applied right away if the threads are running
+    void set_placement(placement_policy _val);
+    placement_policy get_placement() const { return m_placement; }
+    // NUMA node of every worker, taken from the placement policy (0 for
+    // unbound workers). Can be set for workers bound by other means, e.g.
+    // OpenMP places, while the threads are running. Node indices must be
+    // smaller than max(size(), number of nodes)
+    void set_worker_nodes(const std::vector<int>&);
+    int get_worker_node(size_type _index) const
+    { return m_worker_nodes.at(_index).load(std::memory_order_relaxed); }
+    // behavior of workers without tasks, can be changed at any time
+    void set_idle_policy(idle_policy _val) { m_idle_policy = _val; }
+    idle_policy get_idle_policy() const { return m_idle_policy; }
+    // number of pause/yield iterations before an idle worker goes to sleep
+    void set_spin_count(size_type _val) { m_spin_count = _val; }
+    void set_yield_count(size_type _val) { m_yield_count = _val; }
+    // number of parked workers, approximate while workers come and go
+    size_type num_sleeping() const
+    { return std::max<long_type>(m_num_sleeping.load(), 0); }
+    // every n-th task a worker picks is searched for from the lowest lane
+    // up so background work keeps making progress (0 = strict priority)
+    void set_priority_aging(size_type _val) { m_priority_aging = _val; }
+    size_type get_priority_aging() const { return m_priority_aging; }
 
 public:
     // read FORCE_NUM_THREADS environment variable
     static long_type GetEnvNumThreads(long_type _default = -1);
-    static const tid_type& GetThreadIDs() { return tids; }
-    static volatile bool& is_alive() { return is_alive_flag; }
+    // read MAD_PLACEMENT environment variable (see topology.hh)
+    static placement_policy GetEnvPlacement(placement_policy _default =
+                                            placement_policy::none)
+    { return topology::GetEnvPlacement(_default); }
+    // read MAD_IDLE_POLICY environment variable (passive, adaptive, active)
+    static idle_policy GetEnvIdlePolicy(idle_policy _default =
+                                        idle_policy::adaptive);
+    // worker index of the calling thread in its pool, -1 if it is not a
+    // worker of any pool. Thread-local, no lock
+    static long_type GetThisThreadID();
+    // copy of the thread id -> worker index map of this pool
+    tid_type GetThreadIDs() const;
+    // the threads of this pool are running
+    bool is_alive() const { return m_is_alive.load(); }
 
 protected:
-    void* execute_thread(); // function thread sits in
-    void  background_thread(); // function background threads sit in
+    void* execute_thread(size_type); // function thread sits in
     void  run(task_type*&);
+    // run() on behalf of a join, counts the nesting of helping joins
+    void  run_nested(task_type*&);
     bool  is_initialized() const;
 
+protected:
+    // places a task in the local work queue when called from a worker,
+    // otherwise in the shared (injection) queue. Does not wake anyone
+    void  enqueue(task_type*);
+    // wake up to "n" sleeping workers
+    void  notify_workers(size_type n);
+    // high lane -> local pop -> mailbox -> node queue -> injection queue ->
+    // steal -> low lane, with the lanes reversed on every priority aging pick
+    bool  get_task(size_type, task_type*&);
+    // attempt to steal from other workers, starting at a random victim.
+    // Workers of the same NUMA node first, then the queues and workers of
+    // the other nodes
+    bool  steal_task(size_type, task_type*&);
+    // approximate check for any queued work
+    bool  has_pending_work() const;
+    // spin/yield/park according to the idle policy until there might be work
+    void  wait_for_work(size_type);
+    // bind the workers according to the placement policy (or affinity)
+    void  apply_placement();
+    // start threads for the slots up to _n, returns the number of threads
+    size_type spawn_workers(size_type _n);
+    // a worker beyond the pool size: give away the queued tasks and sleep
+    // until the pool grows or stops
+    void  retire(size_type);
+    // workers with an index below are taking tasks
+    size_type num_active() const
+    {
+        return std::min(m_num_active.load(std::memory_order_acquire),
+                        m_num_threads.load(std::memory_order_acquire));
+    }
+
 protected:
     // called in THREAD INIT
-    static void* start_thread(void* arg);
-    static void* start_background(void* arg);
+    static void* start_thread(void* arg, size_type _index);
 
 private:
     // Private variables
     // random
     bool m_use_affinity;
+    placement_policy m_placement;
+    bool m_is_placed;
     size_type m_pool_size;
     pool_state_type m_pool_state;
 
     // locks
     Lock_t m_task_lock;
-    Lock_t m_back_lock;
-
-    // conditions
-    Condition_t m_task_cond;
-    Condition_t m_back_cond;
+    BackLock_t m_back_lock;
 
     // containers
     ThreadContainer_t m_main_threads;   // storage for threads
-    ThreadContainer_t m_back_threads;
-    TaskContainer_t   m_main_tasks;     // storage for tasks
+    TaskContainer_t   m_main_tasks;     // tasks from non-pool threads
+    TaskContainer_t   m_high_tasks;     // task_priority::high lane
+    TaskContainer_t   m_low_tasks;      // task_priority::low lane
+    WorkQueueContainer_t m_work_queues; // one work-stealing deque per worker
+    MailboxContainer_t m_mailboxes;     // tasks placed for a specific worker
+    NodeQueueContainer_t m_node_tasks;  // tasks for the workers of a node
+    NodeContainer_t   m_worker_nodes;   // NUMA node of every worker
+    ParkerContainer_t m_parkers;        // one sleep slot per worker
     JoinContainer_t   m_is_joined;
-    JoinMap_t         m_back_done;
 
     // background
-    void*             m_back_pointer;
-    task_type*        m_back_task_to_do;
-    TaskMap_t         m_back_tasks;
-
-    static tid_type tids;
-    static volatile bool is_alive_flag;
+    size_type            m_background_size;
+    background_executor* m_background;
+    ChannelMap_t         m_back_channels;
+
+    // idle behavior
+    idle_policy       m_idle_policy;
+    size_type         m_spin_count;
+    size_type         m_yield_count;
+    size_type         m_priority_aging;
+
+    // number of parked workers
+    std::atomic<long_type> m_num_sleeping;
+
+    // elastic size: slots [0, m_num_threads) have a thread, the workers
+    // [m_num_active, m_num_threads) are retired
+    std::atomic<size_type> m_num_threads;
+    std::atomic<size_type> m_num_active;
+    eventcount             m_resize_event;
+
+    // per pool, several pools may run side by side
+    std::atomic<bool>      m_is_alive;
+    mutable mutex          m_tid_lock;
+    tid_type               m_tids;
 
 private:
     thread_pool(const thread_pool&)
     : m_use_affinity(false),
+      m_placement(placement_policy::none),
+      m_is_placed(false),
       m_pool_size(0),
       m_pool_state(0),
-      m_task_lock(), // recursive
+      m_task_lock(),
       m_back_lock(),
-      m_task_cond(),
-      m_back_cond(),
       m_main_threads(ThreadContainer_t()),
-      m_back_threads(ThreadContainer_t()),
-      m_main_tasks(TaskContainer_t()),
+      m_main_tasks(),
+      m_high_tasks(),
+      m_low_tasks(),
+      m_work_queues(),
+      m_mailboxes(),
+      m_node_tasks(NodeQueueContainer_t()),
+      m_worker_nodes(),
+      m_parkers(),
       m_is_joined(JoinContainer_t()),
-      m_back_done(JoinMap_t()),
-      m_back_pointer(nullptr),
-      m_back_task_to_do(nullptr),
-      m_back_tasks(TaskMap_t())
+      m_background_size(0),
+      m_background(nullptr),
+      m_back_channels(ChannelMap_t()),
+      m_idle_policy(idle_policy::adaptive),
+      m_spin_count(0),
+      m_yield_count(0),
+      m_priority_aging(0),
+      m_num_sleeping(0),
+      m_num_threads(0),
+      m_num_active(0),
+      m_resize_event(),
+      m_is_alive(false),
+      m_tid_lock(),
+      m_tids()
     { }
 
     thread_pool& operator=(const thread_pool&) { return *this; }
@@ -210,39 +396,34 @@ template <typename Container_t>
 int thread_pool::add_tasks(Container_t& c)
 {
 
-    if(!is_alive_flag) // if we haven't built thread-pool, just execute
+    if(!m_is_alive) // if we haven't built thread-pool, just execute
     {
         for(auto& itr : c)
             run(itr);
         return 0;
     }
 
-    m_task_lock.lock();
-
     // if the thread pool hasn't been initialize, initialize it
     if(!is_initialized())
-        initialize_threadpool();
-
-    // TODO: put a limit on how many tasks can be added at most
-    for(auto& itr : c)
     {
-        itr->group()->task_count() += 1;
-        m_main_tasks.push_back(std::move(itr));
+        m_task_lock.lock();
+        if(!is_initialized())
+            initialize_threadpool();
+        m_task_lock.unlock();
     }
-    c.clear();
 
-    // wake up one thread that is waiting for a task to be available
-    if(c.size() < this->size())
+    size_type _n = 0;
+    for(auto& itr : c)
     {
-        for(size_type i = 0; i < c.size(); ++i)
-            m_task_cond.notify_one();
+        enqueue(itr);
+        ++_n;
     }
-    else
-        m_task_cond.notify_all();
+    c.clear();
 
-    m_task_lock.unlock();
+    // wake up as many threads as there are tasks available, once
+    notify_workers(_n);
 
-    return c.size();
+    return _n;
 }
 //----------------------------------------------------------------------------//
 template <typename _Tp>
@@ -275,7 +456,7 @@ template <typename _Tp, typename _A1, typename _A2, typename _TpJ>
 int thread_pool::add_tasks(task_tree_node<_Tp, _A1, _A2, _TpJ>* node)
 {
     // if we haven't built thread-pool, just execute
-    if(!is_alive_flag)
+    if(!m_is_alive)
     {
         if(node->left())
             add_tasks(node->left());
@@ -290,45 +471,14 @@ int thread_pool::add_tasks(task_tree_node<_Tp, _A1, _A2, _TpJ>* node)
     if(node->left())
         add_tasks(node->left());
 
-    // do outside of lock because is thread-safe and needs to be updated as
-    // soon as possible
-    node->group()->task_count() += 1;
-
-    m_task_lock.lock();
-    // if the thread pool hasn't been initialize, initialize it
-    if(!is_initialized())
-        initialize_threadpool();
-
-    m_main_tasks.push_back(node);
-    m_task_lock.unlock();
+    add_task(node);
 
     if(node->right())
         add_tasks(node->right());
 
-    m_task_cond.notify_all();
-
     return 1;
 }
 //----------------------------------------------------------------------------//
-template <typename... _Tp>
-void thread_pool::signal_background(void* ptr, _Tp... _args)
-{
-    if(m_back_tasks.find(ptr) == m_back_tasks.end())
-        return;
-        //throw std::runtime_error("invalid signal to background task");
-
-    // acquire lock, assign task-to-do, signal a thread to wake up.
-    // thread just woken up will acquire lock, get pointer value of
-    // task-to-do, and then set task-to-do pointer to nullptr
-    m_back_lock.lock();
-    m_back_task_to_do = m_back_tasks[ptr];
-    m_back_task_to_do->set(_args...);
-    m_back_pointer = ptr;
-    m_back_done[ptr] = false;
-    m_back_cond.notify_one();
-    m_back_lock.unlock();
-}
-//----------------------------------------------------------------------------//
 
 } // namespace mad
 
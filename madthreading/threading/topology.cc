@@ -0,0 +1,431 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#include "madthreading/threading/topology.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdlib>
+#include <cctype>
+#include <cerrno>
+
+#if !defined(WIN32) && !defined(__MACH__)
+#define ALLOW_AFFINITY
+#   include <pthread.h>
+#   include <sched.h>
+#endif
+
+#if defined(__linux__)
+#   include <unistd.h>
+#   include <sys/syscall.h>
+#endif
+
+namespace mad
+{
+
+//============================================================================//
+
+static bool read_line(const std::string& _path, std::string& _line)
+{
+    std::ifstream _ifs(_path.c_str());
+    return _ifs && std::getline(_ifs, _line);
+}
+
+//============================================================================//
+
+static int read_int(const std::string& _path, int _default)
+{
+    std::string _line;
+    if(!read_line(_path, _line))
+        return _default;
+    std::istringstream iss(_line);
+    int _val = _default;
+    iss >> _val;
+    return (iss) ? _val : _default;
+}
+
+//============================================================================//
+
+topology::topology()
+{
+    discover("/sys/devices/system", process_cpus());
+}
+
+//============================================================================//
+
+topology::topology(const std::string& _root, const cpu_list_t& _mask)
+{
+    discover(_root, _mask);
+}
+
+//============================================================================//
+
+const topology& topology::instance()
+{
+    static topology _instance;
+    return _instance;
+}
+
+//============================================================================//
+
+void topology::discover(const std::string& _root, const cpu_list_t& _mask)
+{
+    //------------------------------------------------------------------------//
+    // online CPUs that the process may use
+    std::string _line;
+    cpu_list_t _cpus;
+    if(read_line(_root + "/cpu/online", _line))
+        _cpus = parse_cpu_list(_line);
+    if(_cpus.empty())
+        for(unsigned i = 0; i < std::max(std::thread::hardware_concurrency(),
+                                         1U); ++i)
+            _cpus.push_back(i);
+
+    if(!_mask.empty())
+    {
+        cpu_list_t _allowed;
+        for(auto& itr : _cpus)
+            if(std::find(_mask.begin(), _mask.end(), itr) != _mask.end())
+                _allowed.push_back(itr);
+        // the mask is authoritative if sysfs does not know its CPUs
+        _cpus = (_allowed.empty()) ? _mask : _allowed;
+    }
+
+    //------------------------------------------------------------------------//
+    // NUMA node of every CPU
+    cpu_list_t _node_ids;
+    std::vector<int> _cpu_node;
+    if(read_line(_root + "/node/online", _line))
+        _node_ids = parse_cpu_list(_line);
+    for(auto& nitr : _node_ids)
+    {
+        std::stringstream ss;
+        ss << _root << "/node/node" << nitr << "/cpulist";
+        if(!read_line(ss.str(), _line))
+            continue;
+        for(auto& citr : parse_cpu_list(_line))
+        {
+            if(citr >= (int) _cpu_node.size())
+                _cpu_node.resize(citr + 1, 0);
+            _cpu_node[citr] = nitr;
+        }
+    }
+
+    //------------------------------------------------------------------------//
+    // physical core of every CPU: (node, package, core_id, cpu)
+    struct raw_cpu { int node, package, core, id; };
+    std::vector<raw_cpu> _raw;
+    for(auto& itr : _cpus)
+    {
+        std::stringstream ss;
+        ss << _root << "/cpu/cpu" << itr << "/topology/";
+        raw_cpu _cpu;
+        _cpu.node = (itr < (int) _cpu_node.size()) ? _cpu_node[itr] : 0;
+        _cpu.package = read_int(ss.str() + "physical_package_id", 0);
+        _cpu.core = read_int(ss.str() + "core_id", itr);
+        _cpu.id = itr;
+        _raw.push_back(_cpu);
+    }
+    std::sort(_raw.begin(), _raw.end(),
+              [] (const raw_cpu& lhs, const raw_cpu& rhs)
+    {
+        if(lhs.node != rhs.node)
+            return lhs.node < rhs.node;
+        if(lhs.package != rhs.package)
+            return lhs.package < rhs.package;
+        if(lhs.core != rhs.core)
+            return lhs.core < rhs.core;
+        return lhs.id < rhs.id;
+    });
+
+    //------------------------------------------------------------------------//
+    // dense indices
+    m_cpus.clear();
+    m_cores.clear();
+    m_nodes.clear();
+    m_node_ids.clear();
+    for(size_type i = 0; i < _raw.size(); ++i)
+    {
+        bool _new_node = (i == 0 || _raw[i].node != _raw[i-1].node);
+        bool _new_core = (_new_node || _raw[i].package != _raw[i-1].package ||
+                          _raw[i].core != _raw[i-1].core);
+        if(_new_node)
+        {
+            m_nodes.push_back(cpu_list_t());
+            m_node_ids.push_back(_raw[i].node);
+        }
+        if(_new_core)
+            m_cores.push_back(cpu_list_t());
+
+        cpu_info _info;
+        _info.id = _raw[i].id;
+        _info.core = m_cores.size() - 1;
+        _info.node = m_nodes.size() - 1;
+        _info.smt = m_cores.back().size();
+        m_cpus.push_back(_info);
+        m_cores.back().push_back(_info.id);
+        m_nodes.back().push_back(_info.id);
+    }
+
+    for(auto& itr : m_nodes)
+        std::sort(itr.begin(), itr.end());
+}
+
+//============================================================================//
+
+int topology::node_of(int _cpu) const
+{
+    for(auto& itr : m_cpus)
+        if(itr.id == _cpu)
+            return itr.node;
+    return -1;
+}
+
+//============================================================================//
+
+int topology::node_of_address(const void* _ptr) const
+{
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+    // get_mempolicy(MPOL_F_NODE | MPOL_F_ADDR): node of the page at _ptr,
+    // called directly to not depend on libnuma
+    static const unsigned long _mpol_f_node = 1;
+    static const unsigned long _mpol_f_addr = 2;
+    int _id = -1;
+    if(syscall(SYS_get_mempolicy, &_id, nullptr, 0UL, _ptr,
+               _mpol_f_node | _mpol_f_addr) != 0)
+        return -1;
+    for(size_type i = 0; i < m_node_ids.size(); ++i)
+        if(m_node_ids[i] == _id)
+            return i;
+#else
+    (void) _ptr;
+#endif
+    return -1;
+}
+
+//============================================================================//
+
+std::vector<topology::cpu_list_t>
+topology::placement(placement_policy _policy, size_type _n) const
+{
+    std::vector<cpu_list_t> _sets(_n);
+    if(m_cpus.empty())
+        return _sets;
+
+    switch(_policy)
+    {
+        case placement_policy::none:
+            break;
+        //--------------------------------------------------------------------//
+        case placement_policy::compact:
+            for(size_type i = 0; i < _n; ++i)
+                _sets[i].push_back(m_cpus[i % m_cpus.size()].id);
+            break;
+        //--------------------------------------------------------------------//
+        case placement_policy::scatter:
+        {
+            // cores of every node, then take SMT level by SMT level one core
+            // of each node at a time
+            std::vector<std::vector<size_type>> _node_cores(m_nodes.size());
+            size_type _max_smt = 0;
+            for(auto& itr : m_cpus)
+            {
+                std::vector<size_type>& _cores = _node_cores[itr.node];
+                if(_cores.empty() || _cores.back() != (size_type) itr.core)
+                    _cores.push_back(itr.core);
+                _max_smt = std::max(_max_smt, (size_type) itr.smt + 1);
+            }
+            size_type _max_cores = 0;
+            for(auto& itr : _node_cores)
+                _max_cores = std::max(_max_cores, itr.size());
+
+            cpu_list_t _order;
+            for(size_type s = 0; s < _max_smt; ++s)
+                for(size_type c = 0; c < _max_cores; ++c)
+                    for(auto& itr : _node_cores)
+                        if(c < itr.size() && s < m_cores[itr[c]].size())
+                            _order.push_back(m_cores[itr[c]][s]);
+
+            for(size_type i = 0; i < _n; ++i)
+                _sets[i].push_back(_order[i % _order.size()]);
+            break;
+        }
+        //--------------------------------------------------------------------//
+        case placement_policy::one_per_core:
+            for(size_type i = 0; i < _n; ++i)
+                _sets[i] = m_cores[i % m_cores.size()];
+            break;
+        //--------------------------------------------------------------------//
+        case placement_policy::per_numa_node:
+            for(size_type i = 0; i < _n; ++i)
+                _sets[i] = m_nodes[(i * m_nodes.size()) / _n];
+            break;
+    }
+
+    return _sets;
+}
+
+//============================================================================//
+
+topology::cpu_list_t topology::parse_cpu_list(const std::string& _str)
+{
+    cpu_list_t _cpus;
+    std::stringstream ss(_str);
+    std::string _range;
+    while(std::getline(ss, _range, ','))
+    {
+        if(_range.empty() || !isdigit(_range[0]))
+            continue;
+        std::string::size_type _dash = _range.find('-');
+        int _first = atoi(_range.c_str());
+        int _last = (_dash == std::string::npos)
+                    ? _first : atoi(_range.c_str() + _dash + 1);
+        for(int i = _first; i <= _last; ++i)
+            _cpus.push_back(i);
+    }
+    return _cpus;
+}
+
+//============================================================================//
+
+topology::cpu_list_t topology::process_cpus()
+{
+    cpu_list_t _cpus;
+#if defined(ALLOW_AFFINITY)
+    cpu_set_t _set;
+    CPU_ZERO(&_set);
+    if(sched_getaffinity(0, sizeof(cpu_set_t), &_set) == 0)
+    {
+        for(int i = 0; i < CPU_SETSIZE; ++i)
+            if(CPU_ISSET(i, &_set))
+                _cpus.push_back(i);
+    }
+#   if defined(CPU_ALLOC)
+    // EINVAL: the kernel mask is larger than cpu_set_t (more than
+    // CPU_SETSIZE CPUs configured), retry with growing dynamic sets
+    else if(errno == EINVAL)
+    {
+        for(int _n = 2 * CPU_SETSIZE; _n <= (1 << 20); _n *= 2)
+        {
+            cpu_set_t* _dyn = CPU_ALLOC(_n);
+            if(!_dyn)
+                break;
+            std::size_t _size = CPU_ALLOC_SIZE(_n);
+            CPU_ZERO_S(_size, _dyn);
+            int _ret = sched_getaffinity(0, _size, _dyn);
+            int _err = errno;
+            if(_ret == 0)
+                for(int i = 0; i < _n; ++i)
+                    if(CPU_ISSET_S(i, _size, _dyn))
+                        _cpus.push_back(i);
+            CPU_FREE(_dyn);
+            if(_ret == 0 || _err != EINVAL)
+                break;
+        }
+    }
+#   endif
+#endif
+    return _cpus;
+}
+
+//============================================================================//
+
+int topology::bind(std::thread& _thread, const cpu_list_t& _cpus)
+{
+#if defined(ALLOW_AFFINITY)
+    cpu_list_t _ids = _cpus;
+    if(_ids.empty())
+        for(auto& itr : instance().cpus())
+            _ids.push_back(itr.id);
+
+#   if defined(CPU_ALLOC)
+    // sized for the largest id, cpu_set_t only holds CPU_SETSIZE CPUs
+    int _n = CPU_SETSIZE;
+    for(auto& itr : _ids)
+        _n = std::max(_n, itr + 1);
+    cpu_set_t* _set = CPU_ALLOC(_n);
+    if(!_set)
+        return ENOMEM;
+    std::size_t _size = CPU_ALLOC_SIZE(_n);
+    CPU_ZERO_S(_size, _set);
+    for(auto& itr : _ids)
+        if(itr >= 0 && itr < _n)
+            CPU_SET_S(itr, _size, _set);
+    int _ret = pthread_setaffinity_np(_thread.native_handle(), _size, _set);
+    CPU_FREE(_set);
+    return _ret;
+#   else
+    cpu_set_t _set;
+    CPU_ZERO(&_set);
+    for(auto& itr : _ids)
+        if(itr >= 0 && itr < CPU_SETSIZE)
+            CPU_SET(itr, &_set);
+    return pthread_setaffinity_np(_thread.native_handle(), sizeof(cpu_set_t),
+                                  &_set);
+#   endif
+#else
+    (void) _thread;
+    (void) _cpus;
+    return 0;
+#endif
+}
+
+//============================================================================//
+
+placement_policy topology::GetEnvPlacement(placement_policy _default)
+{
+    char* env_policy = getenv("MAD_PLACEMENT");
+
+    if(env_policy)
+    {
+        std::string str_policy = std::string(env_policy);
+        for(auto& itr : str_policy)
+            itr = tolower(itr);
+
+        if(str_policy == "none" || str_policy == "0")
+            return placement_policy::none;
+        else if(str_policy == "compact" || str_policy == "1")
+            return placement_policy::compact;
+        else if(str_policy == "scatter" || str_policy == "2")
+            return placement_policy::scatter;
+        else if(str_policy == "core" || str_policy == "one_per_core" ||
+                str_policy == "3")
+            return placement_policy::one_per_core;
+        else if(str_policy == "numa" || str_policy == "per_numa_node" ||
+                str_policy == "4")
+            return placement_policy::per_numa_node;
+
+        std::cerr << "Warning! Unknown MAD_PLACEMENT \"" << env_policy
+                  << "\". Expected one of: none, compact, scatter, core, numa"
+                  << std::endl;
+    }
+
+    return _default;
+}
+
+//============================================================================//
+
+} // namespace mad
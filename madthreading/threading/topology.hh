@@ -0,0 +1,142 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#ifndef topology_hh_
+#define topology_hh_
+
+//----------------------------------------------------------------------------//
+// CPU topology of the machine and placement of threads on it
+//
+//  - logical CPUs, physical cores (SMT siblings) and NUMA nodes are read from
+//    /sys/devices/system/{cpu,node} (Linux). Without sysfs every CPU is its
+//    own core on node 0
+//  - only the CPUs of the process affinity mask (sched_getaffinity) are
+//    used, i.e. the CPUs left by taskset, cgroup cpusets and containers
+//
+// Placement policies, CPU set of worker i of n:
+//  - none          : not bound
+//  - compact       : one logical CPU, filling the SMT siblings of a core,
+//                    then the next core of the same node
+//  - scatter       : one logical CPU, round-robin over the nodes, then the
+//                    cores of a node, SMT siblings only when every core is
+//                    used
+//  - one_per_core  : all SMT siblings of core i (cores ordered by node)
+//  - per_numa_node : all CPUs of a node, consecutive workers share a node
+// Workers wrap around when there are more workers than CPUs (cores, nodes).
+//----------------------------------------------------------------------------//
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <cstddef>
+
+namespace mad
+{
+
+//----------------------------------------------------------------------------//
+
+enum class placement_policy
+{
+    none,
+    compact,
+    scatter,
+    one_per_core,
+    per_numa_node
+};
+
+//----------------------------------------------------------------------------//
+
+class topology
+{
+public:
+    typedef std::size_t                 size_type;
+    typedef std::vector<int>            cpu_list_t;
+
+    struct cpu_info
+    {
+        int id;         // logical CPU, as in cpuN and sched_setaffinity
+        int core;       // index of the physical core (0 .. num_cores-1)
+        int node;       // index of the NUMA node (0 .. num_nodes-1)
+        int smt;        // index among the SMT siblings of the core
+    };
+
+public:
+    // topology of this machine, restricted to the process affinity mask
+    topology();
+    // read the sysfs tree below "_root" (normally /sys/devices/system),
+    // restricted to "_mask" unless it is empty
+    topology(const std::string& _root, const cpu_list_t& _mask);
+
+    // discovered once, on first use
+    static const topology& instance();
+
+public:
+    // ordered by node, core and SMT index
+    const std::vector<cpu_info>& cpus() const { return m_cpus; }
+    size_type num_cpus() const { return m_cpus.size(); }
+    size_type num_cores() const { return m_cores.size(); }
+    size_type num_nodes() const { return m_nodes.size(); }
+    // logical CPUs of a core or of a node (ascending)
+    const cpu_list_t& core_cpus(size_type _core) const
+    { return m_cores.at(_core); }
+    const cpu_list_t& node_cpus(size_type _node) const
+    { return m_nodes.at(_node); }
+    // node index of a logical CPU, -1 if not in the topology
+    int node_of(int _cpu) const;
+    // node index of the memory page holding "_ptr", -1 if unknown. Only
+    // meaningful after the first touch: the query itself touches the page
+    int node_of_address(const void* _ptr) const;
+    // operating system id of a node index (the N in /sys/.../nodeN)
+    int node_id(size_type _node) const { return m_node_ids.at(_node); }
+
+    // CPU set of each of "_n" workers, empty sets for placement_policy::none
+    std::vector<cpu_list_t> placement(placement_policy, size_type _n) const;
+
+public:
+    // parse a sysfs CPU list, e.g. "0-3,8,10-11"
+    static cpu_list_t parse_cpu_list(const std::string&);
+    // CPUs of the process affinity mask, empty if unknown
+    static cpu_list_t process_cpus();
+    // restrict "_thread" to "_cpus" (the process mask if empty), returns
+    // the error code of pthread_setaffinity_np (0 on success)
+    static int bind(std::thread& _thread, const cpu_list_t& _cpus);
+    // read MAD_PLACEMENT (none, compact, scatter, core, numa)
+    static placement_policy GetEnvPlacement(placement_policy _default =
+                                            placement_policy::none);
+
+private:
+    void discover(const std::string& _root, const cpu_list_t& _mask);
+
+private:
+    std::vector<cpu_info>   m_cpus;
+    std::vector<cpu_list_t> m_cores;
+    std::vector<cpu_list_t> m_nodes;
+    cpu_list_t              m_node_ids;
+};
+
+//----------------------------------------------------------------------------//
+
+} // namespace mad
+
+#endif
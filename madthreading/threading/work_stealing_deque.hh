@@ -0,0 +1,203 @@
+// MIT License
+//
+// Copyright (c) 2017 Jonathan R. Madsen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef work_stealing_deque_hh_
+#define work_stealing_deque_hh_
+
+//----------------------------------------------------------------------------//
+// Chase-Lev work-stealing deque (with the C11 memory orderings of
+// Le, Pop, Cohen and Zappa Nardelli, PPoPP 2013).
+//
+//  - push/pop are only called by the owning thread and operate on the
+//    "bottom" (LIFO, keeps the most recently spawned task hot in cache)
+//  - steal may be called by any thread and operates on the "top" (FIFO,
+//    thieves take the oldest, typically largest, piece of work)
+//
+// The circular buffer grows when full. Old buffers are kept until the deque
+// is destroyed since a thief may still be reading from them.
+//----------------------------------------------------------------------------//
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace mad
+{
+
+//============================================================================//
+
+template <typename _Tp>
+class work_stealing_deque
+{
+public:
+    typedef _Tp             value_type;
+    typedef int64_t         index_type;
+    typedef std::size_t     size_type;
+
+protected:
+    //------------------------------------------------------------------------//
+    class circular_array
+    {
+    public:
+        explicit circular_array(index_type _log_size)
+        : m_log_size(_log_size),
+          m_buffer(new std::atomic<_Tp>[size_type(1) << _log_size])
+        { }
+
+        ~circular_array() { delete [] m_buffer; }
+
+        index_type capacity() const { return index_type(1) << m_log_size; }
+
+        _Tp get(index_type i) const
+        {
+            return m_buffer[i & (capacity()-1)]
+                    .load(std::memory_order_relaxed);
+        }
+
+        void put(index_type i, _Tp x)
+        {
+            m_buffer[i & (capacity()-1)].store(x, std::memory_order_relaxed);
+        }
+
+        circular_array* grow(index_type _bottom, index_type _top) const
+        {
+            circular_array* _new = new circular_array(m_log_size + 1);
+            for(index_type i = _top; i < _bottom; ++i)
+                _new->put(i, get(i));
+            return _new;
+        }
+
+    private:
+        index_type          m_log_size;
+        std::atomic<_Tp>*   m_buffer;
+
+    private:
+        circular_array(const circular_array&);
+        circular_array& operator=(const circular_array&);
+    };
+    //------------------------------------------------------------------------//
+
+public:
+    explicit work_stealing_deque(index_type _log_size = 8)
+    : m_top(0), m_bottom(0), m_array(new circular_array(_log_size))
+    { }
+
+    ~work_stealing_deque()
+    {
+        delete m_array.load(std::memory_order_relaxed);
+        for(auto& itr : m_garbage)
+            delete itr;
+    }
+
+public:
+    //------------------------------------------------------------------------//
+    // owner only
+    void push(_Tp x)
+    {
+        index_type b = m_bottom.load(std::memory_order_relaxed);
+        index_type t = m_top.load(std::memory_order_acquire);
+        circular_array* a = m_array.load(std::memory_order_relaxed);
+        if(b - t > a->capacity() - 1)
+        {
+            m_garbage.push_back(a);
+            a = a->grow(b, t);
+            m_array.store(a, std::memory_order_release);
+        }
+        a->put(b, x);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    //------------------------------------------------------------------------//
+    // owner only
+    bool pop(_Tp& x)
+    {
+        index_type b = m_bottom.load(std::memory_order_relaxed) - 1;
+        circular_array* a = m_array.load(std::memory_order_relaxed);
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        index_type t = m_top.load(std::memory_order_relaxed);
+
+        if(t > b)
+        {
+            // empty
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        x = a->get(b);
+        if(t == b)
+        {
+            // last element, race against thieves
+            bool _won = m_top.compare_exchange_strong(t, t + 1,
+                                                     std::memory_order_seq_cst,
+                                                     std::memory_order_relaxed);
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return _won;
+        }
+        return true;
+    }
+    //------------------------------------------------------------------------//
+    // any thread
+    bool steal(_Tp& x)
+    {
+        index_type t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        index_type b = m_bottom.load(std::memory_order_acquire);
+
+        if(t >= b)
+            return false;
+
+        circular_array* a = m_array.load(std::memory_order_acquire);
+        x = a->get(t);
+        return m_top.compare_exchange_strong(t, t + 1,
+                                             std::memory_order_seq_cst,
+                                             std::memory_order_relaxed);
+    }
+    //------------------------------------------------------------------------//
+    // approximate when called concurrently
+    size_type size() const
+    {
+        index_type b = m_bottom.load(std::memory_order_relaxed);
+        index_type t = m_top.load(std::memory_order_relaxed);
+        return (b > t) ? size_type(b - t) : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+private:
+    std::atomic<index_type>         m_top;
+    std::atomic<index_type>         m_bottom;
+    std::atomic<circular_array*>    m_array;
+    std::vector<circular_array*>    m_garbage;
+
+private:
+    work_stealing_deque(const work_stealing_deque&);
+    work_stealing_deque& operator=(const work_stealing_deque&);
+};
+
+//============================================================================//
+
+} // namespace mad
+
+#endif
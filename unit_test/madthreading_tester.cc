@@ -15,8 +15,18 @@
 #include <madthreading/types.hh>
 #include <madthreading/utility/timer.hh>
 #include <madthreading/threading/thread_manager.hh>
+#include <madthreading/threading/work_stealing_deque.hh>
+#include <madthreading/threading/mpmc_queue.hh>
+#include <madthreading/threading/fast_mutex.hh>
+#include <madthreading/threading/eventcount.hh>
 #include <madthreading/utility/constants.hh>
 
+#include <set>
+#include <memory>
+#include <chrono>
+#include <fstream>
+#include <sys/stat.h>
+
 using namespace mad;
 using namespace std;
 
@@ -126,3 +136,1866 @@ TEST(Test_3_pi_pool_joiner_B)
     CHECK_CLOSE(step*sum, dat::PI, CheckTol);
 }
 
+
+//============================================================================//
+// T4
+TEST(Test_4_nested_run_loop)
+{
+    // every worker joins an inner task_group from inside a task, joins must
+    // help execute the queued inner tasks or the pool deadlocks
+    ulong_type num_threads = 4;
+    ulong_type num_outer = num_threads * 4;
+    ulong_type num_inner = 1000;
+    thread_manager* tm = thread_manager::get_thread_manager(num_threads);
+
+    ulong_ts count = 0;
+    //------------------------------------------------------------------------//
+    auto inner = [&count] (const ulong_type&)
+    {
+        count += 1;
+    };
+    //------------------------------------------------------------------------//
+    auto outer = [&] (const ulong_type&)
+    {
+        mad::task_group inner_tg;
+        tm->run_loop(&inner_tg, inner, 0, num_inner);
+        inner_tg.join();
+    };
+    //------------------------------------------------------------------------//
+
+    mad::task_group tg;
+    tm->run_loop(&tg, outer, 0, num_outer);
+    tg.join();
+
+    CHECK_EQUAL(num_outer * num_inner, count.load());
+}
+
+//============================================================================//
+// T5
+TEST(Test_5_parallel_for)
+{
+    ulong_type num_threads = 4;
+    thread_manager* tm = thread_manager::get_thread_manager(num_threads);
+
+    ulong_type _s = 10;
+    ulong_type _e = 100010;
+    ulong_type expected = (_e*(_e-1))/2 - (_s*(_s-1))/2;
+    blocked_range<ulong_type> range(_s, _e, 64);
+
+    ulong_ts sum = 0;
+    //------------------------------------------------------------------------//
+    auto body = [&sum] (const blocked_range<ulong_type>& r)
+    {
+        ulong_type tl_sum = 0;
+        for(ulong_type i = r.begin(); i != r.end(); ++i)
+            tl_sum += i;
+        sum += tl_sum;
+    };
+    //------------------------------------------------------------------------//
+
+    tm->parallel_for(range, body);
+    CHECK_EQUAL(expected, sum.load());
+
+    sum = 0;
+    tm->parallel_for(range, body, simple_partitioner());
+    CHECK_EQUAL(expected, sum.load());
+
+    affinity_partitioner ap;
+    for(int i = 0; i < 3; ++i)
+    {
+        sum = 0;
+        tm->parallel_for(range, body, ap);
+        CHECK_EQUAL(expected, sum.load());
+    }
+    CHECK(ap.get_map().size() >= 4 * num_threads);
+}
+
+//============================================================================//
+// T6
+TEST(Test_6_run_loop_chunks_offset)
+{
+    // the chunked run_loop must start at _s, not at zero
+    ulong_type num_threads = 4;
+    thread_manager* tm = thread_manager::get_thread_manager(num_threads);
+
+    ulong_type _s = 1000;
+    ulong_type _e = 2000;
+    ulong_ts sum = 0;
+    ulong_ts count = 0;
+    //------------------------------------------------------------------------//
+    auto compute_block = [&] (const ulong_type& s, const ulong_type& e)
+    {
+        for(ulong_type i = s; i < e; ++i)
+            sum += i;
+        count += e - s;
+    };
+    //------------------------------------------------------------------------//
+
+    mad::task_group tg;
+    tm->run_loop(&tg, compute_block, _s, _e, 7);
+    tg.join();
+
+    CHECK_EQUAL(_e - _s, count.load());
+    CHECK_EQUAL((_e*(_e-1))/2 - (_s*(_s-1))/2, sum.load());
+}
+
+//============================================================================//
+
+TEST(Test_7_run_loop_schedules)
+{
+    ulong_type num_threads = 4;
+    thread_manager* tm = thread_manager::get_thread_manager(num_threads);
+
+    ulong_type _s = 17;
+    ulong_type _e = 10017;
+    ulong_ts sum = 0;
+    ulong_ts count = 0;
+    //------------------------------------------------------------------------//
+    auto compute_block = [&] (const ulong_type& s, const ulong_type& e)
+    {
+        for(ulong_type i = s; i < e; ++i)
+            sum += i;
+        count += e - s;
+    };
+    //------------------------------------------------------------------------//
+
+    loop_schedule _schedules[] = { loop_schedule::dynamic(),
+                                   loop_schedule::dynamic(64),
+                                   loop_schedule::guided(),
+                                   loop_schedule::guided(100) };
+
+    for(const auto& _sched : _schedules)
+    {
+        sum = 0;
+        count = 0;
+        mad::task_group tg;
+        tm->run_loop(&tg, compute_block, _s, _e, _sched);
+        tg.join();
+
+        CHECK_EQUAL(_e - _s, count.load());
+        CHECK_EQUAL((_e*(_e-1))/2 - (_s*(_s-1))/2, sum.load());
+    }
+
+    //------------------------------------------------------------------------//
+    // unsigned range ending at the maximum: claims past the end must not
+    // wrap the counter around to the start of the range
+    uint32_t _umax = std::numeric_limits<uint32_t>::max();
+    uint32_t _us = _umax - 1000;
+    for(const auto& _sched : _schedules)
+    {
+        count = 0;
+        mad::task_group tg;
+        tm->run_loop(&tg, [&] (const uint32_t& s, const uint32_t& e)
+                     { count += e - s; },
+                     _us, _umax, _sched);
+        tg.join();
+        CHECK_EQUAL(1000UL, count.load());
+
+        tm->run_bulk(&tg, [&] (uint32_t) { ++count; }, _us, _umax, _sched);
+        tg.join();
+        CHECK_EQUAL(2000UL, count.load());
+    }
+}
+
+//============================================================================//
+
+TEST(Test_8_parallel_reduce)
+{
+    ulong_type num_threads = 4;
+    thread_manager* tm = thread_manager::get_thread_manager(num_threads);
+
+    typedef mad::blocked_range<ulong_type> range_t;
+    ulong_type _s = 3;
+    ulong_type _e = 100003;
+    //------------------------------------------------------------------------//
+    auto map = [] (const range_t& r, ulong_type init)
+    {
+        for(ulong_type i = r.begin(); i < r.end(); ++i)
+            init += i;
+        return init;
+    };
+    auto combine = [] (ulong_type a, ulong_type b) { return a + b; };
+    //------------------------------------------------------------------------//
+    ulong_type _answer = (_e*(_e-1))/2 - (_s*(_s-1))/2;
+
+    CHECK_EQUAL(_answer, tm->parallel_reduce(range_t(_s, _e, 10), 0UL,
+                                             map, combine));
+    CHECK_EQUAL(_answer, tm->parallel_reduce(range_t(_s, _e, 10), 0UL,
+                                             map, combine,
+                                             mad::deterministic_partitioner()));
+    CHECK_EQUAL(0UL, tm->parallel_reduce(range_t(_e, _e), 0UL, map, combine));
+
+    //------------------------------------------------------------------------//
+    // map joins a nested parallel_for: while it waits, the thread can run
+    // other pieces of the same reduction, none of them may be lost
+    auto nested_map = [&] (const range_t& r, ulong_type init)
+    {
+        ulong_ts _sum(0);
+        tm->parallel_for(range_t(r.begin(), r.end(), 100),
+                         [&] (const range_t& sub)
+                         { _sum += map(sub, 0UL); });
+        return init + _sum.load();
+    };
+    for(int i = 0; i < 10; ++i)
+        CHECK_EQUAL(_answer, tm->parallel_reduce(range_t(_s, _e, 1000), 0UL,
+                                                 nested_map, combine));
+
+    //------------------------------------------------------------------------//
+    // deterministic: bitwise identical floating-point sums on every run
+    auto fmap = [] (const range_t& r, double init)
+    {
+        for(ulong_type i = r.begin(); i < r.end(); ++i)
+            init += 1.0 / (1.0 + i);
+        return init;
+    };
+    auto fcombine = [] (double a, double b) { return a + b; };
+    double _first = tm->parallel_reduce(range_t(0, 1000000, 100), 0.0, fmap,
+                                        fcombine,
+                                        mad::deterministic_partitioner(64));
+    for(int i = 0; i < 10; ++i)
+        CHECK_EQUAL(_first, tm->parallel_reduce(range_t(0, 1000000, 100), 0.0,
+                                                fmap, fcombine,
+                                                mad::deterministic_partitioner(64)));
+}
+
+//============================================================================//
+
+TEST(Test_9_parallel_scan)
+{
+    ulong_type num_threads = 4;
+    thread_manager* tm = thread_manager::get_thread_manager(num_threads);
+
+    // large enough for several blocks per worker
+    ulong_type n = (1UL << 20) + 13;
+    std::vector<long> input(n, 0);
+    for(ulong_type i = 0; i < n; ++i)
+        input[i] = (long) (i % 7) - 3;
+
+    std::vector<long> reference(n, 0);
+    std::partial_sum(input.begin(), input.end(), reference.begin());
+
+    //------------------------------------------------------------------------//
+    std::vector<long> output(n, 0);
+    tm->parallel_inclusive_scan(input.data(), input.data() + n, output.data());
+    CHECK(output == reference);
+
+    tm->parallel_inclusive_scan(input.begin(), input.end(), output.begin());
+    CHECK(output == reference);
+
+    tm->parallel_exclusive_scan(input.data(), input.data() + n, output.data(),
+                                5L);
+    CHECK_EQUAL(5L, output[0]);
+    CHECK_EQUAL(reference[n-2] + 5L, output[n-1]);
+
+    output = input;
+    tm->parallel_inclusive_scan(output.data(), output.data() + n,
+                                output.data());
+    CHECK(output == reference);
+
+    //------------------------------------------------------------------------//
+    // associative but not commutative: keep the right-hand side
+    auto right = [] (long, long b) { return b; };
+    tm->parallel_inclusive_scan(input.begin(), input.end(), output.begin(),
+                                right);
+    CHECK(output == input);
+
+    tm->parallel_exclusive_scan(input.begin(), input.end(), output.begin(),
+                                -100L, right);
+    CHECK_EQUAL(-100L, output[0]);
+    CHECK(std::equal(input.begin(), input.end() - 1, output.begin() + 1));
+}
+
+//============================================================================//
+
+TEST(Test_10_parallel_sort)
+{
+    ulong_type num_threads = 4;
+    thread_manager* tm = thread_manager::get_thread_manager(num_threads);
+
+    // large enough for several blocks per worker
+    ulong_type n = (1UL << 18) + 5;
+    std::vector<long> input(n, 0);
+    for(ulong_type i = 0; i < n; ++i)
+        input[i] = (long) ((i * 2654435761UL) % 100003) - 50000;
+
+    std::vector<long> reference = input;
+    std::sort(reference.begin(), reference.end());
+
+    //------------------------------------------------------------------------//
+    std::vector<long> output = input;
+    tm->parallel_sort(output.begin(), output.end());
+    CHECK(output == reference);
+
+    output = input;
+    tm->parallel_sort(output.data(), output.data() + n, std::less<long>());
+    CHECK(output == reference);
+
+    output = input;
+    tm->parallel_sort(output.begin(), output.end(), std::greater<long>());
+    CHECK(std::equal(output.begin(), output.end(), reference.rbegin()));
+
+    std::vector<double> doubles(input.begin(), input.end());
+    tm->parallel_sort(doubles.begin(), doubles.end());
+    CHECK(std::is_sorted(doubles.begin(), doubles.end()));
+
+    //------------------------------------------------------------------------//
+    // stable partition
+    auto is_even = [] (const long& _val) { return _val % 2 == 0; };
+    output = input;
+    auto _split = tm->parallel_partition(output.begin(), output.end(),
+                                         is_even);
+    reference = input;
+    auto _ref_split = std::stable_partition(reference.begin(),
+                                            reference.end(), is_even);
+    CHECK_EQUAL(_ref_split - reference.begin(), _split - output.begin());
+    CHECK(output == reference);
+}
+
+//============================================================================//
+
+TEST(Test_11_task_graph)
+{
+    ulong_type num_threads = 4;
+    thread_manager* tm = thread_manager::get_thread_manager(num_threads);
+
+    // per detector: slerp -> rotate -> accumulate, all accumulates -> reduce
+    const ulong_type ndet = 16;
+    std::atomic<ulong_type> clock(0);
+    std::vector<ulong_type> stamp(3*ndet + 1, 0);
+    ulong_ts count = 0;
+
+    mad::task_graph graph(tm->thread_pool());
+    std::vector<mad::task_graph::node> accumulate;
+    auto record = [&] (ulong_type i) { stamp[i] = ++clock; ++count; };
+    for(ulong_type i = 0; i < ndet; ++i)
+    {
+        auto a = graph.emplace([=] () { record(3*i); });
+        auto b = graph.emplace([=] () { record(3*i+1); });
+        auto c = graph.emplace([=] () { record(3*i+2); });
+        graph.precede(a, b);
+        graph.precede(b, c);
+        accumulate.push_back(c);
+    }
+    auto reduce = graph.emplace([&] () { record(3*ndet); });
+    for(auto& itr : accumulate)
+        graph.precede(itr, reduce);
+
+    CHECK_EQUAL(3*ndet + 1, graph.size());
+
+    // reusable: same nodes, same edges, several runs
+    for(ulong_type n = 1; n <= 5; ++n)
+    {
+        graph.run();
+        CHECK_EQUAL(n * (3*ndet + 1), count.load());
+        for(ulong_type i = 0; i < ndet; ++i)
+        {
+            CHECK(stamp[3*i] < stamp[3*i+1]);
+            CHECK(stamp[3*i+1] < stamp[3*i+2]);
+            CHECK(stamp[3*i+2] < stamp[3*ndet]);
+        }
+    }
+
+    //------------------------------------------------------------------------//
+    // cycles are reported
+    mad::task_graph cyclic(tm->thread_pool());
+    auto x = cyclic.emplace([] () { });
+    auto y = cyclic.emplace([] () { });
+    cyclic.precede(x, y);
+    cyclic.precede(y, x);
+    CHECK_THROW(cyclic.run(), std::runtime_error);
+}
+
+//============================================================================//
+
+TEST(Test_12_pipeline)
+{
+    ulong_type num_threads = 4;
+    thread_manager* tm = thread_manager::get_thread_manager(num_threads);
+
+    struct chunk_t
+    {
+        ulong_type          index;
+        std::vector<double> data;
+    };
+
+    const ulong_type nchunks = 200;
+    const ulong_type max_tokens = 6;
+    ulong_type nread = 0;
+    std::atomic<long> in_flight(0);
+    std::atomic<long> max_in_flight(0);
+    std::atomic<int> in_serial(0);
+    bool overlap = false;
+    std::vector<ulong_type> order;
+    std::set<const double*> buffers;
+    mad::fast_mutex buffers_lock;
+    double total = 0.0;
+
+    mad::pipeline<chunk_t> pipe(max_tokens, tm->thread_pool());
+    pipe.add_source([&] (chunk_t& c)
+    {
+        if(nread == nchunks)
+            return false;
+        c.index = nread++;
+        c.data.resize(64);
+        long n = ++in_flight;
+        long m = max_in_flight.load();
+        while(n > m && !max_in_flight.compare_exchange_weak(m, n)) { }
+        return true;
+    })
+    .add_filter(mad::filter_mode::parallel, [&] (chunk_t& c)
+    {
+        for(ulong_type i = 0; i < c.data.size(); ++i)
+            c.data[i] = c.index + i;
+        mad::fast_lock l(buffers_lock);
+        buffers.insert(c.data.data());
+    })
+    .add_filter(mad::filter_mode::serial_out_of_order, [&] (chunk_t& c)
+    {
+        overlap |= (++in_serial > 1);
+        for(auto& itr : c.data)
+            itr *= 2.0;
+        --in_serial;
+    })
+    .add_filter(mad::filter_mode::serial_in_order, [&] (chunk_t& c)
+    {
+        order.push_back(c.index);
+        for(auto& itr : c.data)
+            total += itr;
+        --in_flight;
+    });
+
+    for(int n = 0; n < 3; ++n)
+    {
+        nread = 0;
+        order.clear();
+        total = 0.0;
+        pipe.run();
+
+        CHECK_EQUAL(nchunks, order.size());
+        for(ulong_type i = 0; i < order.size(); ++i)
+            CHECK_EQUAL(i, order[i]);
+        // sum over chunks k and i < 64 of 2*(k + i)
+        CHECK_CLOSE(2.0 * (64.0 * (nchunks*(nchunks-1))/2 +
+                           nchunks * (64.0*63.0)/2), total, 1.0e-6);
+    }
+    CHECK(!overlap);
+    CHECK(max_in_flight.load() <= (long) max_tokens);
+    CHECK(buffers.size() <= max_tokens);
+}
+
+//============================================================================//
+
+TEST(Test_13_futures)
+{
+    ulong_type num_threads = 4;
+    thread_manager* tm = thread_manager::get_thread_manager(num_threads);
+
+    mad::task_group tg;
+    auto square = [] (long i) { return i * i; };
+
+    //------------------------------------------------------------------------//
+    // exec + then chains
+    std::vector<mad::future<long>> futures;
+    for(long i = 0; i < 100; ++i)
+        futures.push_back(tm->exec<long>(&tg, square, i)
+                          .then([] (const long& v) { return v + 1; }));
+
+    ulong_ts nvoid = 0;
+    mad::future<void> fv = tm->exec(&tg, [&] () { ++nvoid; });
+    fv.then([&] () { ++nvoid; }).then([&] () { ++nvoid; });
+
+    //------------------------------------------------------------------------//
+    // when_all / when_any
+    mad::future<std::vector<long>> all = mad::when_all(futures);
+    mad::future<long> total = all.then([] (const std::vector<long>& v)
+    {
+        return std::accumulate(v.begin(), v.end(), 0L);
+    });
+    mad::future<std::size_t> any = mad::when_any(futures);
+
+    CHECK_EQUAL(328350L + 100L, total.get());
+    CHECK(any.get() < futures.size());
+    CHECK(futures[any.get()].is_ready());
+
+    tg.join();
+    CHECK_EQUAL(3UL, nvoid.load());
+    for(long i = 0; i < 100; ++i)
+        CHECK_EQUAL(i*i + 1, futures[i].get());
+
+    // continuation of an already completed future
+    CHECK_EQUAL(2L, futures[1].then([] (const long& v) { return v; }).get());
+    tg.join();
+
+    //------------------------------------------------------------------------//
+    // a throwing task: get() rethrows, continuations and when_all/when_any
+    // fail with the same exception without calling the user function
+    {
+        ulong_ts ncalls = 0;
+        mad::future<long> _fail = tm->exec<long>(&tg, [] () -> long
+        { throw std::logic_error("future failed"); });
+        mad::future<long> _next = _fail.then([&] (const long& v)
+                                             { ++ncalls; return v; });
+        mad::future<void> _void = tm->exec(&tg, [] ()
+        { throw std::logic_error("void failed"); });
+        mad::future<void> _vnext = _void.then([&] () { ++ncalls; });
+
+        std::vector<mad::future<long>> _mixed = { futures[0], _fail };
+        mad::future<std::vector<long>> _all = mad::when_all(_mixed);
+        std::vector<mad::future<long>> _failed = { _fail };
+        mad::future<std::size_t> _any = mad::when_any(_failed);
+
+        CHECK_THROW(_fail.get(), std::logic_error);
+        CHECK_THROW(_next.get(), std::logic_error);
+        CHECK_THROW(_void.get(), std::logic_error);
+        CHECK_THROW(_vnext.get(), std::logic_error);
+        CHECK_THROW(_all.get(), std::logic_error);
+        CHECK_THROW(_any.get(), std::logic_error);
+        CHECK(_fail.task()->exception() != nullptr);
+        CHECK_THROW(tg.join(), std::logic_error);
+        CHECK_EQUAL(0UL, ncalls.load());
+        // the exception stays with the future
+        CHECK_THROW(_fail.get(), std::logic_error);
+    }
+
+    //------------------------------------------------------------------------//
+    // skipped by cancellation: get() throws task_canceled
+    {
+        tg.cancel();
+        mad::future<long> _skipped = tm->exec<long>(&tg, square, 3L);
+        mad::future<long> _next = _skipped.then([] (const long& v)
+                                                { return v; });
+        tg.join();
+        tg.clear_cancel();
+        CHECK_THROW(_skipped.get(), mad::task_canceled);
+        CHECK_THROW(_next.get(), mad::task_canceled);
+    }
+
+    //------------------------------------------------------------------------//
+    // when_all/when_any combine futures of a single task_group
+    {
+        mad::task_group other;
+        std::vector<mad::future<long>> _mixed =
+                { tm->exec<long>(&tg, square, 2L),
+                  tm->exec<long>(&other, square, 3L) };
+        CHECK_THROW(mad::when_all(_mixed), std::invalid_argument);
+        CHECK_THROW(mad::when_any(_mixed), std::invalid_argument);
+        other.join();
+        tg.join();
+        CHECK_EQUAL(9L, _mixed[1].get());
+    }
+}
+
+//============================================================================//
+
+TEST(Test_14_priority_lanes)
+{
+    ulong_type num_threads = 4;
+    thread_manager* tm = thread_manager::get_thread_manager(num_threads);
+    mad::thread_pool* tp = tm->thread_pool();
+    ulong_type _aging = tp->get_priority_aging();
+
+    // occupy every worker, then release one so the queued tasks are
+    // executed one at a time in the order the lanes hand them out
+    auto ordered = [&] (long nhigh, long nnormal, long nlow)
+                   -> std::vector<int>
+    {
+        mad::task_group tg;
+        ulong_ts started = 0;
+        ulong_ts release = 0;
+        ulong_type nworkers = tp->size();
+        for(ulong_type i = 0; i < nworkers; ++i)
+            tm->exec(&tg, [&] ()
+            {
+                ulong_type _n = started++;
+                while(release.load() <= _n)
+                    std::this_thread::yield();
+            });
+        while(started.load() < nworkers)
+            std::this_thread::yield();
+
+        mad::mutex _mtx;
+        std::vector<int> order;
+        auto record = [&] (int lane)
+        {
+            mad::auto_lock l(_mtx);
+            order.push_back(lane);
+        };
+        for(long i = 0; i < nlow; ++i)
+            tm->exec(&tg, task_priority::low, record, 2);
+        for(long i = 0; i < nnormal; ++i)
+            tm->exec(&tg, task_priority::normal, record, 1);
+        for(long i = 0; i < nhigh; ++i)
+            tm->exec(&tg, task_priority::high, record, 0);
+
+        release = 1;
+        ulong_type ntot = nhigh + nnormal + nlow;
+        while(true)
+        {
+            mad::auto_lock l(_mtx);
+            if(order.size() == ntot)
+                break;
+        }
+        release = nworkers;
+        tg.join();
+        return order;
+    };
+
+    // strict priority
+    tp->set_priority_aging(0);
+    std::vector<int> order = ordered(8, 8, 8);
+    CHECK(std::is_sorted(order.begin(), order.end()));
+
+    // aging lets the low lane through a steady stream of high tasks
+    tp->set_priority_aging(4);
+    order = ordered(64, 0, 4);
+    CHECK(std::find(order.begin(), order.end(), 2) - order.begin() < 16);
+
+    tp->set_priority_aging(_aging);
+}
+
+//============================================================================//
+
+TEST(Test_15_background_tasks)
+{
+    ulong_type num_threads = 4;
+    thread_manager* tm = thread_manager::get_thread_manager(num_threads);
+
+    mad::task_group tg;
+    ulong_ts nexec = 0;
+    mad::background_channel* ch =
+            tm->add_background_task(&tg, &nexec, [&] () { ++nexec; });
+
+    //------------------------------------------------------------------------//
+    // concurrent signals are counted, not overwritten
+    ulong_type nproducers = 4;
+    ulong_type nsignals = 2500;
+    std::vector<std::thread> producers;
+    for(ulong_type i = 0; i < nproducers; ++i)
+        producers.push_back(std::thread([&] ()
+        {
+            mad::background_future f;
+            for(ulong_type j = 0; j < nsignals; ++j)
+                f = tm->signal_background(ch);
+            f.wait();
+            CHECK(f.is_ready());
+        }));
+    for(auto& itr : producers)
+        itr.join();
+    CHECK_EQUAL(nproducers * nsignals, nexec.load());
+
+    //------------------------------------------------------------------------//
+    // look-up by id
+    mad::background_future f = tm->signal_background(&nexec);
+    CHECK(f.valid());
+    f.wait();
+    CHECK(tm->is_done(&nexec));
+    CHECK_EQUAL(nproducers * nsignals + 1, nexec.load());
+
+    // unknown id: nothing to wait for
+    int other = 0;
+    CHECK(!tm->signal_background(&other).valid());
+
+    //------------------------------------------------------------------------//
+    // a throwing execution: its future rethrows, the executor thread keeps
+    // serving the following signals
+    ulong_ts nfail = 0;
+    mad::background_channel* fch =
+            tm->add_background_task(&tg, &nfail, [&] ()
+            {
+                if(++nfail % 2 == 1)
+                    throw std::runtime_error("background task failed");
+            });
+    CHECK_THROW(tm->signal_background(fch).wait(), std::runtime_error);
+    tm->signal_background(fch).wait();
+    CHECK_THROW(tm->signal_background(&nfail).wait(), std::runtime_error);
+    CHECK_EQUAL(3UL, nfail.load());
+    tm->signal_background(ch).wait();
+    CHECK_EQUAL(nproducers * nsignals + 2, nexec.load());
+
+    tg.join();
+}
+
+//============================================================================//
+
+TEST(Test_16_topology)
+{
+    typedef mad::topology::cpu_list_t cpu_list_t;
+
+    //------------------------------------------------------------------------//
+    // fake sysfs: 2 nodes x 2 cores x 2 SMT, siblings numbered like Linux
+    // does (cpu N and cpu N+4 share a core)
+    char _root[] = "/tmp/mad_topology_XXXXXX";
+    CHECK(mkdtemp(_root) != nullptr);
+    std::string root = _root;
+    auto write = [] (const std::string& path, const std::string& line)
+    {
+        std::ofstream ofs(path.c_str());
+        ofs << line << std::endl;
+    };
+    mkdir((root + "/cpu").c_str(), 0700);
+    mkdir((root + "/node").c_str(), 0700);
+    write(root + "/cpu/online", "0-7");
+    write(root + "/node/online", "0-1");
+    for(int n = 0; n < 2; ++n)
+    {
+        std::string dir = root + "/node/node" + std::to_string(n);
+        mkdir(dir.c_str(), 0700);
+        write(dir + "/cpulist", (n == 0) ? "0-1,4-5" : "2-3,6-7");
+    }
+    for(int c = 0; c < 8; ++c)
+    {
+        std::string dir = root + "/cpu/cpu" + std::to_string(c);
+        mkdir(dir.c_str(), 0700);
+        mkdir((dir + "/topology").c_str(), 0700);
+        write(dir + "/topology/physical_package_id", std::to_string((c/2)%2));
+        write(dir + "/topology/core_id", std::to_string(c%2));
+    }
+
+    mad::topology topo(root, cpu_list_t());
+    CHECK_EQUAL(8UL, topo.num_cpus());
+    CHECK_EQUAL(4UL, topo.num_cores());
+    CHECK_EQUAL(2UL, topo.num_nodes());
+    CHECK(topo.node_cpus(1) == cpu_list_t({ 2, 3, 6, 7 }));
+    CHECK_EQUAL(1, topo.node_of(6));
+
+    typedef std::vector<cpu_list_t> sets_t;
+    CHECK(topo.placement(placement_policy::compact, 4) ==
+          sets_t({ {0}, {4}, {1}, {5} }));
+    CHECK(topo.placement(placement_policy::scatter, 5) ==
+          sets_t({ {0}, {2}, {1}, {3}, {4} }));
+    CHECK(topo.placement(placement_policy::one_per_core, 4) ==
+          sets_t({ {0, 4}, {1, 5}, {2, 6}, {3, 7} }));
+    CHECK(topo.placement(placement_policy::per_numa_node, 4) ==
+          sets_t({ {0, 1, 4, 5}, {0, 1, 4, 5}, {2, 3, 6, 7}, {2, 3, 6, 7} }));
+    CHECK(topo.placement(placement_policy::none, 2) == sets_t(2));
+
+    //------------------------------------------------------------------------//
+    // container restricted to one SMT thread per core of node 0 and cpu 6
+    mad::topology masked(root, cpu_list_t({ 0, 1, 6 }));
+    CHECK_EQUAL(3UL, masked.num_cpus());
+    CHECK_EQUAL(3UL, masked.num_cores());
+    CHECK(masked.placement(placement_policy::one_per_core, 4) ==
+          sets_t({ {0}, {1}, {6}, {0} }));
+
+    CHECK(mad::topology::parse_cpu_list("0-2,5,7-8") ==
+          cpu_list_t({ 0, 1, 2, 5, 7, 8 }));
+    CHECK_EQUAL(0, std::system(("rm -rf " + root).c_str()));
+
+    //------------------------------------------------------------------------//
+    // this machine, and binding the running workers
+    const mad::topology& local = mad::topology::instance();
+    CHECK(local.num_cpus() > 0);
+    CHECK(local.num_cores() > 0 && local.num_cores() <= local.num_cpus());
+    CHECK(!mad::topology::process_cpus().empty());
+
+    // ids beyond CPU_SETSIZE (1024) and negative ones are not an error, the
+    // thread gets the valid CPUs of the list
+    {
+        int _cpu = mad::topology::process_cpus().front();
+        std::atomic<bool> _bound(false);
+        std::thread _thread([&] ()
+        {
+            while(!_bound.load())
+                std::this_thread::yield();
+        });
+        CHECK_EQUAL(0, mad::topology::bind(_thread, { -1, _cpu, 4096 }));
+        CHECK_EQUAL(0, mad::topology::bind(_thread, cpu_list_t()));
+        _bound.store(true);
+        _thread.join();
+    }
+
+    thread_manager* tm = thread_manager::get_thread_manager(4);
+    tm->set_placement(placement_policy::compact);
+    tm->set_placement(placement_policy::none);
+    CHECK(tm->thread_pool()->get_placement() == placement_policy::none);
+}
+
+//============================================================================//
+
+TEST(Test_17_numa_queues)
+{
+    ulong_type num_threads = 4;
+    thread_manager* tm = thread_manager::get_thread_manager(num_threads);
+    mad::thread_pool* tp = tm->thread_pool();
+    ulong_type nworkers = tp->size();
+
+    // workers 0,1 on node 0 and the rest on node 1, whatever this machine is
+    std::vector<int> nodes(nworkers, 1);
+    nodes[0] = nodes[1] = 0;
+    tp->set_worker_nodes(nodes);
+    CHECK_EQUAL(1, tp->get_worker_node(nworkers - 1));
+
+    //------------------------------------------------------------------------//
+    // occupy every worker, then release worker 0 only: it has to finish the
+    // work of its own node before it takes the work of node 1
+    mad::task_group tg;
+    ulong_ts started = 0;
+    ulong_ts release = 0;
+    for(ulong_type i = 0; i < nworkers; ++i)
+        tm->exec(&tg, [&] ()
+        {
+            long _w = tp->get_this_thread_index();
+            ++started;
+            while((release.load() & (1UL << _w)) == 0)
+                std::this_thread::yield();
+        });
+    while(started.load() < nworkers)
+        std::this_thread::yield();
+
+    mad::mutex _mtx;
+    std::vector<int> order;
+    auto record = [&] (int kind)
+    {
+        mad::auto_lock l(_mtx);
+        order.push_back(kind);
+    };
+    auto on_node = [] (long _node)
+    {
+        return [=] (int, int) -> long { return _node; };
+    };
+    tm->run_loop(&tg, [&] (int, int) { record(2); }, 0, 8, 8, on_node(1));
+    tm->run_loop(&tg, [&] (int, int) { record(0); }, 0, 8, 8, on_node(0));
+    // no worker on that node -> submitted like any other task
+    tm->run_loop(&tg, [&] (int, int) { record(1); }, 0, 4, 4, on_node(3));
+    for(int i = 0; i < 4; ++i)
+        tm->exec(&tg, record, 1);
+
+    release = 1;
+    while(true)
+    {
+        mad::auto_lock l(_mtx);
+        if(order.size() == 24)
+            break;
+    }
+    release = ~0UL;
+    tg.join();
+    CHECK(std::is_sorted(order.begin(), order.end()));
+
+    //------------------------------------------------------------------------//
+    std::vector<int> too_few(nworkers - 1, 0);
+    std::vector<int> invalid(nworkers, -1);
+    CHECK_THROW(tp->set_worker_nodes(too_few), std::runtime_error);
+    CHECK_THROW(tp->set_worker_nodes(invalid), std::runtime_error);
+    tp->set_worker_nodes(std::vector<int>(nworkers, 0));
+}
+
+//============================================================================//
+
+TEST(Test_18_elastic_resize)
+{
+    ulong_type num_threads = 4;
+    thread_manager* tm = thread_manager::get_thread_manager(num_threads);
+    mad::thread_pool* tp = tm->thread_pool();
+
+    // "n" tasks that only finish once all of them run at the same time,
+    // i.e. there are at least "n" active workers
+    auto concurrent = [&] (ulong_type n) -> bool
+    {
+        mad::task_group tg;
+        ulong_ts started = 0;
+        std::atomic<bool> timeout(false);
+        for(ulong_type i = 0; i < n; ++i)
+            tm->exec(&tg, [&] ()
+            {
+                ++started;
+                auto _end = std::chrono::steady_clock::now() +
+                            std::chrono::seconds(10);
+                while(started.load() < n && !timeout.load())
+                    if(std::chrono::steady_clock::now() > _end)
+                        timeout = true;
+            });
+        tg.join();
+        return !timeout.load();
+    };
+
+    // every worker has registered its id once they all ran a task
+    CHECK(concurrent(num_threads));
+    std::map<std::thread::id, ulong_type> tids = tp->GetThreadIDs();
+
+    //------------------------------------------------------------------------//
+    // shrink with tasks in flight: the queued children of the retired
+    // workers are taken over by the remaining ones
+    mad::task_group tg;
+    ulong_ts nexec = 0;
+    for(ulong_type i = 0; i < 200; ++i)
+        tm->exec(&tg, [&] ()
+        {
+            for(ulong_type j = 0; j < 10; ++j)
+                tm->exec(&tg, [&] () { ++nexec; });
+            ++nexec;
+        });
+    tm->allocate_threads(1);
+    tg.join();
+    CHECK_EQUAL(2200UL, nexec.load());
+    CHECK_EQUAL(1UL, tp->size());
+
+    //------------------------------------------------------------------------//
+    // grow: the retired workers come back, only the delta is spawned
+    tm->allocate_threads(6);
+    CHECK_EQUAL(6UL, tm->size());
+    CHECK(concurrent(6));
+    CHECK_EQUAL(tids.size() + 2, tp->GetThreadIDs().size());
+    for(const auto& itr : tids)
+        CHECK(tp->GetThreadIDs().count(itr.first) == 1);
+
+    //------------------------------------------------------------------------//
+    // grow past the slots of the running pool (and a segment of the slot
+    // arrays): slots are appended, the running workers are kept
+    std::map<std::thread::id, ulong_type> grown_tids = tp->GetThreadIDs();
+    ulong_type _large = tp->capacity() + mad::slot_array<int>::segment_size;
+    tm->allocate_threads(_large);
+    CHECK_EQUAL(_large, tm->size());
+    CHECK(tp->capacity() >= _large);
+    CHECK(concurrent(num_threads));
+    CHECK_EQUAL(_large, tp->GetThreadIDs().size());
+    for(const auto& itr : grown_tids)
+        CHECK(tp->GetThreadIDs().count(itr.first) == 1);
+
+    tm->allocate_threads(num_threads);
+    CHECK(concurrent(num_threads));
+    CHECK_EQUAL(_large, tp->GetThreadIDs().size());
+}
+
+//============================================================================//
+
+TEST(Test_19_independent_pools)
+{
+    ulong_type num_threads = 4;
+    thread_manager* tm = thread_manager::get_thread_manager(num_threads);
+
+    // worker indices seen by tasks of a pool, with and without the
+    // thread-local lookup. The joining thread helps and is not a worker
+    auto indices = [] (thread_manager* _tm, ulong_type n) -> std::set<long>
+    {
+        mad::task_group tg(_tm->thread_pool());
+        mad::mutex _mtx;
+        std::set<long> _ids;
+        for(ulong_type i = 0; i < n; ++i)
+            _tm->exec(&tg, [&] ()
+            {
+                long _id = thread_manager::id(std::this_thread::get_id());
+                CHECK_EQUAL(_id, _tm->thread_pool()->get_this_thread_index());
+                // long enough for the workers to get a turn
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+                mad::auto_lock l(_mtx);
+                _ids.insert(_id);
+            });
+        tg.join();
+        _ids.erase(-1);
+        return _ids;
+    };
+
+    //------------------------------------------------------------------------//
+    // a second, smaller pool next to the default one
+    thread_manager* io = new thread_manager(2, false);
+    CHECK(thread_manager::instance() == tm);
+    CHECK_EQUAL(2UL, io->size());
+    CHECK_EQUAL(num_threads, tm->size());
+
+    std::set<long> io_ids = indices(io, 200);
+    CHECK(!io_ids.empty() && *io_ids.begin() >= 0 && *io_ids.rbegin() < 2);
+    std::set<long> ids = indices(tm, 200);
+    CHECK(!ids.empty() && *ids.begin() >= 0 &&
+          *ids.rbegin() < (long) num_threads);
+
+    CHECK_EQUAL(-1L, thread_manager::id(std::this_thread::get_id()));
+    CHECK_EQUAL(std::string(""), tmid);
+
+    //------------------------------------------------------------------------//
+    // shutting one pool down leaves the other running
+    delete io;
+    CHECK(tm->thread_pool()->is_alive());
+    ids = indices(tm, 200);
+    CHECK(!ids.empty() && *ids.begin() >= 0);
+    CHECK(thread_manager::instance() == tm);
+}
+
+//============================================================================//
+
+TEST(Test_20_bulk_tasks)
+{
+    ulong_type num_threads = 4;
+    thread_manager* tm = thread_manager::get_thread_manager(num_threads);
+
+    //------------------------------------------------------------------------//
+    // every index exactly once, from a single task object
+    ulong_type n = 1000000;
+    std::vector<int> hits(n + 100, 0);
+    {
+        mad::task_group tg;
+        tm->run_bulk(&tg, [&] (ulong_type i) { hits[i] += 1; }, 100, n + 100);
+        tg.join();
+        CHECK_EQUAL(1UL, tg.get_tasks().size());
+    }
+    CHECK_EQUAL(0L, std::accumulate(hits.begin(), hits.begin() + 100, 0L));
+    CHECK_EQUAL((long) n, std::accumulate(hits.begin(), hits.end(), 0L));
+    CHECK(*std::max_element(hits.begin(), hits.end()) == 1);
+
+    //------------------------------------------------------------------------//
+    // fixed chunks, nested in other tasks, and an empty range
+    ulong_ts total = 0;
+    mad::task_group outer;
+    for(ulong_type j = 0; j < 8; ++j)
+        tm->exec(&outer, [&] ()
+        {
+            mad::task_group inner;
+            tm->run_bulk(&inner, [&] (long) { ++total; }, 0L, 10000L,
+                         loop_schedule::dynamic(64));
+            tm->run_bulk(&inner, [&] (long) { ++total; }, 5L, 5L);
+            inner.join();
+        });
+    outer.join();
+    CHECK_EQUAL(80000UL, total.load());
+}
+
+//============================================================================//
+
+namespace
+{
+int64_t serial_fib(int64_t n)
+{
+    return (n < 2) ? n : serial_fib(n-1) + serial_fib(n-2);
+}
+
+int64_t invoke_fib(thread_manager* tm, int64_t n)
+{
+    if(n < 12)
+        return serial_fib(n);
+    int64_t a = 0, b = 0;
+    tm->parallel_invoke([&] () { a = invoke_fib(tm, n-1); },
+                        [&] () { b = invoke_fib(tm, n-2); });
+    return a + b;
+}
+
+// one spawn per level, depth ~ log2(n)
+int64_t spawn_sum(mad::thread_pool* tp, int64_t first, int64_t last)
+{
+    if(last - first < 16)
+    {
+        int64_t _sum = 0;
+        for(int64_t i = first; i < last; ++i)
+            _sum += i;
+        return _sum;
+    }
+    int64_t _mid = first + (last - first) / 2;
+    int64_t _upper = 0;
+    mad::spawn_group sg(tp);
+    sg.spawn([&] () { _upper = spawn_sum(tp, _mid, last); });
+    int64_t _lower = spawn_sum(tp, first, _mid);
+    sg.sync();
+    return _lower + _upper;
+}
+}
+
+//============================================================================//
+
+TEST(Test_21_fork_join)
+{
+    ulong_type num_threads = 4;
+    thread_manager* tm = thread_manager::get_thread_manager(num_threads);
+
+    //------------------------------------------------------------------------//
+    // recursive parallel_invoke
+    CHECK_EQUAL(serial_fib(27), invoke_fib(tm, 27));
+
+    //------------------------------------------------------------------------//
+    // more than two functions, the last on the calling thread
+    std::vector<int> flags(5, 0);
+    long _caller = tm->thread_pool()->get_this_thread_index();
+    long _last = -2;
+    tm->parallel_invoke([&] () { flags[0] = 1; },
+                        [&] () { flags[1] = 1; },
+                        [&] () { flags[2] = 1; },
+                        [&] () { flags[3] = 1; },
+                        [&] () { flags[4] = 1;
+                                 _last = tm->thread_pool()
+                                           ->get_this_thread_index(); });
+    CHECK_EQUAL(5, std::accumulate(flags.begin(), flags.end(), 0));
+    CHECK_EQUAL(_caller, _last);
+
+    //------------------------------------------------------------------------//
+    // deep spawn/sync from many concurrent tasks, more joins in flight
+    // than there are workers
+    int64_t n = 1 << 16;
+    std::vector<int64_t> sums(32, 0);
+    mad::task_group tg;
+    for(ulong_type j = 0; j < sums.size(); ++j)
+        tm->exec(&tg, [&, j] ()
+        { sums[j] = spawn_sum(tm->thread_pool(), 0, n); });
+    tg.join();
+    for(auto itr : sums)
+        CHECK_EQUAL(n * (n - 1) / 2, itr);
+}
+
+//============================================================================//
+
+TEST(Test_22_cancellation)
+{
+    ulong_type num_threads = 4;
+    thread_manager* tm = thread_manager::get_thread_manager(num_threads);
+
+    //------------------------------------------------------------------------//
+    // tasks of a canceled group are skipped, also those returning a value
+    // or a future, join returns and the group can be used again
+    {
+        ulong_ts count = 0;
+        mad::task_group tg;
+        tg.cancel();
+        for(ulong_type i = 0; i < 1000; ++i)
+            tm->exec(&tg, [&] () { ++count; });
+        mad::future<int> _future = tm->exec<int>(&tg, [] () { return 1; });
+        tm->run_bulk(&tg, [&] (ulong_type) { ++count; }, 0, 1000);
+        tg.join();
+        CHECK_EQUAL(0UL, count.load());
+        CHECK(_future.is_ready());
+        CHECK_EQUAL(0L, (long) tg.task_count());
+
+        tg.clear_cancel();
+        for(ulong_type i = 0; i < 10; ++i)
+            tm->exec(&tg, [&] () { ++count; });
+        tg.join();
+        CHECK_EQUAL(10UL, count.load());
+    }
+
+    //------------------------------------------------------------------------//
+    // running tasks poll the token
+    {
+        mad::task_group tg;
+        mad::cancellation_token _token = tg.token();
+        ulong_ts started = 0;
+        for(ulong_type i = 0; i < num_threads; ++i)
+            tm->exec(&tg, [&, _token] ()
+            {
+                ++started;
+                while(!_token.is_canceled())
+                    std::this_thread::yield();
+            });
+        while(started.load() == 0)
+            std::this_thread::yield();
+        CHECK(!_token.is_canceled());
+        tg.cancel();
+        tg.join();
+        CHECK(_token.is_canceled());
+    }
+
+    //------------------------------------------------------------------------//
+    // parallel_find_if returns the first match
+    std::vector<int> data(1 << 20, 0);
+    CHECK(tm->parallel_find_if(data.begin(), data.end(),
+                               [] (int v) { return v > 0; }) == data.end());
+    data[900000] = 2;
+    data[777777] = 1;
+    data[800000] = 3;
+    CHECK_EQUAL(777777L, tm->parallel_find_if(data.begin(), data.end(),
+                         [] (int v) { return v > 0; }) - data.begin());
+    data[5] = 1;
+    CHECK_EQUAL(5L, tm->parallel_find_if(data.begin(), data.end(),
+                    [] (int v) { return v > 0; }) - data.begin());
+    CHECK_EQUAL(800000L, tm->parallel_find_if(data.begin(), data.end(),
+                         [] (int v) { return v > 2; }) - data.begin());
+}
+
+//============================================================================//
+
+TEST(Test_23_exceptions)
+{
+    ulong_type num_threads = 4;
+    thread_manager* tm = thread_manager::get_thread_manager(num_threads);
+
+    //------------------------------------------------------------------------//
+    // the first exception surfaces in join, every other task still runs
+    {
+        ulong_ts count = 0;
+        mad::task_group tg;
+        for(ulong_type i = 0; i < 100; ++i)
+            tm->exec(&tg, [&, i] ()
+            {
+                if(i % 37 == 36)
+                    throw std::runtime_error("task failed");
+                ++count;
+            });
+        mad::future<int> _future = tm->exec<int>(&tg, [] () -> int
+        { throw std::logic_error("future failed"); });
+
+        bool _caught = false;
+        try
+        {
+            tg.join();
+        }
+        catch(std::exception&)
+        {
+            _caught = true;
+        }
+        CHECK(_caught);
+        CHECK_EQUAL(98UL, count.load());
+        CHECK_EQUAL(0L, (long) tg.task_count());
+        CHECK(_future.is_ready());
+
+        // rethrown once, the group and the pool keep working
+        tm->exec(&tg, [&] () { ++count; });
+        tg.join();
+        CHECK_EQUAL(99UL, count.load());
+    }
+
+    //------------------------------------------------------------------------//
+    // fork-join and parallel_for propagate exceptions to the caller
+    CHECK_THROW(tm->parallel_invoke([] () { throw std::runtime_error("f1"); },
+                                    [] () { }),
+                std::runtime_error);
+    CHECK_THROW(tm->parallel_invoke([] () { },
+                                    [] () { throw std::runtime_error("f2"); }),
+                std::runtime_error);
+    CHECK_THROW(tm->parallel_for(blocked_range<ulong_type>(0, 100000, 100),
+                                 [] (const blocked_range<ulong_type>& r)
+                                 {
+                                     if(r.begin() <= 50000 && 50000 < r.end())
+                                         throw std::runtime_error("body");
+                                 }),
+                std::runtime_error);
+
+    //------------------------------------------------------------------------//
+    // still healthy
+    ulong_ts total = 0;
+    tm->parallel_for(blocked_range<ulong_type>(0, 100000, 100),
+                     [&] (const blocked_range<ulong_type>& r)
+                     { total += r.end() - r.begin(); });
+    CHECK_EQUAL(100000UL, total.load());
+}
+
+//============================================================================//
+
+TEST(Test_24_work_stealing_deque)
+{
+    typedef mad::work_stealing_deque<long> deque_type;
+
+    //------------------------------------------------------------------------//
+    // owner pops LIFO, thieves take FIFO, the array grows from 2 slots
+    {
+        deque_type _deque(1);
+        long x = -1;
+        CHECK(!_deque.pop(x));
+        CHECK(!_deque.steal(x));
+        for(long i = 0; i < 1000; ++i)
+            _deque.push(i);
+        CHECK_EQUAL(1000UL, _deque.size());
+        for(long i = 0; i < 10; ++i)
+        {
+            CHECK(_deque.steal(x));
+            CHECK_EQUAL(i, x);
+        }
+        for(long i = 999; i >= 10; --i)
+        {
+            CHECK(_deque.pop(x));
+            CHECK_EQUAL(i, x);
+        }
+        CHECK(!_deque.pop(x));
+        CHECK(_deque.empty());
+    }
+
+    //------------------------------------------------------------------------//
+    // concurrent thieves while the owner pushes (growing) and pops: every
+    // item is taken exactly once
+    {
+        const long n = 200000;
+        const int nthieves = 3;
+        deque_type _deque(2);
+        std::vector<std::atomic<int>> _taken(n);
+        for(auto& itr : _taken)
+            itr.store(0);
+        std::atomic<bool> _done(false);
+        std::atomic<long> _stolen(0);
+
+        std::vector<std::thread> _thieves;
+        for(int j = 0; j < nthieves; ++j)
+            _thieves.push_back(std::thread([&] ()
+            {
+                long x = 0;
+                while(!_done.load())
+                {
+                    if(_deque.steal(x))
+                    {
+                        ++_taken[x];
+                        ++_stolen;
+                    }
+                }
+                while(_deque.steal(x))
+                {
+                    ++_taken[x];
+                    ++_stolen;
+                }
+            }));
+
+        long x = 0;
+        for(long i = 0; i < n; ++i)
+        {
+            _deque.push(i);
+            if(i % 3 == 0 && _deque.pop(x))
+                ++_taken[x];
+        }
+        while(_deque.pop(x))
+            ++_taken[x];
+        _done.store(true);
+        for(auto& itr : _thieves)
+            itr.join();
+
+        long _once = 0;
+        for(auto& itr : _taken)
+            _once += (itr.load() == 1) ? 1 : 0;
+        CHECK_EQUAL(n, _once);
+    }
+
+    //------------------------------------------------------------------------//
+    // one element, owner pop against a thief: exactly one of them wins
+    {
+        const long rounds = 20000;
+        deque_type _deque;
+        std::atomic<long> _round(-1);
+        std::atomic<long> _thief_done(-1);
+        std::atomic<long> _thief_wins(0);
+
+        std::thread _thief([&] ()
+        {
+            long x = 0;
+            for(long r = 0; r < rounds; ++r)
+            {
+                while(_round.load() < r)
+                    std::this_thread::yield();
+                if(_deque.steal(x))
+                    ++_thief_wins;
+                _thief_done.store(r);
+            }
+        });
+
+        long _owner_wins = 0;
+        long x = 0;
+        for(long r = 0; r < rounds; ++r)
+        {
+            _deque.push(r);
+            _round.store(r);
+            if(_deque.pop(x))
+            {
+                CHECK_EQUAL(r, x);
+                ++_owner_wins;
+            }
+            while(_thief_done.load() < r)
+                std::this_thread::yield();
+        }
+        _thief.join();
+        CHECK_EQUAL(rounds, _owner_wins + _thief_wins.load());
+        CHECK(_deque.empty());
+    }
+}
+
+//============================================================================//
+
+TEST(Test_25_mpmc_queue)
+{
+    typedef mad::mpmc_queue<long> queue_type;
+
+    //------------------------------------------------------------------------//
+    // single producer: FIFO through the overflow, also for pushes while
+    // the overflow is not empty and the ring has room again
+    {
+        queue_type _queue(4);
+        CHECK_EQUAL(4UL, _queue.capacity());
+        long x = -1;
+        CHECK(!_queue.pop(x));
+        for(long i = 0; i < 100; ++i)
+            _queue.push(i);
+        CHECK_EQUAL(100UL, _queue.size());
+        CHECK(!_queue.try_push(100));
+
+        long _next = 0;
+        for(long i = 0; i < 2; ++i)
+        {
+            CHECK(_queue.pop(x));
+            CHECK_EQUAL(_next++, x);
+        }
+        // the ring has free cells, but these must queue behind the overflow
+        for(long i = 100; i < 110; ++i)
+            _queue.push(i);
+        while(_queue.pop(x))
+            CHECK_EQUAL(_next++, x);
+        CHECK_EQUAL(110L, _next);
+        CHECK(_queue.empty());
+
+        // back to the ring once the overflow is drained
+        CHECK(_queue.try_push(7));
+        CHECK(_queue.try_pop(x));
+        CHECK_EQUAL(7L, x);
+    }
+
+    //------------------------------------------------------------------------//
+    // saturated ring with several producers and consumers: nothing lost or
+    // duplicated while items spill to the overflow and back
+    {
+        const long nproducers = 4;
+        const long nconsumers = 4;
+        const long per_producer = 50000;
+        const long total = nproducers * per_producer;
+        queue_type _queue(8);
+        std::vector<std::atomic<int>> _taken(total);
+        for(auto& itr : _taken)
+            itr.store(0);
+        std::atomic<long> _consumed(0);
+
+        std::vector<std::thread> _threads;
+        for(long j = 0; j < nconsumers; ++j)
+            _threads.push_back(std::thread([&] ()
+            {
+                long x = 0;
+                while(_consumed.load() < total)
+                {
+                    if(!_queue.pop(x))
+                    {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    ++_taken[x];
+                    ++_consumed;
+                }
+            }));
+        for(long j = 0; j < nproducers; ++j)
+            _threads.push_back(std::thread([&, j] ()
+            {
+                for(long i = 0; i < per_producer; ++i)
+                    _queue.push(j * per_producer + i);
+            }));
+        for(auto& itr : _threads)
+            itr.join();
+
+        long _once = 0;
+        for(auto& itr : _taken)
+            _once += (itr.load() == 1) ? 1 : 0;
+        CHECK_EQUAL(total, _once);
+        CHECK(_queue.empty());
+    }
+}
+
+//============================================================================//
+
+TEST(Test_26_idle_policies)
+{
+    //------------------------------------------------------------------------//
+    // MAD_IDLE_POLICY
+    unsetenv("MAD_IDLE_POLICY");
+    CHECK(thread_pool::GetEnvIdlePolicy(idle_policy::active) ==
+          idle_policy::active);
+    setenv("MAD_IDLE_POLICY", "Passive", 1);
+    CHECK(thread_pool::GetEnvIdlePolicy() == idle_policy::passive);
+    setenv("MAD_IDLE_POLICY", "adaptive", 1);
+    CHECK(thread_pool::GetEnvIdlePolicy(idle_policy::passive) ==
+          idle_policy::adaptive);
+    setenv("MAD_IDLE_POLICY", "2", 1);
+    CHECK(thread_pool::GetEnvIdlePolicy() == idle_policy::active);
+    setenv("MAD_IDLE_POLICY", "sometimes", 1);
+    CHECK(thread_pool::GetEnvIdlePolicy(idle_policy::passive) ==
+          idle_policy::passive);
+    unsetenv("MAD_IDLE_POLICY");
+
+    // true once _pred() holds, false after ~2 seconds
+    auto eventually = [] (std::function<bool()> _pred) -> bool
+    {
+        for(int i = 0; i < 2000 && !_pred(); ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return _pred();
+    };
+
+    //------------------------------------------------------------------------//
+    // with every policy, tasks submitted to idle (or parked) workers all run
+    const ulong_type nworkers = 4;
+    idle_policy _policies[] = { idle_policy::passive, idle_policy::adaptive,
+                                idle_policy::active };
+    for(auto _policy : _policies)
+    {
+        thread_manager* tm = new thread_manager(nworkers, false);
+        mad::thread_pool* tp = tm->thread_pool();
+        tp->set_idle_policy(_policy);
+        tp->set_spin_count(16);
+        tp->set_yield_count(4);
+
+        for(int round = 0; round < 3; ++round)
+        {
+            if(_policy != idle_policy::active)
+                CHECK(eventually([&] ()
+                      { return tp->num_sleeping() == nworkers; }));
+            ulong_ts count = 0;
+            mad::task_group tg(tp);
+            for(ulong_type i = 0; i < 100; ++i)
+                tm->exec(&tg, [&] () { ++count; });
+            tg.join();
+            CHECK_EQUAL(100UL, count.load());
+        }
+        if(_policy == idle_policy::active)
+            CHECK_EQUAL(0UL, tp->num_sleeping());
+        delete tm;
+    }
+
+    //------------------------------------------------------------------------//
+    // one task wakes one parked worker, n tasks at most n
+    {
+        thread_manager* tm = new thread_manager(nworkers, false);
+        mad::thread_pool* tp = tm->thread_pool();
+        tp->set_idle_policy(idle_policy::passive);
+        CHECK(eventually([&] () { return tp->num_sleeping() == nworkers; }));
+
+        std::atomic<bool> _release(false);
+        ulong_ts _running = 0;
+        auto _blocking = [&] ()
+        {
+            ++_running;
+            while(!_release.load())
+                std::this_thread::yield();
+        };
+
+        mad::task_group tg(tp);
+        tm->exec(&tg, _blocking);
+        CHECK(eventually([&] () { return _running.load() == 1; }));
+        CHECK_EQUAL(nworkers - 1, tp->num_sleeping());
+
+        tm->exec(&tg, _blocking);
+        tm->exec(&tg, _blocking);
+        CHECK(eventually([&] () { return _running.load() == 3; }));
+        CHECK_EQUAL(nworkers - 3, tp->num_sleeping());
+
+        _release.store(true);
+        tg.join();
+        delete tm;
+    }
+}
+
+//============================================================================//
+
+namespace
+{
+// nthreads x niter increments of a plain counter under _Mutex, "inside"
+// counts the threads in the critical section
+template <typename _Mutex>
+bool check_mutual_exclusion(ulong_type nthreads, ulong_type niter)
+{
+    _Mutex _mutex;
+    ulong_type _counter = 0;
+    std::atomic<int> _inside(0);
+    std::atomic<bool> _overlap(false);
+
+    std::vector<std::thread> _threads;
+    for(ulong_type i = 0; i < nthreads; ++i)
+        _threads.push_back(std::thread([&] ()
+        {
+            for(ulong_type j = 0; j < niter; ++j)
+            {
+                std::lock_guard<_Mutex> l(_mutex);
+                if(++_inside != 1)
+                    _overlap.store(true);
+                ++_counter;
+                --_inside;
+            }
+        }));
+    for(auto& itr : _threads)
+        itr.join();
+
+    // try_lock fails while another thread holds the lock
+    _mutex.lock();
+    bool _acquired = true;
+    std::thread([&] () { _acquired = _mutex.try_lock(); }).join();
+    _mutex.unlock();
+    bool _free = _mutex.try_lock();
+    if(_free)
+        _mutex.unlock();
+
+    return !_overlap.load() && _counter == nthreads * niter &&
+           !_acquired && _free;
+}
+}
+
+//============================================================================//
+
+TEST(Test_27_locks_and_eventcount)
+{
+    CHECK(check_mutual_exclusion<mad::fast_mutex>(8, 20000));
+    CHECK(check_mutual_exclusion<mad::spin_mutex>(8, 20000));
+
+    //------------------------------------------------------------------------//
+    // ping-pong through one eventcount, both sides sleep between turns. A
+    // lost wake-up would hang: after the deadline everybody is released
+    // and the test fails
+    const long rounds = 5000;
+    mad::eventcount _event;
+    std::atomic<long> _turn(0);
+    std::atomic<bool> _abort(false);
+
+    auto _player = [&] (long _parity)
+    {
+        for(long r = _parity; r < 2 * rounds; r += 2)
+        {
+            // the hand-written form of await(), with cancel_wait
+            while(_turn.load() != r && !_abort.load())
+            {
+                mad::eventcount::key_type _key = _event.prepare_wait();
+                if(_turn.load() == r || _abort.load())
+                {
+                    _event.cancel_wait();
+                    break;
+                }
+                _event.wait(_key);
+            }
+            _turn.store(r + 1);
+            _event.notify_all();
+        }
+    };
+    std::thread _even(_player, 0L);
+    std::thread _odd(_player, 1L);
+
+    //------------------------------------------------------------------------//
+    // several waiters on a flag, woken by notify_all or one by one
+    std::atomic<int> _flag(0);
+    std::atomic<int> _woken(0);
+    std::vector<std::thread> _waiters;
+    for(int i = 0; i < 4; ++i)
+        _waiters.push_back(std::thread([&, i] ()
+        {
+            _event.await([&] ()
+            { return _flag.load() > (i % 2) || _abort.load(); });
+            ++_woken;
+        }));
+    _flag.store(1);
+    _event.notify_one();
+    _event.notify_one();
+    _flag.store(2);
+    _event.notify_all();
+
+    auto _deadline = std::chrono::steady_clock::now() +
+                     std::chrono::seconds(30);
+    while((_turn.load() < 2 * rounds || _woken.load() < 4) &&
+          std::chrono::steady_clock::now() < _deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    CHECK_EQUAL(2 * rounds, _turn.load());
+    CHECK_EQUAL(4, _woken.load());
+
+    _abort.store(true);
+    _event.notify_all();
+    _even.join();
+    _odd.join();
+    for(auto& itr : _waiters)
+        itr.join();
+}
+
+//============================================================================//
+
+namespace
+{
+//----------------------------------------------------------------------------//
+// callable that counts its destructions, optionally padded past the inline
+// buffer of small_function, and owning a move-only resource
+template <std::size_t _Pad>
+struct counted_callable
+{
+    counted_callable(int* _destroyed, int _value)
+    : destroyed(_destroyed), value(new int(_value)), pad()
+    { }
+    counted_callable(counted_callable&& rhs)
+    : destroyed(rhs.destroyed), value(std::move(rhs.value)), pad()
+    { }
+    ~counted_callable() { if(value) ++(*destroyed); }
+
+    int operator()(int _add) const { return *value + _add + (int) pad[0]; }
+
+    int*                    destroyed;
+    std::unique_ptr<int>    value;
+    char                    pad[_Pad];
+};
+
+//----------------------------------------------------------------------------//
+// free-list allocated objects of a given size
+template <std::size_t _Size>
+struct freelist_object : public mad::FreeListAllocator_tl
+{
+    char data[_Size];
+};
+}
+
+//============================================================================//
+
+TEST(Test_28_task_storage)
+{
+    //------------------------------------------------------------------------//
+    // small_function: inline up to 48 bytes, heap above, move-only callables
+    {
+        typedef mad::small_function<int(int)> function_type;
+        int _destroyed = 0;
+        {
+            function_type _small(counted_callable<8>(&_destroyed, 1));
+            function_type _large(counted_callable<64>(&_destroyed, 2));
+            CHECK(!_small.is_heap_allocated());
+            CHECK(_large.is_heap_allocated());
+            CHECK_EQUAL(11, _small(10));
+            CHECK_EQUAL(12, _large(10));
+            // the moved-from temporaries own nothing
+            CHECK_EQUAL(0, _destroyed);
+        }
+        CHECK_EQUAL(2, _destroyed);
+
+        // a lambda with 48 bytes of captures still fits
+        double a = 1, b = 2, c = 3, d = 4, e = 5, f = 6;
+        function_type _lambda([=] (int i) { return (int) (a+b+c+d+e+f) + i; });
+        CHECK(!_lambda.is_heap_allocated());
+        CHECK_EQUAL(22, _lambda(1));
+    }
+
+    //------------------------------------------------------------------------//
+    // FreeListAllocator_tl: 64-byte size classes, blocks are recycled by the
+    // next allocation of the same class on the same thread
+    {
+        freelist_object<24>* _a = new freelist_object<24>;
+        void* _addr = _a;
+        delete _a;
+        freelist_object<60>* _b = new freelist_object<60>;
+        CHECK_EQUAL(_addr, (void*) _b);
+        // another size class does not get the block
+        delete _b;
+        freelist_object<100>* _c = new freelist_object<100>;
+        CHECK(_addr != (void*) _c);
+        freelist_object<30>* _d = new freelist_object<30>;
+        CHECK_EQUAL(_addr, (void*) _d);
+        delete _c;
+        delete _d;
+        // larger than the largest class: plain heap, still released fine
+        delete new freelist_object<1000>;
+
+        // a block allocated without the thread's list (after it was torn
+        // down) can be cached later: it must hold the largest size of its
+        // class
+        void* _block = mad::details::freelist::allocate_block(390);
+        mad::details::freelist::instance()->deallocate(_block, 390);
+        freelist_object<440>* _e = new freelist_object<440>;
+        CHECK_EQUAL(_block, (void*) _e);
+        std::fill(_e->data, _e->data + 440, 'x');
+        delete _e;
+    }
+
+    //------------------------------------------------------------------------//
+    // task::get() from a non-worker sleeps until the task ran and rethrows
+    // what the task threw
+    {
+        thread_manager* tm = thread_manager::get_thread_manager(4);
+        mad::task_group tg;
+        mad::task<int>* _slow = new mad::task<int>(&tg, [] () -> int
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            return 42;
+        });
+        mad::task<int>* _fail = new mad::task<int>(&tg, [] () -> int
+        { throw std::runtime_error("task failed"); });
+        tm->thread_pool()->add_task(_slow);
+        tm->thread_pool()->add_task(_fail);
+
+        CHECK_EQUAL(42, _slow->get_result());
+        CHECK_THROW(_fail->get_result(), std::runtime_error);
+        // the group reports the exception once as well
+        CHECK_THROW(tg.join(), std::runtime_error);
+        tg.join();
+        CHECK(_fail->is_done());
+    }
+}
+
+//============================================================================//
+
+TEST(Test_29_join_protocol)
+{
+    ulong_type num_threads = 4;
+    thread_manager* tm = thread_manager::get_thread_manager(num_threads);
+
+    // tasks block until released, so the joiner runs out of work to help
+    // with and goes to sleep
+    std::atomic<bool> _release(false);
+    auto _gated = [&] () -> void
+    {
+        while(!_release.load())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    };
+    auto _release_after = [&] (long _ms)
+    {
+        return std::thread([&, _ms] ()
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(_ms));
+            _release.store(true);
+        });
+    };
+
+    //------------------------------------------------------------------------//
+    // a non-worker joiner sleeps while the tasks complete
+    {
+        _release.store(false);
+        ulong_ts count = 0;
+        mad::task_group tg;
+        for(ulong_type i = 0; i < 2 * num_threads; ++i)
+            tm->exec(&tg, [&] () { _gated(); ++count; });
+        std::thread _releaser = _release_after(50);
+        tg.join();
+        _releaser.join();
+        CHECK_EQUAL(2 * num_threads, count.load());
+        CHECK_EQUAL(0L, (long) tg.task_count());
+    }
+
+    //------------------------------------------------------------------------//
+    // tasks added while the joiner sleeps, by a task and by another thread
+    {
+        _release.store(false);
+        ulong_ts count = 0;
+        mad::task_group tg;
+        tm->exec(&tg, [&] ()
+        {
+            _gated();
+            for(ulong_type i = 0; i < 100; ++i)
+                tm->exec(&tg, [&] () { ++count; });
+        });
+        std::thread _adder([&] ()
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            for(ulong_type i = 0; i < 100; ++i)
+                tm->exec(&tg, [&] () { ++count; });
+            _release.store(true);
+        });
+        tg.join();
+        _adder.join();
+        CHECK_EQUAL(200UL, count.load());
+        CHECK_EQUAL(0L, (long) tg.task_count());
+    }
+
+    //------------------------------------------------------------------------//
+    // repeated join/add cycles on one group, then groups destroyed right
+    // after their join returns, from a thread that is not a worker
+    {
+        ulong_ts count = 0;
+        mad::task_group tg;
+        for(ulong_type cycle = 1; cycle <= 500; ++cycle)
+        {
+            for(ulong_type i = 0; i < cycle % 7; ++i)
+                tm->exec(&tg, [&] () { ++count; });
+            tg.join();
+            CHECK_EQUAL(0L, (long) tg.task_count());
+        }
+        ulong_type _expected = 0;
+        for(ulong_type cycle = 1; cycle <= 500; ++cycle)
+            _expected += cycle % 7;
+        CHECK_EQUAL(_expected, count.load());
+
+        count = 0;
+        std::thread _joiner([&] ()
+        {
+            for(ulong_type cycle = 0; cycle < 500; ++cycle)
+            {
+                mad::task_group* _tg = new mad::task_group(tm->thread_pool());
+                for(ulong_type i = 0; i < num_threads; ++i)
+                    tm->exec(_tg, [&] () { ++count; });
+                _tg->join();
+                delete _tg;
+            }
+        });
+        _joiner.join();
+        CHECK_EQUAL(500 * num_threads, count.load());
+    }
+}
+
+//============================================================================//